@@ -0,0 +1,512 @@
+/*
+**    Yayo is a UCI chess engine written by am5083 (am@kvasm.us)
+**    Copyright (C) 2022 Ahmed Mohamed (am@kvasm.us)
+**
+**    This program is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**    This program is distributed in the hope that it will be useful,
+**    but WITHOUT ANY WARRANTY; without even the implied warranty of
+**    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**    GNU General Public License for more details.
+**
+**    You should have received a copy of the GNU General Public License
+**    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "bitbase.hpp"
+#include "movegen.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace Yayo {
+
+Bitbases bitbases;
+
+namespace {
+
+// every table only depends on the ones listed before it
+const char *tableNames[] = {"KQK",  "KRK",  "KPK",  "KQKQ", "KQKR",
+                            "KQKB", "KQKN", "KRKR", "KRKB", "KRKN",
+                            "KBBK", "KBNK", "KQKP", "KRKP"};
+
+constexpr char BB_MAGIC[4] = {'Y', 'B', 'B', '1'};
+constexpr std::size_t BB_HEADER = 16;
+
+// generation state of a position, WIN and LOSS are final
+enum GenState : std::uint8_t { G_UNKNOWN, G_WIN, G_LOSS, G_DRAW, G_INVALID };
+
+// Index layout: side to move, white king folded onto files a-d, then
+// 6 bits per remaining piece in table order. Colors are flipped so the
+// stronger side is always white.
+std::uint32_t encode(const Bitbase &t, int stm, const int *sq) {
+    std::uint32_t idx = stm * 32 + (sq[0] >> 3) * 4 + (sq[0] & 7);
+
+    for (int i = 1; i < t.count; i++)
+        idx = idx * 64 + sq[i];
+
+    return idx;
+}
+
+void decode(const Bitbase &t, std::uint32_t idx, int &stm, int *sq) {
+    for (int i = t.count - 1; i > 0; i--) {
+        sq[i] = idx & 63;
+        idx >>= 6;
+    }
+
+    sq[0] = ((idx & 31) >> 2) * 8 + (idx & 3);
+    stm = idx >> 5;
+}
+
+// mirror the white king onto files a-d and order a pair of like pieces
+void canonical(const Bitbase &t, int *sq) {
+    if ((sq[0] & 7) > 3)
+        for (int i = 0; i < t.count; i++)
+            sq[i] ^= 7;
+
+    if (t.count == 4 && t.pcs[2] == t.pcs[3] && sq[2] > sq[3])
+        std::swap(sq[2], sq[3]);
+}
+
+bool isPawnRank(int sq) { return sq >= 8 && sq < 56; }
+
+void place(Board &board, const Bitbase &t, int stm, const int *sq) {
+    for (int i = 0; i < t.count; i++) {
+        const Piece pc = t.pcs[i];
+        const Bitboard bb = SQUARE_BB(Square(sq[i]));
+
+        board.board[sq[i]] = pc;
+        board.pieceBB[pc] |= bb;
+        board.cPieceBB[getPcType(pc)] |= bb;
+        board.color[pc >> 3] |= bb;
+    }
+
+    board.turn = Color(stm);
+    const Bitboard occ = board.pieces();
+    board.checkPcs =
+          stm == WHITE ? board.attacksToKing<BLACK>(Square(sq[0]), occ)
+                       : board.attacksToKing<WHITE>(Square(sq[1]), occ);
+}
+
+void remove(Board &board, const Bitbase &t, const int *sq) {
+    for (int i = 0; i < t.count; i++) {
+        const Piece pc = t.pcs[i];
+
+        board.board[sq[i]] = NO_PC;
+        board.pieceBB[pc] = 0;
+        board.cPieceBB[getPcType(pc)] = 0;
+    }
+
+    board.color[WHITE] = board.color[BLACK] = 0;
+    board.checkPcs = 0;
+}
+
+// squares the piece on sq could have come from without capturing
+Bitboard unmoves(Piece pc, int sq, Bitboard occ) {
+    const Square s = Square(sq);
+
+    switch (getPcType(pc)) {
+    case PAWN: {
+        const int dir = pc == W_PAWN ? 8 : -8;
+        const int from = sq + dir;
+        if (!isPawnRank(from) || (occ & SQUARE_BB(Square(from))))
+            return 0;
+
+        Bitboard b = SQUARE_BB(Square(from));
+        const bool fourthRank = pc == W_PAWN ? (sq >> 3) == 4 : (sq >> 3) == 3;
+        if (fourthRank && !(occ & SQUARE_BB(Square(from + dir))))
+            b |= SQUARE_BB(Square(from + dir));
+
+        return b;
+    }
+    case KNIGHT:
+        return knightAttacks[s] & ~occ;
+    case BISHOP:
+        return getBishopAttacks(s, occ) & ~occ;
+    case ROOK:
+        return getRookAttacks(s, occ) & ~occ;
+    case QUEEN:
+        return (getBishopAttacks(s, occ) | getRookAttacks(s, occ)) & ~occ;
+    case KING:
+        return kingAttacks[s] & ~occ;
+    default:
+        return 0;
+    }
+}
+
+} // namespace
+
+Bitbases::~Bitbases() { clear(); }
+
+void Bitbases::setup() {
+    if (!tables.empty())
+        return;
+
+    for (const char *name : tableNames) {
+        Bitbase t;
+        int counts[2][PT_MAX] = {};
+        int side = -1;
+
+        t.name = name;
+        t.count = 0;
+
+        for (const char *c = name; *c; c++) {
+            if (*c == 'K') {
+                side++;
+                continue;
+            }
+
+            const PieceT pt = *c == 'P'   ? PAWN
+                              : *c == 'N' ? KNIGHT
+                              : *c == 'B' ? BISHOP
+                              : *c == 'R' ? ROOK
+                                          : QUEEN;
+            t.pcs[2 + t.count++] = getCPiece(Color(side), pt);
+            counts[side][pt]++;
+        }
+
+        t.pcs[0] = W_KING;
+        t.pcs[1] = B_KING;
+        t.count += 2;
+
+        t.key = materialKeyOf(counts);
+        std::swap(counts[WHITE], counts[BLACK]);
+        t.key2 = materialKeyOf(counts);
+
+        t.size = 2 * 32;
+        for (int i = 1; i < t.count; i++)
+            t.size *= 64;
+
+        tables.push_back(std::move(t));
+    }
+}
+
+void Bitbases::clear() {
+    for (Bitbase &t : tables) {
+        if (t.mapping)
+            munmap(t.mapping, t.mapLen);
+
+        t.mapping = nullptr;
+        t.owned.clear();
+        t.data = nullptr;
+    }
+
+    loaded = 0;
+}
+
+const Bitbase *Bitbases::find(std::uint64_t key) const {
+    for (const Bitbase &t : tables)
+        if (t.data && (t.key == key || t.key2 == key))
+            return &t;
+
+    return nullptr;
+}
+
+BBResult Bitbases::probe(const Board &board) const {
+    if (!loaded || popcount(board.pieces()) > BB_PIECES || board.castleRights)
+        return BB_NONE;
+
+    const std::uint64_t key = board.materialKey();
+    const Bitbase *t = find(key);
+    if (!t)
+        return BB_NONE;
+
+    // black is the stronger side, look at the position from its side
+    const int flip = key != t->key;
+    Bitboard used = 0;
+    int sq[BB_PIECES];
+
+    for (int i = 0; i < t->count; i++) {
+        const Piece pc = Piece(t->pcs[i] ^ (flip * 8));
+        const int s = __builtin_ctzll(board.pieceBB[pc] & ~used);
+
+        used |= SQUARE_BB(Square(s));
+        sq[i] = s ^ (flip * 56);
+    }
+
+    canonical(*t, sq);
+    return t->at(encode(*t, board.turn ^ flip, sq));
+}
+
+int Bitbases::load(const std::string &dir) {
+    setup();
+    clear();
+
+    if (dir.empty() || dir == "<empty>")
+        return 0;
+
+    for (Bitbase &t : tables) {
+        const std::string path = dir + "/" + t.name + ".ybb";
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd == -1)
+            continue;
+
+        struct stat st;
+        fstat(fd, &st);
+
+        const std::size_t expected = BB_HEADER + (t.size + 3) / 4;
+        void *base = std::size_t(st.st_size) == expected
+                           ? mmap(nullptr, expected, PROT_READ, MAP_SHARED, fd, 0)
+                           : MAP_FAILED;
+        ::close(fd);
+
+        std::uint64_t key = 0;
+        if (base != MAP_FAILED)
+            std::memcpy(&key, (const char *)base + 8, sizeof(key));
+
+        if (base == MAP_FAILED || std::memcmp(base, BB_MAGIC, 4) ||
+            key != t.key) {
+            std::cerr << "info string corrupt bitbase " << path << std::endl;
+            if (base != MAP_FAILED)
+                munmap(base, expected);
+            continue;
+        }
+
+        t.mapping = base;
+        t.mapLen = expected;
+        t.data = (const std::uint8_t *)base + BB_HEADER;
+        loaded++;
+    }
+
+    return loaded;
+}
+
+bool Bitbases::write(const Bitbase &t, const std::string &dir) const {
+    std::ofstream out(dir + "/" + t.name + ".ybb", std::ios::binary);
+    if (!out)
+        return false;
+
+    char header[BB_HEADER] = {0};
+    const std::uint32_t size = t.size;
+    std::memcpy(header, BB_MAGIC, 4);
+    std::memcpy(header + 4, &size, sizeof(size));
+    std::memcpy(header + 8, &t.key, sizeof(t.key));
+
+    out.write(header, BB_HEADER);
+    out.write((const char *)t.data, (t.size + 3) / 4);
+    return bool(out);
+}
+
+// Retrograde analysis. A first pass over every index runs the move
+// generator: mates and stalemates are final, moves leaving the table
+// (captures, promotions) are looked up in the smaller tables, and the
+// moves staying inside are counted. Then results are pushed backwards
+// with un-moves: a loss makes every predecessor a win, a win decrements
+// its predecessors' counters and a counter reaching zero is a loss.
+// Whatever is never reached is a draw.
+bool Bitbases::build(Bitbase &t) {
+    const std::uint32_t n = t.size;
+    std::unique_ptr<std::atomic<std::uint8_t>[]> state(
+          new std::atomic<std::uint8_t>[n]);
+    std::unique_ptr<std::atomic<std::uint8_t>[]> degree(
+          new std::atomic<std::uint8_t>[n]);
+
+    std::vector<std::uint32_t> frontier;
+    std::atomic_bool missing{false};
+
+#pragma omp parallel
+    {
+        std::unique_ptr<Board> board = std::make_unique<Board>();
+        std::vector<std::uint32_t> found;
+
+#pragma omp for schedule(dynamic, 4096)
+        for (std::int64_t i = 0; i < std::int64_t(n); i++) {
+            int stm, sq[BB_PIECES];
+            decode(t, i, stm, sq);
+
+            bool valid = true;
+            for (int a = 0; a < t.count && valid; a++) {
+                if (getPcType(t.pcs[a]) == PAWN && !isPawnRank(sq[a]))
+                    valid = false;
+                for (int b = a + 1; b < t.count; b++)
+                    valid &= sq[a] != sq[b];
+            }
+
+            // only the ordered copy of a pair of like pieces is used
+            if (t.count == 4 && t.pcs[2] == t.pcs[3] && sq[2] > sq[3])
+                valid = false;
+
+            if (!valid) {
+                state[i].store(G_INVALID, std::memory_order_relaxed);
+                continue;
+            }
+
+            place(*board, t, stm, sq);
+
+            // the side that just moved can't be left in check
+            if (board->isSqAttacked(Square(sq[stm ^ 1]), board->pieces(),
+                                    Color(stm))) {
+                remove(*board, t, sq);
+                state[i].store(G_INVALID, std::memory_order_relaxed);
+                continue;
+            }
+
+            moveList mList = {0};
+            Yayo::generate(*board, &mList);
+
+            GenState result = G_UNKNOWN;
+            int inside = 0;
+
+            if (!mList.nMoves)
+                result = board->checkPcs ? G_LOSS : G_DRAW;
+
+            for (int m = 0; m < mList.nMoves && result == G_UNKNOWN; m++) {
+                const unsigned short move = mList.moves[m].move;
+
+                if (getCapture(move) < CAPTURE) {
+                    inside++;
+                    continue;
+                }
+
+                make(*board, move);
+                const BBResult r =
+                      board->isDraw() ? BB_DRAW : probe(*board);
+                unmake(*board, move);
+
+                if (r == BB_NONE)
+                    missing = true;
+                else if (r == BB_LOSS)
+                    result = G_WIN;
+                else if (r == BB_DRAW)
+                    inside++; // keeps the position from ever being lost
+            }
+
+            if (result == G_UNKNOWN && !inside)
+                result = G_LOSS;
+
+            remove(*board, t, sq);
+            state[i].store(result, std::memory_order_relaxed);
+            degree[i].store(inside, std::memory_order_relaxed);
+
+            if (result == G_WIN || result == G_LOSS)
+                found.push_back(i);
+        }
+
+#pragma omp critical
+        frontier.insert(frontier.end(), found.begin(), found.end());
+    }
+
+    if (missing) {
+        std::cerr << "info string bitbase " << t.name
+                  << " needs a missing table" << std::endl;
+        return false;
+    }
+
+    while (!frontier.empty()) {
+        std::vector<std::uint32_t> next;
+
+#pragma omp parallel
+        {
+            std::vector<std::uint32_t> found;
+
+#pragma omp for schedule(dynamic, 1024)
+            for (std::size_t f = 0; f < frontier.size(); f++) {
+                const std::uint32_t idx = frontier[f];
+                const std::uint8_t value =
+                      state[idx].load(std::memory_order_relaxed);
+
+                int stm, sq[BB_PIECES];
+                decode(t, idx, stm, sq);
+
+                Bitboard occ = 0;
+                for (int i = 0; i < t.count; i++)
+                    occ |= SQUARE_BB(Square(sq[i]));
+
+                const int mover = stm ^ 1;
+
+                for (int i = 0; i < t.count; i++) {
+                    if ((t.pcs[i] >> 3) != mover)
+                        continue;
+
+                    Bitboard from = unmoves(t.pcs[i], sq[i], occ);
+                    while (from) {
+                        int prev[BB_PIECES];
+                        std::memcpy(prev, sq, sizeof(prev));
+                        prev[i] = __builtin_ctzll(from);
+                        from &= from - 1;
+
+                        canonical(t, prev);
+                        const std::uint32_t p = encode(t, mover, prev);
+
+                        std::uint8_t expected = G_UNKNOWN;
+                        if (state[p].load(std::memory_order_relaxed) !=
+                            G_UNKNOWN)
+                            continue;
+
+                        if (value == G_LOSS) {
+                            if (state[p].compare_exchange_strong(expected,
+                                                                 G_WIN))
+                                found.push_back(p);
+                        } else if (degree[p].fetch_sub(1) == 1) {
+                            if (state[p].compare_exchange_strong(expected,
+                                                                 G_LOSS))
+                                found.push_back(p);
+                        }
+                    }
+                }
+            }
+
+#pragma omp critical
+            next.insert(next.end(), found.begin(), found.end());
+        }
+
+        frontier.swap(next);
+    }
+
+    std::uint64_t wins = 0, losses = 0, draws = 0;
+    t.owned.assign((n + 3) / 4, 0);
+
+    for (std::uint32_t i = 0; i < n; i++) {
+        const std::uint8_t s = state[i].load(std::memory_order_relaxed);
+        const BBResult r = s == G_WIN       ? BB_WIN
+                           : s == G_LOSS    ? BB_LOSS
+                           : s == G_INVALID ? BB_NONE
+                                            : BB_DRAW;
+
+        wins += r == BB_WIN;
+        losses += r == BB_LOSS;
+        draws += r == BB_DRAW;
+        t.owned[i >> 2] |= r << ((i & 3) * 2);
+    }
+
+    t.data = t.owned.data();
+    loaded++;
+
+    std::cout << "info string bitbase " << t.name << " " << wins << " wins "
+              << losses << " losses " << draws << " draws" << std::endl;
+    return true;
+}
+
+void Bitbases::generate(const std::string &dir,
+                        const std::vector<std::string> &only) {
+    load(dir);
+
+    for (Bitbase &t : tables) {
+        if (t.data || (!only.empty() && std::find(only.begin(), only.end(),
+                                                  t.name) == only.end()))
+            continue;
+
+        const std::uint64_t start = get_time();
+        if (!build(t))
+            return;
+
+        if (!write(t, dir))
+            std::cerr << "info string could not write bitbase " << t.name
+                      << " to " << dir << std::endl;
+
+        std::cout << "info string bitbase " << t.name << " built in "
+                  << get_time() - start << " ms" << std::endl;
+    }
+}
+
+} // namespace Yayo
@@ -0,0 +1,95 @@
+/*
+**    Yayo is a UCI chess engine written by am5083 (am@kvasm.us)
+**    Copyright (C) 2022 Ahmed Mohamed (am@kvasm.us)
+**
+**    This program is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**    This program is distributed in the hope that it will be useful,
+**    but WITHOUT ANY WARRANTY; without even the implied warranty of
+**    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**    GNU General Public License for more details.
+**
+**    You should have received a copy of the GNU General Public License
+**    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BITBASE_H_
+#define BITBASE_H_
+#include "board.hpp"
+#include "util.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Yayo {
+
+#define BB_PIECES 4
+// eval bonus for a won bitbase position, stays far below the mate scores
+#define BB_WIN_BONUS 1000
+
+// results are relative to the side to move
+enum BBResult : std::uint8_t {
+    BB_DRAW = 0,
+    BB_WIN = 1,
+    BB_LOSS = 2,
+    BB_NONE = 3, // no table, or an index that is never a legal position
+};
+
+// eval offset of a probed result, a draw is exact and returned as is
+constexpr int bbBonus(BBResult r) {
+    return r == BB_WIN ? BB_WIN_BONUS : r == BB_LOSS ? -BB_WIN_BONUS : 0;
+}
+
+// one material combination, stronger side as white, 2 bits per position
+struct Bitbase {
+    std::string name;
+    Piece pcs[BB_PIECES];
+    int count;
+    std::uint64_t key, key2;
+    std::uint32_t size;
+
+    const std::uint8_t *data = nullptr;
+    std::vector<std::uint8_t> owned;
+    void *mapping = nullptr;
+    std::size_t mapLen = 0;
+
+    BBResult at(std::uint32_t idx) const {
+        return BBResult((data[idx >> 2] >> ((idx & 3) * 2)) & 3);
+    }
+};
+
+// Win/draw/loss bitbases for 3- and 4-piece endings, built in the engine by
+// retrograde analysis and stored as bit-packed files that are mmapped back.
+class Bitbases {
+  public:
+    ~Bitbases();
+
+    // maps every table present in dir, returns how many were found
+    int load(const std::string &dir);
+    // builds and writes the tables missing from dir, smaller ones first;
+    // a list of names limits it to those, their dependencies must be
+    // listed too or be in dir
+    void generate(const std::string &dir,
+                  const std::vector<std::string> &only = {});
+
+    BBResult probe(const Board &board) const;
+
+  private:
+    void setup();
+    void clear();
+    bool build(Bitbase &t);
+    bool write(const Bitbase &t, const std::string &dir) const;
+    const Bitbase *find(std::uint64_t key) const;
+
+    std::vector<Bitbase> tables;
+    int loaded = 0;
+};
+
+extern Bitbases bitbases;
+
+} // namespace Yayo
+
+#endif // BITBASE_H_
@@ -63,6 +63,7 @@ extern std::uint64_t zobristBlackToMove;
 extern std::uint64_t zobristEpFile[8];
 extern std::uint64_t zobristCastleRights[16];
 extern std::uint64_t zobristPieceSq[16][64];
+extern const std::uint64_t polyglotRandom[781];
 
 constexpr Bitboard FILE_BB(File f) { return A_FILEBB << f; };
 
@@ -164,6 +164,7 @@ void Board::setFen(const std::string fen) {
     key = 0;
     ply = 0;
     gamePly = 0;
+    pliesFromNull = 0;
     lastCapt = NO_PC;
     color[WHITE] = 0;
     color[BLACK] = 0;
@@ -310,6 +311,158 @@ std::uint64_t Board::hash() const {
     return h;
 }
 
+// the same position hashed the way Polyglot books index it
+std::uint64_t Board::polyglotKey() const {
+    std::uint64_t h = 0;
+
+    for (Bitboard b = pieces(); b; b &= b - 1) {
+        const int sq = __builtin_ctzll(b);
+        const Piece pc = board[sq];
+        const int kind = 2 * (getPcType(pc) - 1) + ((pc >> 3) == WHITE);
+
+        h ^= polyglotRandom[64 * kind + 8 * (7 - (sq >> 3)) + (sq & 7)];
+    }
+
+    constexpr int rights[] = {WHITE_KING, WHITE_QUEEN, BLACK_KING, BLACK_QUEEN};
+    for (int i = 0; i < 4; i++)
+        if (castleRights & rights[i])
+            h ^= polyglotRandom[768 + i];
+
+    // only when a pawn could actually take en passant
+    if (enPass != SQUARE_64 &&
+        (pawnAttacks[~turn][enPass] & pieces(PAWN, turn)))
+        h ^= polyglotRandom[772 + (enPass & 7)];
+
+    if (turn == WHITE)
+        h ^= polyglotRandom[780];
+
+    return h;
+}
+
+// bijective 64-bit finalizer, spreads every bit of the input over the key
+static constexpr std::uint64_t mix64(std::uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+// keys of the pawn structure and the material balance, computed from the
+// bitboards instead of being carried through make/unmake
+std::uint64_t Board::pawnKey() const {
+    return mix64(pieces(PAWN, WHITE)) ^
+           mix64(pieces(PAWN, BLACK) ^ 0x9e3779b97f4a7c15ULL);
+}
+
+std::uint64_t Board::materialKey() const {
+    int counts[2][PT_MAX] = {};
+
+    for (int pt = PAWN; pt <= QUEEN; pt++) {
+        counts[WHITE][pt] = popcount(pieces(PieceT(pt), WHITE));
+        counts[BLACK][pt] = popcount(pieces(PieceT(pt), BLACK));
+    }
+
+    return materialKeyOf(counts);
+}
+
+std::uint64_t materialKeyOf(const int counts[2][PT_MAX]) {
+    std::uint64_t packed = 0;
+
+    for (int pt = PAWN; pt <= QUEEN; pt++)
+        packed = (packed << 8) | (counts[WHITE][pt] << 4) | counts[BLACK][pt];
+
+    return mix64(packed);
+}
+
+std::uint64_t cuckoo[8192];
+unsigned short cuckooMove[8192];
+
+void initCuckoo() {
+    std::fill(std::begin(cuckoo), std::end(cuckoo), 0);
+    std::fill(std::begin(cuckooMove), std::end(cuckooMove), NO_MOVE);
+
+    for (int pc = W_KNIGHT; pc < PC_MAX; pc++) {
+        const PieceT pt = getPcType(Piece(pc));
+        if (pt < KNIGHT || pt > KING)
+            continue;
+
+        for (int s1 = 0; s1 < 64; s1++) {
+            for (int s2 = s1 + 1; s2 < 64; s2++) {
+                const Bitboard atks =
+                      pt == KNIGHT   ? knightAttacks[s1]
+                      : pt == KING   ? kingAttacks[s1]
+                      : pt == BISHOP ? getBishopAttacks(Square(s1), 0)
+                      : pt == ROOK   ? getRookAttacks(Square(s1), 0)
+                                     : getBishopAttacks(Square(s1), 0) |
+                                             getRookAttacks(Square(s1), 0);
+                if (!(atks & SQUARE_BB(Square(s2))))
+                    continue;
+
+                unsigned short move =
+                      encodeMove(Square(s1), Square(s2), QUIET);
+                std::uint64_t key =
+                      zobristPieceSq[pc][s1] ^ zobristPieceSq[pc][s2] ^ 1;
+
+                // insert, displacing whatever sits in the slot until an
+                // empty one is found
+                int i = cuckooH1(key);
+                while (true) {
+                    std::swap(cuckoo[i], key);
+                    std::swap(cuckooMove[i], move);
+                    if (move == NO_MOVE)
+                        break;
+                    i = (i == cuckooH1(key)) ? cuckooH2(key) : cuckooH1(key);
+                }
+            }
+        }
+    }
+}
+
+// true if the side to move can reach a position seen earlier with a single
+// reversible move, i.e. the game is about to cycle
+bool Board::hasUpcomingRepetition(int ply) const {
+    const int end = std::min(halfMoves, pliesFromNull);
+    if (end < 3)
+        return false;
+
+    const Bitboard occ = pieces();
+    for (int i = 3; i <= end; i += 2) {
+        const std::uint64_t moveKey = key ^ hist[gamePly - i].key;
+
+        int j = cuckooH1(moveKey);
+        if (cuckoo[j] != moveKey) {
+            j = cuckooH2(moveKey);
+            if (cuckoo[j] != moveKey)
+                continue;
+        }
+
+        const Square s1 = getFrom(cuckooMove[j]);
+        const Square s2 = getTo(cuckooMove[j]);
+        if (between(s1, s2) & occ)
+            continue;
+
+        // the cycle closes inside the search tree
+        if (ply > i)
+            return true;
+
+        // before the root, only count it if the move belongs to the side to
+        // move and the target position has already been repeated once
+        const Piece pc = board[s1] != NO_PC ? board[s1] : board[s2];
+        if (pc == NO_PC || (pc >= B_PAWN) != (turn == BLACK))
+            continue;
+
+        const std::uint64_t target = hist[gamePly - i].key;
+        for (int k = i + 2; k <= end; k += 2) {
+            if (hist[gamePly - k].key == target)
+                return true;
+        }
+    }
+
+    return false;
+}
+
 int Board::see(Square toSq, Piece toPc, Square from, Piece fromPc) {
     int gain[32];
     int ply = 0;
@@ -356,6 +509,132 @@ int Board::see(Square toSq, Piece toPc, Square from, Piece fromPc) {
     return gain[0];
 }
 
+void Board::sliderBlockers(Color c, Bitboard &blockers,
+                           Bitboard &pinners) const {
+    const Square ksq = Square(lsb_index(pieces(KING, c)));
+    const Bitboard rookQueens = pieces(ROOK) | pieces(QUEEN);
+    const Bitboard bishopQueens = pieces(BISHOP) | pieces(QUEEN);
+
+    Bitboard snipers = ((getRookAttacks(ksq, 0) & rookQueens) |
+                        (getBishopAttacks(ksq, 0) & bishopQueens)) &
+                       pieces(~c);
+    const Bitboard occ = pieces() ^ snipers;
+
+    blockers = pinners = 0;
+    while (snipers) {
+        const Square s = Square(lsb_index(snipers));
+        const Bitboard b = between(ksq, s) & occ;
+
+        if (b && !(b & (b - 1))) {
+            blockers |= b;
+            if (b & pieces(c))
+                pinners |= SQUARE_BB(s);
+        }
+
+        snipers &= snipers - 1;
+    }
+}
+
+// threshold form of the static exchange: returns as soon as the sign of
+// (exchange result - threshold) is known instead of building the swap list
+bool Board::seeGE(unsigned short move, int threshold) const {
+    constexpr auto pcVal = std::array{0,        PAWN_VAL,  KNIGHT_VAL, BISHOP_VAL,
+                                      ROOK_VAL, QUEEN_VAL, KING_VAL,   0};
+
+    const MoveFlag flag = getCapture(move);
+    if (flag == K_CASTLE || flag == Q_CASTLE)
+        return 0 >= threshold;
+
+    const Square from = getFrom(move), to = getTo(move);
+    const bool promo = flag >= P_KNIGHT;
+
+    int swap = -threshold;
+    if (flag == EP_CAPTURE)
+        swap += PAWN_VAL;
+    else if (flag == CAPTURE || flag >= CP_KNIGHT)
+        swap += pcVal[getPcType(board[to])];
+
+    int nextVictim = pcVal[getPcType(board[from])];
+    if (promo) {
+        const int promoVal = pcVal[KNIGHT + (flag - P_KNIGHT) % 4];
+        swap += promoVal - PAWN_VAL;
+        nextVictim = promoVal;
+    }
+
+    if (swap < 0)
+        return false;
+
+    swap = nextVictim - swap;
+    if (swap <= 0)
+        return true;
+
+    Bitboard occ = pieces() ^ SQUARE_BB(from) ^ SQUARE_BB(to);
+    if (flag == EP_CAPTURE)
+        occ ^= SQUARE_BB(Square(to ^ 8));
+
+    const Bitboard bishopQueens = pieces(BISHOP) | pieces(QUEEN);
+    const Bitboard rookQueens = pieces(ROOK) | pieces(QUEEN);
+
+    Bitboard blockers[NUM_COLOR], pinners[NUM_COLOR];
+    sliderBlockers(WHITE, blockers[WHITE], pinners[BLACK]);
+    sliderBlockers(BLACK, blockers[BLACK], pinners[WHITE]);
+
+    Bitboard attackers =
+          attacksToKing<WHITE>(to, occ) | attacksToKing<BLACK>(to, occ);
+    Color stm = turn;
+    int res = 1;
+
+    while (true) {
+        stm = ~stm;
+        attackers &= occ;
+
+        Bitboard stmAttackers = attackers & pieces(stm);
+        if (!stmAttackers)
+            break;
+
+        // pinned pieces may not recapture while their pinner is still there
+        if (pinners[~stm] & occ)
+            stmAttackers &= ~blockers[stm];
+        if (!stmAttackers)
+            break;
+
+        res ^= 1;
+
+        Bitboard bb;
+        if ((bb = stmAttackers & pieces(PAWN))) {
+            if ((swap = PAWN_VAL - swap) < res)
+                break;
+            occ ^= bb & -bb;
+            attackers |= getBishopAttacks(to, occ) & bishopQueens;
+        } else if ((bb = stmAttackers & pieces(KNIGHT))) {
+            if ((swap = KNIGHT_VAL - swap) < res)
+                break;
+            occ ^= bb & -bb;
+        } else if ((bb = stmAttackers & pieces(BISHOP))) {
+            if ((swap = BISHOP_VAL - swap) < res)
+                break;
+            occ ^= bb & -bb;
+            attackers |= getBishopAttacks(to, occ) & bishopQueens;
+        } else if ((bb = stmAttackers & pieces(ROOK))) {
+            if ((swap = ROOK_VAL - swap) < res)
+                break;
+            occ ^= bb & -bb;
+            attackers |= getRookAttacks(to, occ) & rookQueens;
+        } else if ((bb = stmAttackers & pieces(QUEEN))) {
+            if ((swap = QUEEN_VAL - swap) < res)
+                break;
+            occ ^= bb & -bb;
+            attackers |= (getBishopAttacks(to, occ) & bishopQueens) |
+                         (getRookAttacks(to, occ) & rookQueens);
+        } else {
+            // the king can only take if the square is no longer defended
+            return (attackers & ~pieces(stm)) ? res ^ 1 : res;
+        }
+    }
+
+    return bool(res);
+}
+
 Board::Board() {
     key = 0;
     checkPcs = 0;
@@ -365,12 +644,13 @@ Board::Board() {
     gamePly = 0;
     halfMoves = 0;
     fullMoves = 0;
+    pliesFromNull = 0;
     enPass = SQUARE_64;
     castleRights = 0;
     color[WHITE] = 0;
     color[BLACK] = 0;
 
-    for (int i = 0; i < 13; i++)
+    for (int i = 0; i < PC_MAX; i++)
         pieceBB[i] = 0;
     for (int i = 0; i < 7; i++)
         cPieceBB[i] = 0;
@@ -378,7 +658,7 @@ Board::Board() {
         board[i] = NO_PC;
 }
 
-Board::Board(const Board &other) {
+Board::Board(const Board &other) : BoardState(other) {
     for (int i = 0; hist[i].key; i++) {
         hist[i].castleStatus = other.hist[i].castleStatus;
         hist[i].checkPcs = other.hist[i].checkPcs;
@@ -388,32 +668,6 @@ Board::Board(const Board &other) {
         hist[i].key = other.hist[i].key;
         hist[i].lastCapt = other.hist[i].lastCapt;
     }
-
-    for (int i = 0; i < 64; i++) {
-        board[i] = other.board[i];
-    }
-
-    color[0] = other.color[0];
-    color[1] = other.color[1];
-
-    for (int i = 0; i < PC_MAX; i++) {
-        pieceBB[i] = other.pieceBB[i];
-    }
-
-    for (int i = 0; i < 7; i++) {
-        cPieceBB[i] = other.cPieceBB[i];
-    }
-
-    key = other.key;
-    checkPcs = other.checkPcs;
-    lastCapt = other.lastCapt;
-    turn = other.turn;
-    ply = other.ply;
-    gamePly = other.gamePly;
-    halfMoves = other.halfMoves;
-    fullMoves = other.fullMoves;
-    enPass = other.enPass;
-    castleRights = other.castleRights;
 }
 
 constexpr bool Board::operator==(const Board &b1) const {
@@ -441,8 +695,8 @@ constexpr bool Board::operator==(const Board &b1) const {
             print();
             b1.print();
             std::cout << "INDEX: " << i << std::endl;
-            std::cout << "BOARD1: " << board[i] << std::endl;
-            std::cout << "BOARD2: " << b1.board[i] << std::endl;
+            std::cout << "BOARD1: " << int(board[i]) << std::endl;
+            std::cout << "BOARD2: " << int(b1.board[i]) << std::endl;
             std::cout << "ERROR! BOARD ARRAY"
                       << "\n";
             return false;
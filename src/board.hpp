@@ -37,6 +37,7 @@ struct Hist {
     int castleStatus  = 0;
     int halfMoves     = 0;
     int fullMoves     = 0;
+    int pliesFromNull = 0;
 };
 
 struct Info {
@@ -50,8 +51,12 @@ struct Info {
     int depth                  = -1;
     int selDepth               = -1;
     int movestogo              = -1;
+    // stop once this many nodes are searched, 0 for no limit
+    std::uint64_t nodeLimit    = 0;
 
     bool timeGiven             = false;
+    // no info or bestmove output, for searches run by the engine itself
+    bool silent                = false;
     bool uciQuit               = false;
     bool uciStop = false;
 };
@@ -79,10 +84,9 @@ static const int castleMod[64] = {
     11, 15, 15, 15, 3,  15, 15, 7,
 };
 
-class Board {
-  public:
-    Hist hist[1000];
-    Piece board[64];
+// everything make() changes lives here, so copy-make can snapshot the position
+// with a single copy and unmake() becomes a restore
+struct BoardState {
     Bitboard color[2];
     Bitboard pieceBB[PC_MAX];
     Bitboard cPieceBB[7];
@@ -90,12 +94,48 @@ class Board {
     mutable Bitboard checkPcs;
     uint64_t key;
 
+    Piece board[64];
     Piece lastCapt;
     Color turn;
     int castleRights;
     Square enPass;
     int ply, gamePly;
     int halfMoves, fullMoves;
+    int pliesFromNull;
+};
+
+// cuckoo tables of every reversible non-pawn move, keyed by the zobrist
+// difference the move makes (including the side to move)
+extern std::uint64_t cuckoo[8192];
+extern unsigned short cuckooMove[8192];
+
+constexpr int cuckooH1(std::uint64_t key) { return key & 0x1fff; }
+constexpr int cuckooH2(std::uint64_t key) { return (key >> 16) & 0x1fff; }
+
+void initCuckoo();
+
+// material key from per-side piece counts, matches Board::materialKey()
+std::uint64_t materialKeyOf(const int counts[2][PT_MAX]);
+
+// copy-make keeps a ring of snapshots indexed by gamePly; only positions
+// inside the current search (or perft) are ever restored
+constexpr int STATE_STACK_SIZE = 256;
+
+struct Accumulator;
+struct PawnTable;
+static_assert(STATE_STACK_SIZE > MAX_PLY + 6);
+
+class Board : public BoardState {
+  public:
+    Hist hist[1000];
+    // the network accumulator of this ply while a search keeps a stack of
+    // them, make() and unmake() step through it
+    Accumulator *acc = nullptr;
+    // the searching thread's pawn cache, if any
+    PawnTable *pawnTable = nullptr;
+#ifdef COPY_MAKE
+    BoardState states[STATE_STACK_SIZE];
+#endif
 
     Board();
     Board(const Board &other);
@@ -105,6 +145,7 @@ class Board {
     constexpr int numRepetition() const;
     constexpr bool isRepetition() const;
     constexpr bool isTMR() const;
+    bool hasUpcomingRepetition(int ply) const;
 
     void print() const;
     void setFen(const std::string fen);
@@ -124,10 +165,15 @@ class Board {
     constexpr Bitboard xRayAtks(Square sq, Bitboard occ);
     constexpr Bitboard getLVA(Color side, Bitboard atkDefMap, Piece *p);
     int see(Square toSq, Piece toPc, Square from, Piece fromPc);
+    bool seeGE(unsigned short move, int threshold) const;
+    void sliderBlockers(Color c, Bitboard &blockers, Bitboard &pinners) const;
     constexpr bool castleBlocked(CastleRights cr, Square sq) const;
     constexpr bool isSqAttacked(Square sq, Bitboard occ, Color byColor) const;
     constexpr bool isDraw();
     std::uint64_t hash() const;
+    std::uint64_t polyglotKey() const;
+    std::uint64_t pawnKey() const;
+    std::uint64_t materialKey() const;
 
     template <Color C> constexpr Bitboard attacksToKing(Square sq, Bitboard occ) const {
         Bitboard knights, kings, queenRooks, queenBishops;
@@ -0,0 +1,150 @@
+/*
+**    Yayo is a UCI chess engine written by am5083 (am@kvasm.us)
+**    Copyright (C) 2022 Ahmed Mohamed (am@kvasm.us)
+**
+**    This program is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**    This program is distributed in the hope that it will be useful,
+**    but WITHOUT ANY WARRANTY; without even the implied warranty of
+**    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**    GNU General Public License for more details.
+**
+**    You should have received a copy of the GNU General Public License
+**    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "book.hpp"
+#include "movegen.hpp"
+#include <fcntl.h>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace Yayo {
+
+Book book;
+
+namespace {
+
+constexpr std::size_t ENTRY_SIZE = 16;
+
+std::uint64_t readBE(const std::uint8_t *p, int bytes) {
+    std::uint64_t v = 0;
+    for (int i = 0; i < bytes; i++)
+        v = (v << 8) | p[i];
+    return v;
+}
+
+// our move in Polyglot notation: a1 = 0, castling as king takes rook
+unsigned polyglotMove(unsigned short move) {
+    const int flag = getCapture(move);
+    const int from = getFrom(move) ^ 56;
+    int to = getTo(move) ^ 56;
+    int promo = 0;
+
+    if (flag == K_CASTLE)
+        to = (to & 56) | 7;
+    else if (flag == Q_CASTLE)
+        to = to & 56;
+    else if (flag >= CP_KNIGHT)
+        promo = flag - CP_KNIGHT + 1;
+    else if (flag >= P_KNIGHT)
+        promo = flag - P_KNIGHT + 1;
+
+    return (promo << 12) | (from << 6) | to;
+}
+
+} // namespace
+
+bool Book::open(const std::string &path) {
+    close();
+
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd == -1)
+        return false;
+
+    struct stat st;
+    fstat(fd, &st);
+
+    const std::size_t len = st.st_size;
+    void *base = len >= ENTRY_SIZE ? mmap(nullptr, len, PROT_READ, MAP_SHARED,
+                                          fd, 0)
+                                   : MAP_FAILED;
+    ::close(fd);
+
+    if (base == MAP_FAILED)
+        return false;
+
+    entries = (const std::uint8_t *)base;
+    count = len / ENTRY_SIZE;
+    mapLen = len;
+    return true;
+}
+
+void Book::close() {
+    if (entries)
+        munmap((void *)entries, mapLen);
+
+    entries = nullptr;
+    count = mapLen = 0;
+}
+
+std::uint64_t Book::keyAt(std::size_t i) const {
+    return readBE(entries + i * ENTRY_SIZE, 8);
+}
+
+unsigned short Book::probe(const Board &board) {
+    if (!entries)
+        return 0;
+
+    const std::uint64_t key = board.polyglotKey();
+
+    // first entry with this key
+    std::size_t lo = 0, hi = count;
+    while (lo < hi) {
+        const std::size_t mid = lo + (hi - lo) / 2;
+        if (keyAt(mid) < key)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    std::uint32_t total = 0;
+    std::size_t end = lo;
+    for (; end < count && keyAt(end) == key; end++)
+        total += readBE(entries + end * ENTRY_SIZE + 10, 2);
+
+    if (lo == end || !total)
+        return 0;
+
+    std::uint32_t pick = rng() % total;
+    unsigned bookMove = 0;
+
+    for (std::size_t i = lo; i < end; i++) {
+        const std::uint8_t *e = entries + i * ENTRY_SIZE;
+        const std::uint32_t weight = readBE(e + 10, 2);
+
+        if (pick < weight) {
+            bookMove = readBE(e + 8, 2);
+            break;
+        }
+
+        pick -= weight;
+    }
+
+    // only play it if it is legal here, keys can collide
+    moveList mList = {0};
+    generate(board, &mList);
+
+    for (int i = 0; i < mList.nMoves; i++)
+        if (polyglotMove(mList.moves[i].move) == bookMove)
+            return mList.moves[i].move;
+
+    return 0;
+}
+
+} // namespace Yayo
@@ -0,0 +1,55 @@
+/*
+**    Yayo is a UCI chess engine written by am5083 (am@kvasm.us)
+**    Copyright (C) 2022 Ahmed Mohamed (am@kvasm.us)
+**
+**    This program is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**    This program is distributed in the hope that it will be useful,
+**    but WITHOUT ANY WARRANTY; without even the implied warranty of
+**    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**    GNU General Public License for more details.
+**
+**    You should have received a copy of the GNU General Public License
+**    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BOOK_H_
+#define BOOK_H_
+#include "board.hpp"
+#include <cstdint>
+#include <random>
+#include <string>
+
+namespace Yayo {
+
+// Polyglot .bin opening book: 16-byte big-endian entries sorted by key,
+// memory mapped and binary searched in place.
+class Book {
+  public:
+    ~Book() { close(); }
+
+    bool open(const std::string &path);
+    void close();
+    bool isOpen() const { return entries; }
+    std::size_t size() const { return count; }
+
+    // weighted random book move for the position, 0 when out of book
+    unsigned short probe(const Board &board);
+
+  private:
+    std::uint64_t keyAt(std::size_t i) const;
+
+    const std::uint8_t *entries = nullptr;
+    std::size_t count = 0;
+    std::size_t mapLen = 0;
+    std::mt19937_64 rng{std::random_device{}()};
+};
+
+extern Book book;
+
+} // namespace Yayo
+
+#endif // BOOK_H_
@@ -0,0 +1,205 @@
+/*
+**    Yayo is a UCI chess engine written by am5083 (am@kvasm.us)
+**    Copyright (C) 2022 Ahmed Mohamed (am@kvasm.us)
+**
+**    This program is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**    This program is distributed in the hope that it will be useful,
+**    but WITHOUT ANY WARRANTY; without even the implied warranty of
+**    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**    GNU General Public License for more details.
+**
+**    You should have received a copy of the GNU General Public License
+**    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "datagen.hpp"
+#include "dataset.hpp"
+#include "thread.hpp"
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace Yayo {
+
+namespace {
+
+struct Shared {
+    const DatagenOptions &options;
+    DatasetWriter writer;
+    std::mutex lock;
+    std::atomic<std::uint64_t> started{0};
+    std::uint64_t games = 0, positions = 0;
+    std::uint64_t wins[3] = {0};
+    std::uint64_t startTime;
+};
+
+bool isQuiet(unsigned move) { return getCapture(move) < CAPTURE; }
+
+// plays random moves from the start position, false if the game ended early
+bool randomOpening(Board &board, Search &search, std::mt19937_64 &rng,
+                   int plies) {
+    board.setFen(START_POS);
+    search._setFen(START_POS);
+
+    for (int i = 0; i < plies; i++) {
+        moveList mList = {0};
+        generate(board, &mList);
+        if (!mList.nMoves)
+            return false;
+
+        const unsigned short move = mList.moves[rng() % mList.nMoves].move;
+        make(board, move);
+        board.ply = 0;
+        search._make(move);
+    }
+
+    moveList mList = {0};
+    generate(board, &mList);
+    return mList.nMoves > 0;
+}
+
+// one game, returns the result from white's view: 0 loss, 1 draw, 2 win
+int playGame(Board &board, Search &search, Info *info,
+             std::vector<PackedPos> &positions) {
+    int winPlies = 0, drawPlies = 0;
+
+    for (int ply = 0;; ply++) {
+        moveList mList = {0};
+        generate(board, &mList);
+
+        if (!mList.nMoves) {
+            if (!board.checkPcs)
+                return 1;
+            return board.turn == WHITE ? 0 : 2;
+        }
+
+        if (board.halfMoves >= 100 || board.isDraw() || board.isTMR() ||
+            ply >= DATAGEN_MAX_PLIES)
+            return 1;
+
+        const BBResult known = bitbases.probe(board);
+        if (known != BB_NONE) {
+            if (known == BB_DRAW)
+                return 1;
+            return (known == BB_WIN) == (board.turn == WHITE) ? 2 : 0;
+        }
+
+        int score;
+        const unsigned move = search.searchNow(info, score);
+        const int white = board.turn == WHITE ? score : -score;
+
+        // counted with white's sign, both sides have to see the same winner
+        const int side = white > 0 ? 1 : -1;
+        if (std::abs(score) >= DATAGEN_WIN_SCORE)
+            winPlies = winPlies * side > 0 ? winPlies + side : side;
+        else
+            winPlies = 0;
+
+        if (std::abs(winPlies) >= DATAGEN_WIN_PLIES)
+            return winPlies > 0 ? 2 : 0;
+
+        if (ply >= DATAGEN_DRAW_START && std::abs(score) <= DATAGEN_DRAW_SCORE)
+            drawPlies++;
+        else
+            drawPlies = 0;
+
+        if (drawPlies >= DATAGEN_DRAW_PLIES)
+            return 1;
+
+        // the tuner wants positions where the eval is the whole story
+        if (!board.checkPcs && isQuiet(move) &&
+            std::abs(score) < DATAGEN_MAX_SCORE)
+            positions.push_back(pack(board, 0, white));
+
+        make(board, move);
+        board.ply = 0;
+        search._make(move);
+    }
+}
+
+void worker(Shared &shared, int id) {
+    const DatagenOptions &options = shared.options;
+
+    auto search = std::make_unique<Search>();
+    auto board = std::make_unique<Board>();
+    std::mt19937_64 rng(options.seed * 0x9E3779B97F4A7C15ull + id + 1);
+    std::vector<PackedPos> positions;
+
+    Info info[1];
+    info->timeGiven = false;
+    info->silent = true;
+    info->depth = options.depth ? options.depth : MAX_PLY - 1;
+    info->nodeLimit = options.depth ? 0 : options.nodes;
+
+    while (shared.started++ < options.games) {
+        search->clearHistory();
+        positions.clear();
+
+        // a long enough opening that ends in a live position
+        while (!randomOpening(*board, *search, rng, options.randomPlies))
+            ;
+
+        const int result = playGame(*board, *search, info, positions);
+        for (auto &pos : positions)
+            pos.result = result;
+
+        std::lock_guard<std::mutex> guard(shared.lock);
+        for (const auto &pos : positions)
+            shared.writer.write(pos);
+
+        shared.games++;
+        shared.positions += positions.size();
+        shared.wins[result]++;
+
+        if (shared.games % 100 == 0 || shared.games == options.games) {
+            const double secs =
+                  std::max<std::uint64_t>(1, get_time() - shared.startTime) /
+                  1000.0;
+            printf("games %llu (+%llu =%llu -%llu) positions %llu, %.0f "
+                   "positions/s, %.0f per thread\n",
+                   (unsigned long long)shared.games,
+                   (unsigned long long)shared.wins[2],
+                   (unsigned long long)shared.wins[1],
+                   (unsigned long long)shared.wins[0],
+                   (unsigned long long)shared.positions,
+                   shared.positions / secs,
+                   shared.positions / secs / options.threads);
+            fflush(stdout);
+        }
+    }
+}
+
+} // namespace
+
+void runDatagen(const DatagenOptions &options) {
+    Shared shared{options};
+    if (!shared.writer.open(options.out)) {
+        std::cerr << "ERROR: COULD NOT WRITE " << options.out << "\n";
+        return;
+    }
+
+    tt.init(options.hash);
+    shared.startTime = get_time();
+
+    // the games share the transposition table, it is lockless
+    std::vector<std::thread> pool;
+    for (int i = 0; i < options.threads; i++)
+        pool.emplace_back(worker, std::ref(shared), i);
+    for (auto &t : pool)
+        t.join();
+
+    shared.writer.close();
+    std::cout << "wrote " << shared.positions << " positions from "
+              << shared.games << " games to " << options.out << "\n";
+}
+
+} // namespace Yayo
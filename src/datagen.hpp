@@ -0,0 +1,54 @@
+/*
+**    Yayo is a UCI chess engine written by am5083 (am@kvasm.us)
+**    Copyright (C) 2022 Ahmed Mohamed (am@kvasm.us)
+**
+**    This program is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**    This program is distributed in the hope that it will be useful,
+**    but WITHOUT ANY WARRANTY; without even the implied warranty of
+**    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**    GNU General Public License for more details.
+**
+**    You should have received a copy of the GNU General Public License
+**    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DATAGEN_H_
+#define DATAGEN_H_
+#include <cstdint>
+#include <string>
+
+namespace Yayo {
+
+// adjudication: a win once both sides agree on WIN_SCORE for WIN_PLIES plies
+// in a row, a draw after DRAW_PLIES plies within DRAW_SCORE past DRAW_START
+#define DATAGEN_WIN_SCORE 1000
+#define DATAGEN_WIN_PLIES 4
+#define DATAGEN_DRAW_SCORE 10
+#define DATAGEN_DRAW_PLIES 12
+#define DATAGEN_DRAW_START 80
+#define DATAGEN_MAX_PLIES 400
+// positions scored beyond this are left out of the data
+#define DATAGEN_MAX_SCORE 3000
+
+struct DatagenOptions {
+    std::string out = "selfplay.bin";
+    std::uint64_t games = 1000;
+    int threads = 1;
+    int depth = 0;
+    std::uint64_t nodes = 5000;
+    int randomPlies = 8;
+    int hash = 64;
+    std::uint64_t seed = 0;
+};
+
+// Plays self-play games on a pool of threads, each with its own Search, and
+// writes the quiet positions with their search score and the game result.
+void runDatagen(const DatagenOptions &options);
+
+} // namespace Yayo
+
+#endif // DATAGEN_H_
@@ -0,0 +1,232 @@
+/*
+**    Yayo is a UCI chess engine written by am5083 (am@kvasm.us)
+**    Copyright (C) 2022 Ahmed Mohamed (am@kvasm.us)
+**
+**    This program is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**    This program is distributed in the hope that it will be useful,
+**    but WITHOUT ANY WARRANTY; without even the implied warranty of
+**    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**    GNU General Public License for more details.
+**
+**    You should have received a copy of the GNU General Public License
+**    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "dataset.hpp"
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace Yayo {
+
+namespace {
+
+constexpr std::size_t HEADER_SIZE = 16;
+
+} // namespace
+
+PackedPos pack(const Board &board, int result, int score) {
+    PackedPos pos;
+    std::memset(&pos, 0, sizeof(pos));
+
+    pos.occupancy = board.pieces();
+
+    int n = 0;
+    for (Bitboard b = pos.occupancy; b; b &= b - 1, n++) {
+        const int sq = __builtin_ctzll(b);
+        pos.pieces[n / 2] |= (board.board[sq] & 15) << (4 * (n & 1));
+    }
+
+    pos.turn = board.turn;
+    pos.castleRights = board.castleRights;
+    pos.enPass = board.enPass;
+    pos.result = result;
+    pos.score = score;
+    pos.halfMoves = std::min(board.halfMoves, 255);
+    return pos;
+}
+
+// mirrors what setFen leaves behind, including the key
+void unpack(const PackedPos &pos, Board &board) {
+    board.key = 0;
+    board.ply = board.gamePly = board.pliesFromNull = 0;
+    board.lastCapt = NO_PC;
+    board.color[WHITE] = board.color[BLACK] = 0;
+
+    for (int i = 0; i < PC_MAX; i++)
+        board.pieceBB[i] = 0;
+    for (int i = 0; i < 7; i++)
+        board.cPieceBB[i] = 0;
+    for (int i = 0; i < 64; i++)
+        board.board[i] = NO_PC;
+
+    int n = 0;
+    for (Bitboard b = pos.occupancy; b; b &= b - 1, n++) {
+        const int sq = __builtin_ctzll(b);
+        const Piece pc = Piece((pos.pieces[n / 2] >> (4 * (n & 1))) & 15);
+        const Bitboard bb = SQUARE_BB(Square(sq));
+
+        board.board[sq] = pc;
+        board.pieceBB[pc] |= bb;
+        board.cPieceBB[getPcType(pc)] |= bb;
+        board.color[pc >> 3] |= bb;
+        board.key ^= zobristPieceSq[pc][sq];
+    }
+
+    board.turn = Color(pos.turn);
+    if (board.turn == BLACK)
+        board.key ^= 1;
+
+    board.castleRights = pos.castleRights;
+    for (int cr = WHITE_KING; cr; cr >>= 1)
+        if (board.castleRights & cr)
+            board.key ^= zobristCastleRights[cr];
+
+    board.enPass = Square(pos.enPass);
+    if (board.enPass != SQUARE_64)
+        board.key ^= zobristEpFile[board.enPass % 8];
+
+    board.halfMoves = pos.halfMoves;
+    board.fullMoves = 1;
+
+    const Bitboard occ = board.pieces();
+    board.checkPcs =
+          board.turn == WHITE
+                ? board.attacksToKing<BLACK>(Sq(board.pieces(KING, WHITE)), occ)
+                : board.attacksToKing<WHITE>(Sq(board.pieces(KING, BLACK)),
+                                             occ);
+}
+
+std::size_t convertText(const std::string &in, const std::string &out) {
+    std::ifstream text(in);
+    if (!text.is_open()) {
+        std::cerr << "ERROR: COULD NOT OPEN " << in << "\n";
+        return 0;
+    }
+
+    DatasetWriter writer;
+    if (!writer.open(out)) {
+        std::cerr << "ERROR: COULD NOT WRITE " << out << "\n";
+        return 0;
+    }
+
+    Board board;
+    std::string line;
+    while (getline(text, line)) {
+        int result;
+        if (line.find("[1.0]") != std::string::npos)
+            result = 2;
+        else if (line.find("[0.5]") != std::string::npos)
+            result = 1;
+        else if (line.find("[0.0]") != std::string::npos)
+            result = 0;
+        else
+            continue;
+
+        board.setFen(line);
+        writer.write(pack(board, result, PACKED_NO_SCORE));
+    }
+
+    writer.close();
+    return writer.size();
+}
+
+bool Dataset::open(const std::string &path) {
+    close();
+
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd == -1)
+        return false;
+
+    struct stat st;
+    fstat(fd, &st);
+
+    const std::size_t len = st.st_size;
+    void *base = len >= HEADER_SIZE ? mmap(nullptr, len, PROT_READ, MAP_SHARED,
+                                           fd, 0)
+                                    : MAP_FAILED;
+    ::close(fd);
+
+    if (base == MAP_FAILED)
+        return false;
+
+    std::uint32_t magic;
+    std::uint64_t n;
+    std::memcpy(&magic, base, 4);
+    std::memcpy(&n, (const char *)base + 8, 8);
+
+    if (magic != DATASET_MAGIC ||
+        n > (len - HEADER_SIZE) / sizeof(PackedPos)) {
+        munmap(base, len);
+        return false;
+    }
+
+    madvise(base, len, MADV_SEQUENTIAL);
+
+    mapping = base;
+    mapLen = len;
+    positions = (const PackedPos *)((const char *)base + HEADER_SIZE);
+    count = n;
+    return true;
+}
+
+void Dataset::close() {
+    if (mapping)
+        munmap(mapping, mapLen);
+
+    mapping = nullptr;
+    positions = nullptr;
+    count = mapLen = 0;
+}
+
+void Dataset::release(std::size_t start, std::size_t end) const {
+    const std::size_t page = sysconf(_SC_PAGESIZE);
+    std::size_t from = HEADER_SIZE + start * sizeof(PackedPos);
+    std::size_t to = HEADER_SIZE + end * sizeof(PackedPos);
+
+    // only whole pages, the ones at the edges may still be shared
+    from = (from + page - 1) / page * page;
+    to = to / page * page;
+
+    if (from < to)
+        madvise((char *)mapping + from, to - from, MADV_DONTNEED);
+}
+
+bool DatasetWriter::open(const std::string &path) {
+    close();
+
+    file = std::fopen(path.c_str(), "wb");
+    if (!file)
+        return false;
+
+    const std::uint32_t header[4] = {DATASET_MAGIC, 0, 0, 0};
+    std::fwrite(header, sizeof(header), 1, file);
+    count = 0;
+    return true;
+}
+
+void DatasetWriter::write(const PackedPos &pos) {
+    std::fwrite(&pos, sizeof(pos), 1, file);
+    count++;
+}
+
+void DatasetWriter::close() {
+    if (!file)
+        return;
+
+    const std::uint64_t n = count;
+    std::fseek(file, 8, SEEK_SET);
+    std::fwrite(&n, sizeof(n), 1, file);
+    std::fclose(file);
+    file = nullptr;
+}
+
+} // namespace Yayo
@@ -0,0 +1,95 @@
+/*
+**    Yayo is a UCI chess engine written by am5083 (am@kvasm.us)
+**    Copyright (C) 2022 Ahmed Mohamed (am@kvasm.us)
+**
+**    This program is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**    This program is distributed in the hope that it will be useful,
+**    but WITHOUT ANY WARRANTY; without even the implied warranty of
+**    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**    GNU General Public License for more details.
+**
+**    You should have received a copy of the GNU General Public License
+**    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef DATASET_H_
+#define DATASET_H_
+#include "board.hpp"
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+namespace Yayo {
+
+#define PACKED_NO_SCORE -32768
+
+// One training position in 32 bytes. Occupied squares are listed by the
+// occupancy bitboard, in square order (A8 first), and their pieces follow as
+// 4-bit codes, two per byte with the low nibble first.
+struct PackedPos {
+    std::uint64_t occupancy;
+    std::uint8_t pieces[16];
+    std::uint8_t turn;
+    std::uint8_t castleRights;
+    std::uint8_t enPass;
+    std::uint8_t result;  // from white's view: 0 loss, 1 draw, 2 win
+    std::int16_t score;   // white-relative search score, or PACKED_NO_SCORE
+    std::uint8_t halfMoves;
+    std::uint8_t pad;
+};
+
+static_assert(sizeof(PackedPos) == 32);
+
+// files start with a 16-byte header: "YTD1", 4 reserved bytes and the
+// position count as a little-endian u64
+#define DATASET_MAGIC 0x31445459
+
+PackedPos pack(const Board &board, int result, int score);
+void unpack(const PackedPos &pos, Board &board);
+
+// the tuner's text format: one fen per line tagged [1.0], [0.5] or [0.0]
+std::size_t convertText(const std::string &in, const std::string &out);
+
+// Read-only mapping of a packed dataset. Positions are paged in on demand and
+// can be dropped again once consumed, so files larger than RAM stream through.
+class Dataset {
+  public:
+    ~Dataset() { close(); }
+
+    bool open(const std::string &path);
+    void close();
+    std::size_t size() const { return count; }
+    const PackedPos &operator[](std::size_t i) const { return positions[i]; }
+
+    // hints that positions [start, end) will not be read again
+    void release(std::size_t start, std::size_t end) const;
+
+  private:
+    const PackedPos *positions = nullptr;
+    std::size_t count = 0;
+    void *mapping = nullptr;
+    std::size_t mapLen = 0;
+};
+
+// appends positions to a packed dataset, fixing up the header count on close
+class DatasetWriter {
+  public:
+    ~DatasetWriter() { close(); }
+
+    bool open(const std::string &path);
+    void close();
+    void write(const PackedPos &pos);
+    std::size_t size() const { return count; }
+
+  private:
+    std::FILE *file = nullptr;
+    std::size_t count = 0;
+};
+
+} // namespace Yayo
+
+#endif // DATASET_H_
@@ -35,7 +35,7 @@ int TracePeek::calculate(std::tuple<int, int, int> info) {
 
     int score     = TEMPO;
     int nFeatures = 0;
-    for (int i = 0, w = 0; w < 487; i += 2, w++) {
+    for (int i = 0, w = 0; w < 519; i += 2, w++) {
         if (trace[i] - trace[i + 1]) {
             const int eval =
                 (trace[i] - trace[i + 1]) * ((mgPhase * MgScore(weights[w]) + egPhase * EgScore(weights[w])) / 24);
@@ -150,6 +150,36 @@ void TracePeek::print() {
         std::cout << t.queenMobility[i][WHITE] - t.queenMobility[i][BLACK] << std::endl;
     }
 
+    numTerms += 8;
+    std::cout << "kingAttackWeight:" << std::endl;
+    for (int i = 0; i < 4; i++) {
+        std::cout << t.kingAttackWeight[i][WHITE] - t.kingAttackWeight[i][BLACK] << std::endl;
+    }
+
+    numTerms += 16;
+    std::cout << "kingAttackers:" << std::endl;
+    for (int i = 0; i <= KING_ATTACKERS_MAX; i++) {
+        std::cout << t.kingAttackers[i][WHITE] - t.kingAttackers[i][BLACK] << std::endl;
+    }
+
+    numTerms += 8;
+    std::cout << "safeChecks:" << std::endl;
+    for (int i = 0; i < 4; i++) {
+        std::cout << t.safeChecks[i][WHITE] - t.safeChecks[i][BLACK] << std::endl;
+    }
+
+    numTerms += 16;
+    std::cout << "kingShelter:" << std::endl;
+    for (int i = 0; i < 8; i++) {
+        std::cout << t.kingShelter[i][WHITE] - t.kingShelter[i][BLACK] << std::endl;
+    }
+
+    numTerms += 16;
+    std::cout << "kingStorm:" << std::endl;
+    for (int i = 0; i < 8; i++) {
+        std::cout << t.kingStorm[i][WHITE] - t.kingStorm[i][BLACK] << std::endl;
+    }
+
     std::cout << "\ntotal number of terms: " << numTerms << std::endl;
 }
 } // namespace Yayo
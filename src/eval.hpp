@@ -18,12 +18,16 @@
 
 #ifndef SEARCH_H_
 #define SEARCH_H_
+#include "bitbase.hpp"
 #include "board.hpp"
 #include "move.hpp"
 #include "util.hpp"
 #include "weights.hpp"
 #include <thread>
 
+#define PAWN_TABLE_SIZE 16384
+#define KING_ATTACKERS_MAX 7
+
 namespace Yayo {
 namespace {
 constexpr int TEMPO = 5;
@@ -55,6 +59,11 @@ struct Trace {
     int bishopMobility[14][NUM_COLOR] = {{0}};
     int rookMobility[15][NUM_COLOR] = {{0}};
     int queenMobility[28][NUM_COLOR] = {{0}};
+    int kingAttackWeight[4][NUM_COLOR] = {{0}};
+    int kingAttackers[KING_ATTACKERS_MAX + 1][NUM_COLOR] = {{0}};
+    int safeChecks[4][NUM_COLOR] = {{0}};
+    int kingShelter[8][NUM_COLOR] = {{0}};
+    int kingStorm[8][NUM_COLOR] = {{0}};
 };
 
 struct TracePeek {
@@ -72,6 +81,38 @@ struct TracePeek {
 extern const EvalWeights evalWeights;
 static Trace tempTrace;
 
+// What each side attacks, computed once per eval against the real occupancy
+// and shared by every term that looks at attacks. twice holds the squares a
+// side attacks with at least two pieces.
+struct AttackInfo {
+    Bitboard piece[SQUARE_CT];
+    Bitboard byType[NUM_COLOR][PT_MAX];
+    Bitboard all[NUM_COLOR];
+    Bitboard twice[NUM_COLOR];
+};
+
+// Pawn shelter and storm only change with the pawns and the king, so the
+// search keeps them by pawn key. Each side's score is valid for the king
+// square it was computed on.
+struct PawnEntry {
+    std::uint64_t key;
+    Score shelter[NUM_COLOR];
+    std::uint8_t kingSq[NUM_COLOR];
+};
+
+struct PawnTable {
+    PawnEntry entries[PAWN_TABLE_SIZE] = {};
+
+    PawnEntry &probe(std::uint64_t key) {
+        PawnEntry &entry = entries[key % PAWN_TABLE_SIZE];
+        if (entry.key != key) {
+            entry.key = key;
+            entry.kingSq[WHITE] = entry.kingSq[BLACK] = SQUARE_CT;
+        }
+        return entry;
+    }
+};
+
 enum Tracing : bool { NO_TRACE, TRACE };
 
 template <Tracing T = NO_TRACE> class Eval {
@@ -80,6 +121,23 @@ template <Tracing T = NO_TRACE> class Eval {
     Eval(Board &b, Trace &t) : board(b), trace(t) { init(); }
 
     int eval() {
+        // known endings: draws are exact, wins get pushed towards converting
+        int known = 0;
+        if (!T && popcount(board.pieces()) <= BB_PIECES) {
+            const BBResult r = bitbases.probe(board);
+            if (r == BB_DRAW)
+                return 0;
+            known = bbBonus(r);
+        }
+
+        initAttacks<WHITE>();
+        initAttacks<BLACK>();
+
+        // traced evals always recompute the shelter to fill in the features
+        pawnEntry = nullptr;
+        if (!T && board.pawnTable)
+            pawnEntry = &board.pawnTable->probe(board.pawnKey());
+
         const auto whitePawnCount = popcount(board.pieces(PAWN, WHITE));
         const auto whiteKnightCount = popcount(board.pieces(KNIGHT, WHITE));
         const auto whiteBishopCount = popcount(board.pieces(BISHOP, WHITE));
@@ -168,6 +226,11 @@ template <Tracing T = NO_TRACE> class Eval {
         const int mgMobility = MgScore(wMobility) - MgScore(bMobility);
         const int egMobility = EgScore(wMobility) - EgScore(bMobility);
 
+        const Score wKingSafety = kingSafety<WHITE>();
+        const Score bKingSafety = kingSafety<BLACK>();
+        const int mgKingSafety = MgScore(wKingSafety) - MgScore(bKingSafety);
+        const int egKingSafety = EgScore(wKingSafety) - EgScore(bKingSafety);
+
         const auto color = (board.turn == WHITE) ? 1 : -1;
         const auto materialScore = wMaterial - bMaterial;
         const int pcSqEval = (mgPcSq * mgPhase + egPcSq * egPhase) / 24;
@@ -181,12 +244,15 @@ template <Tracing T = NO_TRACE> class Eval {
               (mgBackwardPawn * mgPhase + egBackwardPawn * egPhase) / 24;
         const int mobilityEval =
               (mgMobility * mgPhase + egMobility * egPhase) / 24;
+        const int kingSafetyEval =
+              (mgKingSafety * mgPhase + egKingSafety * egPhase) / 24;
 
         auto eval = TEMPO;
         eval += materialScore + pcSqEval + passedPawnEval + doubledPawnEval +
-                isolatedPawnEval + backwardPawnEval + mobilityEval;
+                isolatedPawnEval + backwardPawnEval + mobilityEval +
+                kingSafetyEval;
 
-        return eval * color;
+        return eval * color + known;
     }
 
   public:
@@ -197,8 +263,13 @@ template <Tracing T = NO_TRACE> class Eval {
   private:
     Board &board;
     Trace &trace;
+    AttackInfo attacks;
+    PawnEntry *pawnEntry = nullptr;
 
   private:
+    template <Color C> void initAttacks();
+    template <PieceT P, Color C> void addAttacks();
+
     template <Color C> constexpr Bitboard doubledPawns();
     template <Color C> constexpr Bitboard backwardPawns();
 
@@ -208,6 +279,8 @@ template <Tracing T = NO_TRACE> class Eval {
     template <Color C> constexpr Score doubledPawnPenalty();
     template <Color C> constexpr Score pieceSquare();
     template <Color C> constexpr Score mobilityScore();
+    template <Color C> constexpr Score kingShelter(Square ksq);
+    template <Color C> constexpr Score kingSafety();
 
   private:
     void init() {
@@ -229,6 +302,41 @@ template <Tracing T = NO_TRACE> class Eval {
     }
 };
 
+template <Tracing T> template <Color C> void Eval<T>::initAttacks() {
+    const Bitboard pushed = shift<pushDirection(C)>(board.pieces(PAWN, C));
+    const Bitboard east = shift<EAST>(pushed), west = shift<WEST>(pushed);
+
+    attacks.byType[C][PAWN] = east | west;
+    attacks.all[C] = east | west;
+    attacks.twice[C] = east & west;
+
+    addAttacks<KNIGHT, C>();
+    addAttacks<BISHOP, C>();
+    addAttacks<ROOK, C>();
+    addAttacks<QUEEN, C>();
+    addAttacks<KING, C>();
+}
+
+template <Tracing T>
+template <PieceT P, Color C>
+void Eval<T>::addAttacks() {
+    const Bitboard occ = board.pieces();
+    Bitboard pieces = board.pieces(P, C);
+
+    attacks.byType[C][P] = 0;
+    while (pieces) {
+        const Square sq = Square(lsb_index(pieces));
+        const Bitboard a = getAttacks<P>(sq, occ);
+
+        attacks.piece[sq] = a;
+        attacks.byType[C][P] |= a;
+        attacks.twice[C] |= attacks.all[C] & a;
+        attacks.all[C] |= a;
+
+        pieces &= pieces - 1;
+    }
+}
+
 template <Tracing T>
 template <Color C>
 constexpr Bitboard Eval<T>::doubledPawns() {
@@ -256,12 +364,11 @@ constexpr Bitboard Eval<T>::backwardPawns() {
     constexpr Direction Down = pushDirection(~C);
 
     const Bitboard pawns = board.pieces(PAWN, C);
-    const Bitboard enemyPawns = board.pieces(PAWN, ~C);
     const Bitboard stopSquare = shift<Up>(pawns);
 
     const Bitboard candidateBackwardPawns =
-          shift<Down>(pawnDblAttacks<~C>(enemyPawns) & stopSquare) & pawns;
-    const Bitboard defendedStopSquares = pawnDblAttacks<C>(pawns) & stopSquare;
+          shift<Down>(attacks.byType[~C][PAWN] & stopSquare) & pawns;
+    const Bitboard defendedStopSquares = attacks.byType[C][PAWN] & stopSquare;
     const Bitboard backwardPawns =
           candidateBackwardPawns & ~shift<Down>(defendedStopSquares);
 
@@ -438,7 +545,7 @@ constexpr Score Eval<T>::mobilityScore() {
 
     const Bitboard secondThirdRank =
           (C == WHITE) ? (RANK_2BB | RANK_3BB) : (RANK_7BB | RANK_6BB);
-    const Bitboard enemyPawnAttacks = pawnDblAttacks<~C>(enemyPawns);
+    const Bitboard enemyPawnAttacks = attacks.byType[~C][PAWN];
     const Bitboard secondThirdRankPawns = friendlyPawns & secondThirdRank;
     const Bitboard blockedPawns = shift<Down>(enemyPawns) & friendlyPawns;
     const Bitboard friendlyKing = board.pieces(KING, C);
@@ -447,16 +554,13 @@ constexpr Score Eval<T>::mobilityScore() {
     const Bitboard excludedSquares = enemyPawnAttacks | secondThirdRankPawns |
                                      blockedPawns | friendlyKing |
                                      friendlyQueens;
-    // enemyPawnAttacks; // | secondThirdRankPawns |
-    // blockedPawns | friendlyKing |
-    // friendlyQueens;
 
     int mgScore = 0;
     int egScore = 0;
 
     while (knights) {
         Square knightSq = Square(lsb_index(knights));
-        Bitboard knightMoves = knightAttacks[knightSq] & ~excludedSquares;
+        Bitboard knightMoves = attacks.piece[knightSq] & ~excludedSquares;
 
         int numMoves = popcount(knightMoves);
         if (numMoves < 0)
@@ -474,7 +578,7 @@ constexpr Score Eval<T>::mobilityScore() {
 
     while (bishops) {
         Square bishopSq = Square(lsb_index(bishops));
-        Bitboard bishopMoves = getBishopAttacks(bishopSq, 0) & ~excludedSquares;
+        Bitboard bishopMoves = attacks.piece[bishopSq] & ~excludedSquares;
 
         int numMoves = popcount(bishopMoves);
         if (numMoves < 0)
@@ -492,7 +596,7 @@ constexpr Score Eval<T>::mobilityScore() {
 
     while (rooks) {
         Square rookSq = Square(lsb_index(rooks));
-        Bitboard rookMoves = getRookAttacks(rookSq, 0) & ~excludedSquares;
+        Bitboard rookMoves = attacks.piece[rookSq] & ~excludedSquares;
 
         int numMoves = popcount(rookMoves);
         if (numMoves < 0)
@@ -510,10 +614,7 @@ constexpr Score Eval<T>::mobilityScore() {
 
     while (queens) {
         Square queenSq = Square(lsb_index(queens));
-        Bitboard rookMoves = getRookAttacks(queenSq, 0) & ~excludedSquares;
-        Bitboard bishopMoves = getBishopAttacks(queenSq, secondThirdRankPawns) &
-                               ~excludedSquares;
-        Bitboard queenMoves = rookMoves | bishopMoves;
+        Bitboard queenMoves = attacks.piece[queenSq] & ~excludedSquares;
 
         int numMoves = popcount(queenMoves);
         if (numMoves < 0)
@@ -535,5 +636,123 @@ constexpr Score Eval<T>::mobilityScore() {
     return S(mgScore, egScore);
 }
 
+// the own and the enemy pawn closest to the king on each file next to it,
+// looking only ahead of the king, by rank (0 when the file has none)
+template <Tracing T>
+template <Color C>
+constexpr Score Eval<T>::kingShelter(Square ksq) {
+    constexpr Direction Up = pushDirection(C);
+
+    const Bitboard ahead = fill<Up>(RANK_BB(RANK_OF(ksq)));
+    const int kingFile = FILE_OF(ksq);
+
+    int mgScore = 0, egScore = 0;
+    for (int f = std::max(kingFile - 1, 0); f <= std::min(kingFile + 1, 7);
+         f++) {
+        const Bitboard file = FILE_BB(File(f)) & ahead;
+        const Bitboard ours = board.pieces(PAWN, C) & file;
+        const Bitboard theirs = board.pieces(PAWN, ~C) & file;
+
+        int ourRank = 0, theirRank = 0;
+        if (ours) {
+            const Square sq = C == WHITE ? Sq(ours) : Square(lsb_index(ours));
+            ourRank = RANK_OF(C == WHITE ? sq : Square(mirror(sq)));
+        }
+        if (theirs) {
+            const Square sq =
+                  C == WHITE ? Sq(theirs) : Square(lsb_index(theirs));
+            theirRank = RANK_OF(C == WHITE ? sq : Square(mirror(sq)));
+        }
+
+        mgScore += MgScore(kingShelterRank[ourRank]) +
+                   MgScore(kingStormRank[theirRank]);
+        egScore += EgScore(kingShelterRank[ourRank]) +
+                   EgScore(kingStormRank[theirRank]);
+
+        if (T) {
+            trace.kingShelter[ourRank][C]++;
+            trace.kingStorm[theirRank][C]++;
+        }
+    }
+
+    return S(mgScore, egScore);
+}
+
+// the danger to C's king: pieces hitting the squares around it, by how many
+// and by how much, safe checks and the pawn cover
+template <Tracing T>
+template <Color C>
+constexpr Score Eval<T>::kingSafety() {
+    const Square ksq = Square(lsb_index(board.pieces(KING, C)));
+    const Bitboard zone = kingAttacks[ksq] | SQUARE_BB(ksq);
+
+    int mgScore = 0, egScore = 0, attackers = 0;
+    for (int pt = KNIGHT; pt <= QUEEN; pt++) {
+        Bitboard pieces = board.pieces(PieceT(pt), ~C);
+
+        while (pieces) {
+            const Bitboard hits = attacks.piece[lsb_index(pieces)] & zone;
+            if (hits) {
+                const int count = popcount(hits);
+                attackers++;
+
+                mgScore += count * MgScore(kingAttackWeight[pt - KNIGHT]);
+                egScore += count * EgScore(kingAttackWeight[pt - KNIGHT]);
+
+                if (T) {
+                    trace.kingAttackWeight[pt - KNIGHT][C] += count;
+                }
+            }
+
+            pieces &= pieces - 1;
+        }
+    }
+
+    attackers = std::min(attackers, KING_ATTACKERS_MAX);
+    mgScore += MgScore(kingAttackerCount[attackers]);
+    egScore += EgScore(kingAttackerCount[attackers]);
+    if (T) {
+        trace.kingAttackers[attackers][C]++;
+    }
+
+    // a checking square is safe when we do not guard it, or guard it once
+    // against two attackers
+    const Bitboard safe =
+          ~board.pieces(~C) &
+          (~attacks.all[C] | (attacks.twice[~C] & ~attacks.twice[C]));
+    const Bitboard bishopRays = getBishopAttacks(ksq, board.pieces());
+    const Bitboard rookRays = getRookAttacks(ksq, board.pieces());
+    const Bitboard checks[4] = {
+          knightAttacks[ksq] & attacks.byType[~C][KNIGHT],
+          bishopRays & attacks.byType[~C][BISHOP],
+          rookRays & attacks.byType[~C][ROOK],
+          (bishopRays | rookRays) & attacks.byType[~C][QUEEN],
+    };
+
+    for (int i = 0; i < 4; i++) {
+        const int count = popcount(checks[i] & safe);
+
+        mgScore += count * MgScore(safeCheckPenalty[i]);
+        egScore += count * EgScore(safeCheckPenalty[i]);
+
+        if (T) {
+            trace.safeChecks[i][C] += count;
+        }
+    }
+
+    Score shelter;
+    if (pawnEntry && pawnEntry->kingSq[C] == ksq) {
+        shelter = pawnEntry->shelter[C];
+    } else {
+        shelter = kingShelter<C>(ksq);
+        if (pawnEntry) {
+            pawnEntry->shelter[C] = shelter;
+            pawnEntry->kingSq[C] = ksq;
+        }
+    }
+
+    return S(mgScore + MgScore(shelter), egScore + EgScore(shelter));
+}
+
 } // namespace Yayo
 #endif // SEARCH_H_
@@ -16,6 +16,8 @@
 **    along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include "datagen.hpp"
+#include "match.hpp"
 #include "thread.hpp"
 #include "tuner.hpp"
 #include "uci.hpp"
@@ -26,15 +28,183 @@ int main(int argc, char *argv[]) {
     std::unique_ptr<Search> searcher(new Search);
     UCI uci(*searcher.get());
 
+    // yayo bitbase [dir] builds the endgame bitbases missing from dir
+    if (argc >= 2 && strcmp(argv[1], "bitbase") == 0) {
+        init_arrays();
+        initMvvLva();
+        bitbases.generate(argc >= 3 ? argv[2] : ".");
+        return 0;
+    }
+
+    // yayo tune [file] [adam|sgd|adagrad] [resume] takes a packed dataset or
+    // the text format
+    if (argc >= 2 && strcmp(argv[1], "tune") == 0) {
+        init_arrays();
+        initMvvLva();
+
+        std::string optimizer = "adam";
+        bool resume = false;
+        for (int i = 3; i < argc; i++) {
+            if (strcmp(argv[i], "resume") == 0)
+                resume = true;
+            else
+                optimizer = argv[i];
+        }
+
+        TunerEntries tuner(argc >= 3 ? argv[2] : "selfplay.pgn");
+        tuner.runTuner(optimizer, resume);
+        return 0;
+    }
+
+    // yayo nnuetrain <file> [out] [epochs|rate|lambda value]... trains the
+    // network on a packed dataset
+    if (argc >= 3 && strcmp(argv[1], "nnuetrain") == 0) {
+        init_arrays();
+        initMvvLva();
+
+        std::string out = "yayo.nnue";
+        int epochs = NNUE_TRAIN_EPOCHS;
+        double rate = NNUE_TRAIN_RATE, lambda = NNUE_TRAIN_LAMBDA;
+
+        int i = 3;
+        if (argc % 2 == 0)
+            out = argv[i++];
+
+        for (; i + 1 < argc; i += 2) {
+            const std::string key = argv[i];
+            if (key == "epochs")
+                epochs = std::stoi(argv[i + 1]);
+            else if (key == "rate")
+                rate = std::stod(argv[i + 1]);
+            else if (key == "lambda")
+                lambda = std::stod(argv[i + 1]);
+            else
+                std::cerr << "unknown nnuetrain option " << key << "\n";
+        }
+
+        NNUETrainer trainer(argv[2]);
+        trainer.run(out, epochs, rate, lambda);
+        return 0;
+    }
+
+    // yayo tunebench <file> compares the scalar and avx2 gradient kernels
+    if (argc == 3 && strcmp(argv[1], "tunebench") == 0) {
+        init_arrays();
+        initMvvLva();
+        TunerEntries tuner(argv[2]);
+        tuner.benchmark();
+        return 0;
+    }
+
+    // yayo convert <in> <out> packs a text dataset for the tuner
+    if (argc == 4 && strcmp(argv[1], "convert") == 0) {
+        init_arrays();
+        std::cout << "packed " << convertText(argv[2], argv[3])
+                  << " positions\n";
+        return 0;
+    }
+
+    // yayo datagen [out] [games|threads|nodes|depth|random|hash|seed value]...
+    // plays self-play games and writes a packed dataset
+    if (argc >= 2 && strcmp(argv[1], "datagen") == 0) {
+        init_arrays();
+        initMvvLva();
+
+        DatagenOptions options;
+        int i = 2;
+        if (argc % 2 == 1)
+            options.out = argv[i++];
+
+        for (; i + 1 < argc; i += 2) {
+            const std::string key = argv[i];
+            const std::uint64_t value = std::stoull(argv[i + 1]);
+            if (key == "games")
+                options.games = value;
+            else if (key == "threads")
+                options.threads = std::max<int>(1, value);
+            else if (key == "nodes")
+                options.nodes = value;
+            else if (key == "depth")
+                options.depth = value;
+            else if (key == "random")
+                options.randomPlies = value;
+            else if (key == "hash")
+                options.hash = value;
+            else if (key == "seed")
+                options.seed = value;
+            else
+                std::cerr << "unknown datagen option " << key << "\n";
+        }
+
+        runDatagen(options);
+        return 0;
+    }
+
+    // yayo match <engine> <engine> [games|concurrency|tc|nodes|hash|openings|
+    // random|seed|elo0|elo1|alpha|beta value]... runs an sprt between two
+    // builds, tc being base+inc in seconds
+    if (argc >= 4 && strcmp(argv[1], "match") == 0) {
+        init_arrays();
+        initMvvLva();
+
+        MatchOptions options;
+        options.engines[0] = argv[2];
+        options.engines[1] = argv[3];
+
+        for (int i = 4; i + 1 < argc; i += 2) {
+            const std::string key = argv[i], value = argv[i + 1];
+            if (key == "games")
+                options.games = std::stoull(value);
+            else if (key == "concurrency")
+                options.concurrency = std::max(1, std::stoi(value));
+            else if (key == "tc") {
+                const std::size_t plus = value.find('+');
+                options.base = std::stod(value) * 1000;
+                options.inc = plus == std::string::npos
+                                    ? 0
+                                    : std::stod(value.substr(plus + 1)) * 1000;
+            } else if (key == "nodes")
+                options.nodes = std::stoull(value);
+            else if (key == "hash")
+                options.hash = std::stoi(value);
+            else if (key == "openings")
+                options.openings = value;
+            else if (key == "random")
+                options.randomPlies = std::stoi(value);
+            else if (key == "seed")
+                options.seed = std::stoull(value);
+            else if (key == "elo0")
+                options.elo0 = std::stod(value);
+            else if (key == "elo1")
+                options.elo1 = std::stod(value);
+            else if (key == "alpha")
+                options.alpha = std::stod(value);
+            else if (key == "beta")
+                options.beta = std::stod(value);
+            else
+                std::cerr << "unknown match option " << key << "\n";
+        }
+
+        runMatch(options);
+        return 0;
+    }
+
+    if (argc == 3 && strcmp(argv[1], "nnuebench") == 0) {
+        uci.NNUEBench(argv[2]);
+        return 0;
+    }
+
+    if (argc == 3 && strcmp(argv[1], "bookbench") == 0) {
+        uci.BookBench(argv[2]);
+        return 0;
+    }
+
     if (argc == 2) {
         if (strcmp(argv[1], "bench") == 0) {
             uci.Bench();
             return 0;
-        } else if (strcmp(argv[1], "tune") == 0) {
-            init_arrays();
-            initMvvLva();
-            TunerEntries tuner("selfplay.pgn");
-            tuner.runTuner();
+        } else if (strcmp(argv[1], "seebench") == 0) {
+            uci.SeeBench();
             return 0;
         } else if (strcmp(argv[1], "perft") == 0) {
             init_arrays();
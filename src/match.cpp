@@ -0,0 +1,603 @@
+/*
+**    Yayo is a UCI chess engine written by am5083 (am@kvasm.us)
+**    Copyright (C) 2022 Ahmed Mohamed (am@kvasm.us)
+**
+**    This program is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**    This program is distributed in the hope that it will be useful,
+**    but WITHOUT ANY WARRANTY; without even the implied warranty of
+**    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**    GNU General Public License for more details.
+**
+**    You should have received a copy of the GNU General Public License
+**    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "match.hpp"
+#include "board.hpp"
+#include "movegen.hpp"
+#include "util.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <csignal>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <poll.h>
+#include <random>
+#include <sstream>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace Yayo {
+
+std::uint64_t Pentanomial::count() const {
+    std::uint64_t n = 0;
+    for (int i = 0; i < 5; i++)
+        n += pairs[i];
+    return n;
+}
+
+double Pentanomial::score() const {
+    const std::uint64_t n = count();
+    if (!n)
+        return 0.5;
+
+    double sum = 0;
+    for (int i = 0; i < 5; i++)
+        sum += pairs[i] * i / 4.0;
+    return sum / n;
+}
+
+double Pentanomial::variance() const {
+    const std::uint64_t n = count();
+    if (!n)
+        return 0.0;
+
+    const double s = score();
+    double sum = 0;
+    for (int i = 0; i < 5; i++)
+        sum += pairs[i] * (i / 4.0 - s) * (i / 4.0 - s);
+    return sum / n;
+}
+
+static double scoreToElo(double s) {
+    s = std::clamp(s, 1e-6, 1.0 - 1e-6);
+    return -400.0 * std::log10(1.0 / s - 1.0);
+}
+
+static double eloToScore(double elo) {
+    return 1.0 / (1.0 + std::pow(10.0, -elo / 400.0));
+}
+
+double Pentanomial::elo() const { return scoreToElo(score()); }
+
+double Pentanomial::eloError() const {
+    const std::uint64_t n = count();
+    if (!n)
+        return 0.0;
+
+    const double s = score(), dev = 1.96 * std::sqrt(variance() / n);
+    return (scoreToElo(s + dev) - scoreToElo(s - dev)) / 2.0;
+}
+
+// normal approximation of the log likelihood ratio between the two elo
+// hypotheses, with the variance taken from the pairs themselves. A run of
+// identical pairs has none yet, the floor lets such a test still end.
+double Pentanomial::llr(double elo0, double elo1) const {
+    const std::uint64_t n = count();
+    const double var = std::max(variance(), 1e-3);
+    if (!n)
+        return 0.0;
+
+    const double s0 = eloToScore(elo0), s1 = eloToScore(elo1);
+    return n * (s1 - s0) * (2.0 * score() - s0 - s1) / (2.0 * var);
+}
+
+namespace {
+
+// an engine process talking UCI over a pair of pipes
+class UciEngine {
+  public:
+    ~UciEngine() { stop(); }
+
+    bool start(const std::string &path, int hash);
+    void stop();
+    bool alive();
+
+    bool send(const std::string &line);
+    // false on eof, or once timeout ms pass without a full line
+    bool readLine(std::string &line, int timeout);
+    bool waitFor(const std::string &token, int timeout);
+
+  private:
+    pid_t pid = -1;
+    int in = -1, out = -1;
+    std::string buffer;
+};
+
+bool UciEngine::start(const std::string &path, int hash) {
+    int toChild[2], fromChild[2];
+    if (pipe2(toChild, O_CLOEXEC))
+        return false;
+    if (pipe2(fromChild, O_CLOEXEC)) {
+        close(toChild[0]);
+        close(toChild[1]);
+        return false;
+    }
+
+    pid = fork();
+    if (pid == 0) {
+        dup2(toChild[0], STDIN_FILENO);
+        dup2(fromChild[1], STDOUT_FILENO);
+        execl(path.c_str(), path.c_str(), (char *)nullptr);
+        _exit(127);
+    }
+
+    close(toChild[0]);
+    close(fromChild[1]);
+    in = toChild[1];
+    out = fromChild[0];
+    buffer.clear();
+
+    if (pid < 0) {
+        stop();
+        return false;
+    }
+
+    if (!send("uci") || !waitFor("uciok", 10000) ||
+        !send("setoption name Hash value " + std::to_string(hash)) ||
+        !send("isready") || !waitFor("readyok", 10000)) {
+        stop();
+        return false;
+    }
+
+    return true;
+}
+
+void UciEngine::stop() {
+    if (in >= 0) {
+        send("quit");
+        close(in);
+        in = -1;
+    }
+
+    if (out >= 0) {
+        close(out);
+        out = -1;
+    }
+
+    if (pid > 0) {
+        // give it a moment to quit on its own
+        const std::uint64_t deadline = get_time() + 500;
+        while (waitpid(pid, nullptr, WNOHANG) == 0) {
+            if (get_time() > deadline) {
+                kill(pid, SIGKILL);
+                waitpid(pid, nullptr, 0);
+                break;
+            }
+            usleep(1000);
+        }
+    }
+
+    pid = -1;
+}
+
+// reaps the process once it has exited, so a crash is told apart from an
+// engine that is only slow to answer
+bool UciEngine::alive() {
+    if (pid > 0 && waitpid(pid, nullptr, WNOHANG) == pid) {
+        pid = -1;
+        stop();
+    }
+
+    return pid > 0;
+}
+
+bool UciEngine::send(const std::string &line) {
+    if (in < 0)
+        return false;
+
+    const std::string data = line + "\n";
+    std::size_t done = 0;
+    while (done < data.size()) {
+        const ssize_t n = write(in, data.data() + done, data.size() - done);
+        if (n <= 0)
+            return false;
+        done += n;
+    }
+
+    return true;
+}
+
+bool UciEngine::readLine(std::string &line, int timeout) {
+    const std::uint64_t deadline = get_time() + timeout;
+
+    while (true) {
+        const std::size_t end = buffer.find('\n');
+        if (end != std::string::npos) {
+            line = buffer.substr(0, end);
+            buffer.erase(0, end + 1);
+            if (!line.empty() && line.back() == '\r')
+                line.pop_back();
+            return true;
+        }
+
+        const std::uint64_t now = get_time();
+        if (out < 0 || now >= deadline)
+            return false;
+
+        pollfd fd = {out, POLLIN, 0};
+        if (poll(&fd, 1, int(deadline - now)) <= 0)
+            return false;
+
+        char chunk[4096];
+        const ssize_t n = read(out, chunk, sizeof(chunk));
+        if (n <= 0)
+            return false;
+        buffer.append(chunk, n);
+    }
+}
+
+bool UciEngine::waitFor(const std::string &token, int timeout) {
+    const std::uint64_t deadline = get_time() + timeout;
+    std::string line;
+
+    while (get_time() < deadline) {
+        if (!readLine(line, int(deadline - get_time())))
+            return false;
+        if (line.rfind(token, 0) == 0)
+            return true;
+    }
+
+    return false;
+}
+
+struct Shared {
+    const MatchOptions &options;
+    std::vector<std::string> openings;
+    std::uint64_t totalPairs;
+    std::atomic<std::uint64_t> nextPair{0};
+    std::atomic<bool> done{false};
+
+    std::mutex lock;
+    Pentanomial penta;
+    std::uint64_t wdl[3] = {0};
+    double lower, upper;
+    std::uint64_t startTime;
+};
+
+// random moves from the start position, retried until the game is still on
+std::string randomOpening(std::mt19937_64 &rng, int plies) {
+    Board board;
+    while (true) {
+        board.setFen(START_POS);
+
+        moveList mList = {0};
+        for (int i = 0; i < plies; i++) {
+            mList = {0};
+            generate(board, &mList);
+            if (!mList.nMoves)
+                break;
+            make(board, mList.moves[rng() % mList.nMoves].move);
+            board.ply = 0;
+        }
+
+        mList = {0};
+        generate(board, &mList);
+        if (mList.nMoves)
+            return board.fen();
+    }
+}
+
+unsigned short findMove(const Board &board, const std::string &str) {
+    moveList mList = {0};
+    generate(board, &mList);
+
+    for (int i = 0; i < mList.nMoves; i++)
+        if (move_str(mList.moves[i].move) == str)
+            return mList.moves[i].move;
+    return 0;
+}
+
+// the score of the search that just finished, from the mover's view
+bool parseScore(const std::string &line, int &score) {
+    std::istringstream iss(line);
+    std::string token;
+
+    while (iss >> token) {
+        if (token != "score")
+            continue;
+
+        iss >> token;
+        int value;
+        if (!(iss >> value))
+            return false;
+
+        if (token == "cp")
+            score = value;
+        else if (token == "mate")
+            score = value > 0 ? CHECKMATE : -CHECKMATE;
+        else
+            return false;
+        return true;
+    }
+
+    return false;
+}
+
+// plays one game between players[WHITE] and players[BLACK], returns the
+// result from white's view: 0 loss, 1 draw, 2 win
+int playGame(UciEngine *players[2], const std::string &fen,
+             const MatchOptions &options, std::string &reason) {
+    Board board;
+    board.setFen(fen);
+
+    for (int c = 0; c < 2; c++) {
+        if (!players[c]->send("ucinewgame") || !players[c]->send("isready") ||
+            !players[c]->waitFor("readyok", 10000)) {
+            reason = "engine failed to start the game";
+            players[c]->stop();
+            return c == WHITE ? 0 : 2;
+        }
+    }
+
+    const int loss[2] = {0, 2};
+    std::int64_t clock[2] = {options.base, options.base};
+    std::string moves;
+    int winPlies = 0, drawPlies = 0;
+
+    for (int ply = 0;; ply++) {
+        moveList mList = {0};
+        generate(board, &mList);
+
+        if (!mList.nMoves) {
+            if (!board.checkPcs) {
+                reason = "stalemate";
+                return 1;
+            }
+            reason = "checkmate";
+            return loss[board.turn];
+        }
+
+        if (board.halfMoves >= 100 || board.isDraw() || board.isTMR() ||
+            ply >= MATCH_MAX_PLIES) {
+            reason = "draw by rule";
+            return 1;
+        }
+
+        const int us = board.turn;
+        UciEngine *engine = players[us];
+
+        engine->send("position fen " + fen + (moves.empty() ? "" : " moves") +
+                     moves);
+        if (options.nodes) {
+            engine->send("go nodes " + std::to_string(options.nodes));
+        } else {
+            std::ostringstream go;
+            go << "go wtime " << std::max<std::int64_t>(1, clock[WHITE])
+               << " btime " << std::max<std::int64_t>(1, clock[BLACK])
+               << " winc " << options.inc << " binc " << options.inc;
+            engine->send(go.str());
+        }
+
+        const int timeout = options.nodes ? MATCH_NODES_TIMEOUT
+                                          : clock[us] + MATCH_TIME_MARGIN;
+        const std::uint64_t start = get_time();
+        std::string line, best;
+        int score = 0;
+        bool scored = false, moved = false;
+
+        while (!moved) {
+            const int left = timeout - int(get_time() - start);
+            if (left <= 0 || !engine->readLine(line, left)) {
+                // hung or gone, it is restarted before the next game. The
+                // pipe closing early also means the process went away,
+                // even if it is not reaped yet
+                const bool early = int(get_time() - start) < timeout;
+                reason = engine->alive() && !early ? "time forfeit"
+                                                   : "engine crashed";
+                engine->stop();
+                return loss[us];
+            }
+
+            if (line.rfind("info", 0) == 0 && parseScore(line, score))
+                scored = true;
+            else if (line.rfind("bestmove", 0) == 0) {
+                // a bare bestmove leaves best empty, which is illegal
+                std::istringstream(line.substr(8)) >> best;
+                moved = true;
+            }
+        }
+
+        if (!options.nodes) {
+            clock[us] -= get_time() - start;
+            if (clock[us] < -MATCH_TIME_MARGIN) {
+                reason = "time forfeit";
+                return loss[us];
+            }
+            clock[us] += options.inc;
+        }
+
+        const unsigned short move = findMove(board, best);
+        if (!move) {
+            reason = "illegal move " + (best.empty() ? "(none)" : best);
+            return loss[us];
+        }
+
+        // both engines have to agree on the winner, counted with white's sign
+        const int white = us == WHITE ? score : -score;
+        const int side = white > 0 ? 1 : -1;
+        if (scored && std::abs(score) >= MATCH_WIN_SCORE)
+            winPlies = winPlies * side > 0 ? winPlies + side : side;
+        else
+            winPlies = 0;
+
+        if (std::abs(winPlies) >= MATCH_WIN_PLIES) {
+            reason = "adjudicated win";
+            return winPlies > 0 ? 2 : 0;
+        }
+
+        if (scored && ply >= MATCH_DRAW_START &&
+            std::abs(score) <= MATCH_DRAW_SCORE)
+            drawPlies++;
+        else
+            drawPlies = 0;
+
+        if (drawPlies >= MATCH_DRAW_PLIES) {
+            reason = "adjudicated draw";
+            return 1;
+        }
+
+        make(board, move);
+        board.ply = 0;
+        moves += " " + best;
+    }
+}
+
+void report(Shared &shared) {
+    const MatchOptions &options = shared.options;
+    const Pentanomial &p = shared.penta;
+    const double llr = p.llr(options.elo0, options.elo1);
+
+    printf("games %llu: +%llu =%llu -%llu  elo %.1f +- %.1f  llr %.2f "
+           "(%.2f, %.2f) [%.1f, %.1f]  ptnml %llu %llu %llu %llu %llu\n",
+           (unsigned long long)(p.count() * 2),
+           (unsigned long long)shared.wdl[2],
+           (unsigned long long)shared.wdl[1],
+           (unsigned long long)shared.wdl[0], p.elo(), p.eloError(), llr,
+           shared.lower, shared.upper, options.elo0, options.elo1,
+           (unsigned long long)p.pairs[0], (unsigned long long)p.pairs[1],
+           (unsigned long long)p.pairs[2], (unsigned long long)p.pairs[3],
+           (unsigned long long)p.pairs[4]);
+    fflush(stdout);
+}
+
+void worker(Shared &shared) {
+    const MatchOptions &options = shared.options;
+    UciEngine engines[2];
+
+    while (!shared.done) {
+        const std::uint64_t pair = shared.nextPair++;
+        if (pair >= shared.totalPairs)
+            break;
+
+        std::string fen;
+        if (shared.openings.empty()) {
+            std::mt19937_64 rng(options.seed * 0x9E3779B97F4A7C15ull + pair);
+            fen = randomOpening(rng, options.randomPlies);
+        } else {
+            fen = shared.openings[pair % shared.openings.size()];
+        }
+
+        // points of the first engine over the pair, 0 to 4
+        int points = 0, results[2];
+        for (int game = 0; game < 2; game++) {
+            for (int e = 0; e < 2; e++) {
+                if (!engines[e].alive() &&
+                    !engines[e].start(options.engines[e], options.hash)) {
+                    std::cerr << "ERROR: COULD NOT START "
+                              << options.engines[e] << "\n";
+                    shared.done = true;
+                    return;
+                }
+            }
+
+            // the first engine is white in the first game of the pair
+            UciEngine *players[2] = {&engines[game], &engines[1 - game]};
+            std::string reason;
+            const int result = playGame(players, fen, options, reason);
+            results[game] = game ? 2 - result : result;
+
+            // anything but a normal ending points at a broken build
+            if (reason.find("crash") != std::string::npos ||
+                reason.find("forfeit") != std::string::npos ||
+                reason.find("illegal") != std::string::npos)
+                std::cerr << "pair " << pair << " game " << game << ": "
+                          << reason << " (" << fen << ")\n";
+            points += results[game];
+        }
+
+        std::lock_guard<std::mutex> guard(shared.lock);
+        if (shared.done)
+            break;
+
+        shared.penta.pairs[points]++;
+        for (int game = 0; game < 2; game++)
+            shared.wdl[results[game]]++;
+        report(shared);
+
+        const double llr = shared.penta.llr(options.elo0, options.elo1);
+        if (shared.penta.count() >= MATCH_MIN_PAIRS &&
+            (llr <= shared.lower || llr >= shared.upper))
+            shared.done = true;
+    }
+
+}
+
+} // namespace
+
+void runMatch(const MatchOptions &options) {
+    // a dead engine should fail a write, not take the match down with it
+    signal(SIGPIPE, SIG_IGN);
+
+    Shared shared{options};
+    shared.totalPairs = (options.games + 1) / 2;
+    shared.lower = std::log(options.beta / (1.0 - options.alpha));
+    shared.upper = std::log((1.0 - options.beta) / options.alpha);
+
+    if (!options.openings.empty()) {
+        std::ifstream file(options.openings);
+        std::string line;
+        while (std::getline(file, line)) {
+            // epd lines carry 4 fields and maybe opcodes, fens carry 6
+            std::istringstream iss(line);
+            std::string field, fen;
+            for (int i = 0; i < 6 && iss >> field; i++) {
+                if (i >= 4 && !std::all_of(field.begin(), field.end(),
+                                           ::isdigit))
+                    break;
+                fen += (i ? " " : "") + field;
+            }
+
+            if (std::count(fen.begin(), fen.end(), ' ') == 3)
+                fen += " 0 1";
+            if (std::count(fen.begin(), fen.end(), ' ') == 5)
+                shared.openings.push_back(fen);
+        }
+
+        if (shared.openings.empty()) {
+            std::cerr << "ERROR: NO OPENINGS IN " << options.openings << "\n";
+            return;
+        }
+    }
+
+    shared.startTime = get_time();
+
+    std::vector<std::thread> pool;
+    for (int i = 0; i < options.concurrency; i++)
+        pool.emplace_back(worker, std::ref(shared));
+    for (auto &t : pool)
+        t.join();
+
+    const double llr = shared.penta.llr(options.elo0, options.elo1);
+    std::cout << "finished " << shared.penta.count() * 2 << " games in "
+              << (get_time() - shared.startTime) / 1000 << "s, ";
+    if (shared.penta.count() < MATCH_MIN_PAIRS)
+        std::cout << "too few pairs for the sprt\n";
+    else if (llr >= shared.upper)
+        std::cout << "H1 accepted (elo >= " << options.elo1 << ")\n";
+    else if (llr <= shared.lower)
+        std::cout << "H0 accepted (elo <= " << options.elo0 << ")\n";
+    else
+        std::cout << "sprt inconclusive\n";
+}
+
+} // namespace Yayo
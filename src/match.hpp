@@ -0,0 +1,78 @@
+/*
+**    Yayo is a UCI chess engine written by am5083 (am@kvasm.us)
+**    Copyright (C) 2022 Ahmed Mohamed (am@kvasm.us)
+**
+**    This program is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**    This program is distributed in the hope that it will be useful,
+**    but WITHOUT ANY WARRANTY; without even the implied warranty of
+**    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**    GNU General Public License for more details.
+**
+**    You should have received a copy of the GNU General Public License
+**    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MATCH_H_
+#define MATCH_H_
+#include <cstdint>
+#include <string>
+
+namespace Yayo {
+
+// adjudication, as in datagen but on the scores both engines report
+#define MATCH_WIN_SCORE 1000
+#define MATCH_WIN_PLIES 6
+#define MATCH_DRAW_SCORE 10
+#define MATCH_DRAW_PLIES 12
+#define MATCH_DRAW_START 80
+#define MATCH_MAX_PLIES 600
+// slack on the clock before a game is lost on time, in ms
+#define MATCH_TIME_MARGIN 100
+// how long a node limited search may take before the engine is given up on
+#define MATCH_NODES_TIMEOUT 60000
+// the variance of a handful of pairs is too small to trust, so the sprt does
+// not stop before this many
+#define MATCH_MIN_PAIRS 16
+
+struct MatchOptions {
+    std::string engines[2];
+    std::uint64_t games = 1000;
+    int concurrency = 1;
+    // base and increment in ms, unused when nodes is set
+    int base = 10000, inc = 100;
+    std::uint64_t nodes = 0;
+    int hash = 16;
+    // an epd or fen file, otherwise randomPlies random moves from startpos
+    std::string openings;
+    int randomPlies = 8;
+    std::uint64_t seed = 0;
+    double elo0 = 0.0, elo1 = 5.0, alpha = 0.05, beta = 0.05;
+};
+
+// Game pair outcomes of the first engine, from 0 (lost both) to 4 (won both),
+// and the generalized SPRT on them in logistic elo.
+struct Pentanomial {
+    std::uint64_t pairs[5] = {0};
+
+    std::uint64_t count() const;
+    // mean score and the variance of one pair's score, both in [0, 1]
+    double score() const;
+    double variance() const;
+    double elo() const;
+    // half width of the 95% confidence interval on elo
+    double eloError() const;
+    double llr(double elo0, double elo1) const;
+};
+
+// Plays the two engines against each other over UCI, each opening once with
+// either color, on concurrency pairs of engine processes. Stops early once
+// the SPRT accepts either hypothesis.
+void runMatch(const MatchOptions &options);
+
+} // namespace Yayo
+
+#endif // MATCH_H_
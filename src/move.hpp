@@ -85,7 +85,8 @@ static inline std::string move_str(unsigned short move) {
     std::string m = "";
     m += nToSq[from];
     m += nToSq[to];
-    m += flags;
+    if (flags >= P_KNIGHT)
+        m += "nbrq"[(flags - P_KNIGHT) & 3];
 
     return m;
 }
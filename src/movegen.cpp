@@ -17,6 +17,7 @@
 */
 
 #include "movegen.hpp"
+#include "nnue.hpp"
 
 namespace Yayo {
 
@@ -44,6 +45,9 @@ void printMvvLvaTable() {
 void makeNullMove(Board &board) {
     int ply = board.gamePly;
 
+    if (board.acc)
+        pushAccumulator(board, 0);
+
     (board.hist)[ply].checkPcs = board.checkPcs;
     (board.hist)[ply].lastCapt = board.lastCapt;
     (board.hist)[ply].castleStatus = board.castleRights;
@@ -51,6 +55,7 @@ void makeNullMove(Board &board) {
     (board.hist)[ply].halfMoves = board.halfMoves;
     (board.hist)[ply].fullMoves = board.fullMoves;
     (board.hist)[ply].key = board.key;
+    (board.hist)[ply].pliesFromNull = board.pliesFromNull;
 
     board.key ^= (board.enPass != SQUARE_64)
                        ? zobristEpFile[FILE_OF(board.enPass)]
@@ -65,11 +70,15 @@ void makeNullMove(Board &board) {
     board.gamePly++;
     board.halfMoves++;
     board.fullMoves++;
+    board.pliesFromNull = 0;
 
     board.turn = ~board.turn;
 }
 
 void unmakeNullMove(Board &board) {
+    if (board.acc)
+        board.acc--;
+
     board.turn = ~board.turn;
     board.ply--;
     board.gamePly--;
@@ -82,6 +91,7 @@ void unmakeNullMove(Board &board) {
     board.halfMoves = (board.hist)[ply].halfMoves;
     board.fullMoves = (board.hist)[ply].fullMoves;
     board.key = (board.hist)[ply].key;
+    board.pliesFromNull = (board.hist)[ply].pliesFromNull;
 }
 
 void make(Board &board, unsigned short move) {
@@ -91,12 +101,22 @@ void make(Board &board, unsigned short move) {
     Piece fromPc = board.board[fromSq];
     Piece toPc = board.board[toSq];
 
+    const int oldCastle = board.castleRights;
+
+    if (board.acc)
+        pushAccumulator(board, move);
+
+#ifdef COPY_MAKE
+    board.states[board.gamePly & (STATE_STACK_SIZE - 1)] = board;
+#else
     board.hist[board.gamePly].checkPcs = board.checkPcs;
     board.hist[board.gamePly].lastCapt = board.lastCapt;
     board.hist[board.gamePly].castleStatus = board.castleRights;
     board.hist[board.gamePly].enPass = board.enPass;
     board.hist[board.gamePly].halfMoves = board.halfMoves;
     board.hist[board.gamePly].fullMoves = board.fullMoves;
+    board.hist[board.gamePly].pliesFromNull = board.pliesFromNull;
+#endif
     board.hist[board.gamePly].key = board.key;
 
     board.key ^= (board.enPass != SQUARE_64)
@@ -317,7 +337,7 @@ void make(Board &board, unsigned short move) {
     } break;
     }
 
-    int temp = board.castleRights ^ board.hist[board.ply].castleStatus;
+    int temp = board.castleRights ^ oldCastle;
     board.key ^= zobristCastleRights[temp];
 
     board.turn = ~board.turn;
@@ -332,13 +352,20 @@ void make(Board &board, unsigned short move) {
 
     board.ply++;
     board.gamePly++;
+    board.pliesFromNull++;
 
     if (board.turn == WHITE)
         board.fullMoves++;
 }
 
 void unmake(Board &board, unsigned short move) {
-    int copy = 1;
+    if (board.acc)
+        board.acc--;
+
+#ifdef COPY_MAKE
+    static_cast<BoardState &>(board) =
+          board.states[(board.gamePly - 1) & (STATE_STACK_SIZE - 1)];
+#else
     board.turn = ~board.turn;
     board.ply--;
     board.gamePly--;
@@ -350,6 +377,7 @@ void unmake(Board &board, unsigned short move) {
     board.halfMoves = board.hist[ply].halfMoves;
     board.fullMoves = board.hist[ply].fullMoves;
     board.key = board.hist[ply].key;
+    board.pliesFromNull = board.hist[ply].pliesFromNull;
 
     Square fromSq = getFrom(move);
     Square toSq = getTo(move);
@@ -460,7 +488,6 @@ void unmake(Board &board, unsigned short move) {
     case CP_BISHOP:
     case CP_ROOK:
     case CP_QUEEN: {
-        Board c2(board);
         int pTo = getCapture(move) - CP_KNIGHT;
         Piece promoPc = Piece(W_KNIGHT + (pTo + (8 * board.turn)));
 
@@ -484,6 +511,7 @@ void unmake(Board &board, unsigned short move) {
     }
 
     board.lastCapt = board.hist[ply].lastCapt;
+#endif
 }
 
 } // namespace Yayo
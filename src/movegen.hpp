@@ -141,9 +141,9 @@ constexpr moveList *generatePawnMoves(const Board &board, moveList *mList,
 
             int score = mvvLvaTable[toPc][fromPc];
             mList->addMove(encodeMove(fromSq, s, CP_QUEEN), true, true, score);
-            mList->addMove(encodeMove(fromSq, s, CP_QUEEN), true, true, score);
-            mList->addMove(encodeMove(fromSq, s, CP_QUEEN), true, true, score);
-            mList->addMove(encodeMove(fromSq, s, CP_QUEEN), true, true, score);
+            mList->addMove(encodeMove(fromSq, s, CP_ROOK), true, true, score);
+            mList->addMove(encodeMove(fromSq, s, CP_BISHOP), true, true, score);
+            mList->addMove(encodeMove(fromSq, s, CP_KNIGHT), true, true, score);
         }
 
         while (pushPromo) {
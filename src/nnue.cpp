@@ -0,0 +1,280 @@
+/*
+**    Yayo is a UCI chess engine written by am5083 (am@kvasm.us)
+**    Copyright (C) 2022 Ahmed Mohamed (am@kvasm.us)
+**
+**    This program is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**    This program is distributed in the hope that it will be useful,
+**    but WITHOUT ANY WARRANTY; without even the implied warranty of
+**    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**    GNU General Public License for more details.
+**
+**    You should have received a copy of the GNU General Public License
+**    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "nnue.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <immintrin.h>
+
+namespace Yayo {
+
+NNUE nnue;
+
+bool NNUE::load(const std::string &path) {
+    std::FILE *file = std::fopen(path.c_str(), "rb");
+    if (!file)
+        return false;
+
+    auto read = [&](void *data, std::size_t size) {
+        return std::fread(data, size, 1, file) == 1;
+    };
+
+    NetworkHeader header;
+    auto next = std::make_unique<Network>();
+    const bool ok =
+          read(&header, sizeof(header)) && header.magic == NNUE_MAGIC &&
+          header.inputs == NNUE_INPUTS && header.hidden == NNUE_HIDDEN &&
+          header.l2 == NNUE_L2 && header.l3 == NNUE_L3 &&
+          header.scale == NNUE_SCALE &&
+          read(next->ftBias, sizeof(next->ftBias)) &&
+          read(next->ftWeights, sizeof(next->ftWeights)) &&
+          read(next->l2Bias, sizeof(next->l2Bias)) &&
+          read(next->l2Weights, sizeof(next->l2Weights)) &&
+          read(next->l3Bias, sizeof(next->l3Bias)) &&
+          read(next->l3Weights, sizeof(next->l3Weights)) &&
+          read(&next->outBias, sizeof(next->outBias)) &&
+          read(next->outWeights, sizeof(next->outWeights));
+    std::fclose(file);
+
+    if (!ok)
+        return false;
+
+    net = std::move(next);
+    simd = __builtin_cpu_supports("avx2");
+    return true;
+}
+
+bool NNUE::save(const std::string &path) const {
+    std::FILE *file = net ? std::fopen(path.c_str(), "wb") : nullptr;
+    if (!file)
+        return false;
+
+    auto write = [&](const void *data, std::size_t size) {
+        return std::fwrite(data, size, 1, file) == 1;
+    };
+
+    const NetworkHeader header = {NNUE_MAGIC, NNUE_INPUTS, NNUE_HIDDEN,
+                                  NNUE_L2,    NNUE_L3,     NNUE_SCALE};
+    bool ok = write(&header, sizeof(header)) &&
+              write(net->ftBias, sizeof(net->ftBias)) &&
+              write(net->ftWeights, sizeof(net->ftWeights)) &&
+              write(net->l2Bias, sizeof(net->l2Bias)) &&
+              write(net->l2Weights, sizeof(net->l2Weights)) &&
+              write(net->l3Bias, sizeof(net->l3Bias)) &&
+              write(net->l3Weights, sizeof(net->l3Weights)) &&
+              write(&net->outBias, sizeof(net->outBias)) &&
+              write(net->outWeights, sizeof(net->outWeights));
+    ok = std::fclose(file) == 0 && ok;
+    return ok;
+}
+
+void NNUE::refresh(const Board &board, Accumulator &acc, Color persp) const {
+    std::int16_t *values = acc.values[persp];
+    std::memcpy(values, net->ftBias, sizeof(net->ftBias));
+
+    const Square ksq = Square(lsb_index(board.pieces(KING, persp)));
+    Bitboard occ = board.pieces();
+    while (occ) {
+        const Square sq = Square(lsb_index(occ));
+        const std::int16_t *row =
+              net->ftWeights[nnueFeature(persp, ksq, board.board[sq], sq)];
+        for (int i = 0; i < NNUE_HIDDEN; i++)
+            values[i] += row[i];
+        occ &= occ - 1;
+    }
+
+    acc.computed[persp] = true;
+}
+
+// walks back to the nearest computed ply and replays the moves since, unless
+// a king move in between forces a refresh
+void NNUE::update(const Board &board, Color persp) const {
+    Accumulator *cur = board.acc;
+    if (cur->computed[persp])
+        return;
+
+    Accumulator *acc = cur;
+    while (!acc->computed[persp] && !acc->dirty.refresh[persp])
+        acc--;
+
+    if (!acc->computed[persp]) {
+        refresh(board, *cur, persp);
+        return;
+    }
+
+    const Square ksq = Square(lsb_index(board.pieces(KING, persp)));
+    for (; acc != cur; acc++) {
+        const DirtyPieces &dirty = acc[1].dirty;
+        std::int16_t *values = acc[1].values[persp];
+        std::memcpy(values, acc->values[persp], sizeof(acc->values[persp]));
+
+        for (int d = 0; d < dirty.num; d++) {
+            if (dirty.from[d] != SQUARE_64) {
+                const std::int16_t *row = net->ftWeights[nnueFeature(
+                      persp, ksq, dirty.pc[d], dirty.from[d])];
+                for (int i = 0; i < NNUE_HIDDEN; i++)
+                    values[i] -= row[i];
+            }
+
+            if (dirty.to[d] != SQUARE_64) {
+                const std::int16_t *row = net->ftWeights[nnueFeature(
+                      persp, ksq, dirty.pc[d], dirty.to[d])];
+                for (int i = 0; i < NNUE_HIDDEN; i++)
+                    values[i] += row[i];
+            }
+        }
+
+        acc[1].computed[persp] = true;
+    }
+}
+
+int NNUE::evaluate(const Board &board) {
+    if (!board.acc) {
+        Accumulator acc;
+        refresh(board, acc, WHITE);
+        refresh(board, acc, BLACK);
+        return propagate(acc, board.turn);
+    }
+
+    update(board, WHITE);
+    update(board, BLACK);
+    return propagate(*board.acc, board.turn);
+}
+
+int NNUE::propagate(const Accumulator &acc, Color stm) const {
+    const int out = simd ? propagateAVX2(acc, stm) : propagateScalar(acc, stm);
+    return out * NNUE_SCALE / (NNUE_QA * NNUE_QB);
+}
+
+int NNUE::propagateScalar(const Accumulator &acc, Color stm) const {
+    // clipped relu, the side to move first
+    std::uint8_t input[2 * NNUE_HIDDEN], l2[NNUE_L2], l3[NNUE_L3];
+    for (int i = 0; i < NNUE_HIDDEN; i++) {
+        input[i] = std::clamp<int>(acc.values[stm][i], 0, NNUE_QA);
+        input[NNUE_HIDDEN + i] =
+              std::clamp<int>(acc.values[~stm][i], 0, NNUE_QA);
+    }
+
+    for (int o = 0; o < NNUE_L2; o++) {
+        int sum = net->l2Bias[o];
+        for (int i = 0; i < 2 * NNUE_HIDDEN; i++)
+            sum += input[i] * net->l2Weights[o][i];
+        l2[o] = std::clamp(sum >> NNUE_QB_SHIFT, 0, NNUE_QA);
+    }
+
+    for (int o = 0; o < NNUE_L3; o++) {
+        int sum = net->l3Bias[o];
+        for (int i = 0; i < NNUE_L2; i++)
+            sum += l2[i] * net->l3Weights[o][i];
+        l3[o] = std::clamp(sum >> NNUE_QB_SHIFT, 0, NNUE_QA);
+    }
+
+    int out = net->outBias;
+    for (int i = 0; i < NNUE_L3; i++)
+        out += l3[i] * net->outWeights[i];
+    return out;
+}
+
+#define AVX2_TARGET __attribute__((target("avx2")))
+
+namespace {
+
+// activations are at most 127, so the pairwise sums in maddubs can not
+// saturate
+AVX2_TARGET inline __m256i dot(__m256i sum, __m256i input, const void *w) {
+    const __m256i weights =
+          _mm256_loadu_si256(reinterpret_cast<const __m256i *>(w));
+    return _mm256_add_epi32(
+          sum, _mm256_madd_epi16(_mm256_maddubs_epi16(input, weights),
+                                 _mm256_set1_epi16(1)));
+}
+
+// a clipped relu layer, four outputs at a time so the horizontal sums share
+// their adds
+template <int In, int Out>
+AVX2_TARGET inline void layer(const std::uint8_t *input,
+                              const std::int8_t (*weights)[In],
+                              const std::int32_t *bias, std::uint8_t *out) {
+    for (int o = 0; o < Out; o += 4) {
+        __m256i sum[4] = {_mm256_setzero_si256(), _mm256_setzero_si256(),
+                          _mm256_setzero_si256(), _mm256_setzero_si256()};
+
+        for (int i = 0; i < In; i += 32) {
+            const __m256i in =
+                  _mm256_load_si256(reinterpret_cast<const __m256i *>(input + i));
+            for (int k = 0; k < 4; k++)
+                sum[k] = dot(sum[k], in, weights[o + k] + i);
+        }
+
+        const __m256i quad =
+              _mm256_hadd_epi32(_mm256_hadd_epi32(sum[0], sum[1]),
+                                _mm256_hadd_epi32(sum[2], sum[3]));
+        __m128i x = _mm_add_epi32(_mm256_castsi256_si128(quad),
+                                  _mm256_extracti128_si256(quad, 1));
+        x = _mm_add_epi32(
+              x, _mm_loadu_si128(reinterpret_cast<const __m128i *>(bias + o)));
+        x = _mm_srai_epi32(x, NNUE_QB_SHIFT);
+        x = _mm_min_epi32(_mm_max_epi32(x, _mm_setzero_si128()),
+                          _mm_set1_epi32(NNUE_QA));
+
+        alignas(16) std::int32_t values[4];
+        _mm_store_si128(reinterpret_cast<__m128i *>(values), x);
+        for (int k = 0; k < 4; k++)
+            out[o + k] = values[k];
+    }
+}
+
+} // namespace
+
+AVX2_TARGET int NNUE::propagateAVX2(const Accumulator &acc, Color stm) const {
+    alignas(32) std::uint8_t input[2 * NNUE_HIDDEN];
+    alignas(32) std::uint8_t l2[NNUE_L2], l3[NNUE_L3];
+
+    // clipped relu, the side to move first. packus saturates at 0 and
+    // interleaves the lanes, the permute puts them back in order.
+    const __m256i max = _mm256_set1_epi8(NNUE_QA);
+    for (int side = 0; side < 2; side++) {
+        const std::int16_t *values = acc.values[side ? ~stm : stm];
+        for (int i = 0; i < NNUE_HIDDEN; i += 32) {
+            const __m256i a = _mm256_load_si256(
+                  reinterpret_cast<const __m256i *>(values + i));
+            const __m256i b = _mm256_load_si256(
+                  reinterpret_cast<const __m256i *>(values + i + 16));
+            const __m256i packed = _mm256_permute4x64_epi64(
+                  _mm256_packus_epi16(a, b), 0xd8);
+            _mm256_store_si256(
+                  reinterpret_cast<__m256i *>(input + side * NNUE_HIDDEN + i),
+                  _mm256_min_epu8(packed, max));
+        }
+    }
+
+    layer<2 * NNUE_HIDDEN, NNUE_L2>(input, net->l2Weights, net->l2Bias, l2);
+    layer<NNUE_L2, NNUE_L3>(l2, net->l3Weights, net->l3Bias, l3);
+
+    __m256i sum = dot(_mm256_setzero_si256(),
+                      _mm256_load_si256(reinterpret_cast<const __m256i *>(l3)),
+                      net->outWeights);
+    __m128i x = _mm_add_epi32(_mm256_castsi256_si128(sum),
+                              _mm256_extracti128_si256(sum, 1));
+    x = _mm_add_epi32(x, _mm_shuffle_epi32(x, 0x4e));
+    x = _mm_add_epi32(x, _mm_shuffle_epi32(x, 0xb1));
+    return net->outBias + _mm_cvtsi128_si32(x);
+}
+
+} // namespace Yayo
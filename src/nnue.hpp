@@ -0,0 +1,201 @@
+/*
+**    Yayo is a UCI chess engine written by am5083 (am@kvasm.us)
+**    Copyright (C) 2022 Ahmed Mohamed (am@kvasm.us)
+**
+**    This program is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**    This program is distributed in the hope that it will be useful,
+**    but WITHOUT ANY WARRANTY; without even the implied warranty of
+**    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**    GNU General Public License for more details.
+**
+**    You should have received a copy of the GNU General Public License
+**    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef NNUE_H_
+#define NNUE_H_
+#include "board.hpp"
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace Yayo {
+
+// HalfKA with king buckets: every piece on the board seen from each side's
+// king, mirrored so the king stays on files a-d
+#define NNUE_BUCKETS 4
+#define NNUE_INPUTS (NNUE_BUCKETS * 12 * 64)
+#define NNUE_HIDDEN 256
+#define NNUE_L2 32
+#define NNUE_L3 32
+// quantization: activations are 1.0 = QA, hidden weights 1.0 = QB, and a
+// network output of 1.0 is SCALE centipawns
+#define NNUE_QA 127
+#define NNUE_QB 64
+#define NNUE_QB_SHIFT 6
+#define NNUE_SCALE 400
+#define NNUE_MAGIC 0x31554E59
+
+static_assert(NNUE_HIDDEN % 32 == 0 && NNUE_L2 % 32 == 0 && NNUE_L3 == 32,
+              "the avx2 layers work on whole registers");
+
+// bucket by the oriented, mirrored king square, own back rank split in two
+constexpr int nnueKingBucket[64] = {
+    3, 3, 3, 3, 3, 3, 3, 3,
+    3, 3, 3, 3, 3, 3, 3, 3,
+    3, 3, 3, 3, 3, 3, 3, 3,
+    3, 3, 3, 3, 3, 3, 3, 3,
+    3, 3, 3, 3, 3, 3, 3, 3,
+    3, 3, 3, 3, 3, 3, 3, 3,
+    2, 2, 2, 2, 2, 2, 2, 2,
+    0, 0, 1, 1, 1, 1, 0, 0,
+};
+
+// the square as seen by persp, white's first rank at the bottom for both
+constexpr Square nnueOrient(Color persp, Square sq, Square ksq) {
+    const int flip = persp == WHITE ? 0 : 56;
+    const int mirror = FILE_OF(Square(ksq ^ flip)) >= 4 ? 7 : 0;
+    return Square(sq ^ flip ^ mirror);
+}
+
+constexpr int nnueFeature(Color persp, Square ksq, Piece pc, Square sq) {
+    const int bucket = nnueKingBucket[nnueOrient(persp, ksq, ksq)];
+    const int theirs = (pc >> 3) != persp;
+    return ((bucket * 12 + theirs * 6 + getPcType(pc) - 1) << 6) +
+           nnueOrient(persp, sq, ksq);
+}
+
+// a king move that changes the bucket or the mirroring starts over
+constexpr bool nnueNeedsRefresh(Color persp, Square from, Square to) {
+    return (FILE_OF(from) >= 4) != (FILE_OF(to) >= 4) ||
+           nnueKingBucket[nnueOrient(persp, from, from)] !=
+                 nnueKingBucket[nnueOrient(persp, to, to)];
+}
+
+// pieces a move added or removed, SQUARE_64 standing for neither
+struct DirtyPieces {
+    int num;
+    Piece pc[3];
+    Square from[3], to[3];
+    bool refresh[2];
+};
+
+// One per search ply. Filled lazily: make() only records what moved and the
+// values are brought up to date from the nearest computed ply when the
+// position is evaluated.
+struct alignas(32) Accumulator {
+    std::int16_t values[2][NNUE_HIDDEN];
+    bool computed[2];
+    DirtyPieces dirty;
+};
+
+struct Network {
+    alignas(32) std::int16_t ftBias[NNUE_HIDDEN];
+    alignas(32) std::int16_t ftWeights[NNUE_INPUTS][NNUE_HIDDEN];
+    std::int32_t l2Bias[NNUE_L2];
+    alignas(32) std::int8_t l2Weights[NNUE_L2][2 * NNUE_HIDDEN];
+    std::int32_t l3Bias[NNUE_L3];
+    alignas(32) std::int8_t l3Weights[NNUE_L3][NNUE_L2];
+    std::int32_t outBias;
+    alignas(32) std::int8_t outWeights[NNUE_L3];
+};
+
+struct NetworkHeader {
+    std::uint32_t magic;
+    std::uint32_t inputs, hidden, l2, l3;
+    std::uint32_t scale;
+};
+
+class NNUE {
+  public:
+    bool load(const std::string &path);
+    bool save(const std::string &path) const;
+    void unload() { net.reset(); }
+    bool loaded() const { return net != nullptr; }
+
+    // score for the side to move, through board.acc when the board has a
+    // stack and from scratch otherwise
+    int evaluate(const Board &board);
+
+    void refresh(const Board &board, Accumulator &acc, Color persp) const;
+    // the output layers on a computed accumulator
+    int propagate(const Accumulator &acc, Color stm) const;
+
+    std::unique_ptr<Network> net;
+    bool simd = false;
+
+  private:
+    void update(const Board &board, Color persp) const;
+    int propagateScalar(const Accumulator &acc, Color stm) const;
+    int propagateAVX2(const Accumulator &acc, Color stm) const;
+};
+
+extern NNUE nnue;
+
+// called by make() and makeNullMove() before the board changes
+inline void pushAccumulator(Board &board, unsigned short move) {
+    Accumulator *next = board.acc + 1;
+    DirtyPieces &dirty = next->dirty;
+    next->computed[WHITE] = next->computed[BLACK] = false;
+    dirty.refresh[WHITE] = dirty.refresh[BLACK] = false;
+    dirty.num = 0;
+    board.acc = next;
+
+    // null move
+    if (!move)
+        return;
+
+    const Square from = getFrom(move), to = getTo(move);
+    const Piece pc = board.board[from];
+    const Color us = board.turn;
+
+    auto add = [&](Piece p, Square f, Square t) {
+        dirty.pc[dirty.num] = p;
+        dirty.from[dirty.num] = f;
+        dirty.to[dirty.num++] = t;
+    };
+
+    switch (getCapture(move)) {
+    case EP_CAPTURE: {
+        const Square capSq = Square(us == WHITE ? to + 8 : to - 8);
+        add(board.board[capSq], capSq, SQUARE_64);
+        add(pc, from, to);
+    } break;
+    case K_CASTLE:
+    case Q_CASTLE: {
+        const bool king = getCapture(move) == K_CASTLE;
+        const Square rFrom = us == WHITE ? (king ? H1 : A1) : (king ? H8 : A8);
+        const Square rTo = us == WHITE ? (king ? F1 : D1) : (king ? F8 : D8);
+        add(pc, from, to);
+        add(board.board[rFrom], rFrom, rTo);
+    } break;
+    case CAPTURE:
+        add(board.board[to], to, SQUARE_64);
+        add(pc, from, to);
+        break;
+    case QUIET:
+    case DOUBLE_PAWN:
+        add(pc, from, to);
+        break;
+    default: {
+        // promotions, with or without a capture
+        const int promo = getCapture(move);
+        if (promo >= CP_KNIGHT)
+            add(board.board[to], to, SQUARE_64);
+        add(pc, from, SQUARE_64);
+        add(Piece(W_KNIGHT + ((promo - P_KNIGHT) & 3) + 8 * us), SQUARE_64,
+            to);
+    } break;
+    }
+
+    if (getPcType(pc) == KING)
+        dirty.refresh[us] = nnueNeedsRefresh(us, from, to);
+}
+
+} // namespace Yayo
+
+#endif // NNUE_H_
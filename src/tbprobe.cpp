@@ -0,0 +1,1120 @@
+/*
+**    Yayo is a UCI chess engine written by am5083 (am@kvasm.us)
+**    Copyright (C) 2022 Ahmed Mohamed (am@kvasm.us)
+**
+**    This program is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**    This program is distributed in the hope that it will be useful,
+**    but WITHOUT ANY WARRANTY; without even the implied warranty of
+**    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**    GNU General Public License for more details.
+**
+**    You should have received a copy of the GNU General Public License
+**    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Syzygy probing follows the layout of the reference tbprobe code by
+// Ronald de Man as adapted in Stockfish (GPLv3). Squares inside this file
+// use the tablebase convention A1 = 0 ... H8 = 63, which is the engine's
+// square index ^ 56.
+
+#include "tbprobe.hpp"
+#include "movegen.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <iostream>
+#include <mutex>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace Yayo {
+
+Tablebases tb;
+
+namespace {
+
+constexpr int TB_PIECES = 7;
+constexpr int MAX_DTZ = 1 << 18;
+
+enum TBType { TB_WDL, TB_DTZ };
+enum TBFlag {
+    TBF_STM = 1,
+    TBF_MAPPED = 2,
+    TBF_WIN_PLIES = 4,
+    TBF_LOSS_PLIES = 8,
+    TBF_WIDE = 16,
+    TBF_SINGLE_VALUE = 128,
+};
+
+int MapPawns[64];
+int MapB1H1H7[64];
+int MapA1D1D4[64];
+int MapKK[10][64];
+int Binomial[6][64];
+int LeadPawnIdx[6][64];
+int LeadPawnsSize[6][4];
+
+constexpr int fileOf(int s) { return s & 7; }
+constexpr int rankOf(int s) { return s >> 3; }
+constexpr int offA1H8(int s) { return rankOf(s) - fileOf(s); }
+constexpr int edgeDistance(int f) { return std::min(f, 7 - f); }
+
+bool pawnsComp(int i, int j) { return MapPawns[i] < MapPawns[j]; }
+
+constexpr bool isCapture(unsigned move) {
+    const int flag = getCapture((unsigned short)move);
+    return flag == CAPTURE || flag == EP_CAPTURE || flag >= CP_KNIGHT;
+}
+
+bool isZeroing(const Board &board, unsigned move) {
+    return isCapture(move) ||
+           getPcType(board.board[getFrom((unsigned short)move)]) == PAWN;
+}
+
+int dtzBeforeZeroing(WDLScore wdl) {
+    return wdl == WDL_WIN            ? 1
+           : wdl == WDL_CURSED_WIN   ? 101
+           : wdl == WDL_BLESSED_LOSS ? -101
+           : wdl == WDL_LOSS         ? -1
+                                     : 0;
+}
+
+template <typename T> int signOf(T val) { return (T(0) < val) - (val < T(0)); }
+
+// the files are little endian except for the huffman bitstream
+template <typename T> T readLE(const void *addr) {
+    T v;
+    std::memcpy(&v, addr, sizeof(T));
+    return v;
+}
+
+template <typename T> T readBE(const void *addr) {
+    T v = readLE<T>(addr);
+    if constexpr (sizeof(T) == 8)
+        return __builtin_bswap64(v);
+    else if constexpr (sizeof(T) == 4)
+        return __builtin_bswap32(v);
+    else
+        return __builtin_bswap16(v);
+}
+
+typedef std::uint16_t Sym;
+
+// sparse index entry: block number and offset inside it, little endian
+struct SparseEntry {
+    char block[4];
+    char offset[2];
+};
+static_assert(sizeof(SparseEntry) == 6);
+
+// pair of 12-bit child symbols of a recursive-pairing symbol
+struct LR {
+    std::uint8_t lr[3];
+
+    Sym left() const { return ((lr[1] & 0xF) << 8) | lr[0]; }
+    Sym right() const { return (lr[2] << 4) | (lr[1] >> 4); }
+};
+static_assert(sizeof(LR) == 3);
+
+struct PairsData {
+    std::uint8_t flags;
+    std::uint8_t maxSymLen;
+    std::uint8_t minSymLen;
+    std::uint32_t numBlocks;
+    std::size_t blockSize;
+    std::size_t span;
+    Sym *lowestSym;
+    LR *btree;
+    std::uint16_t *blockLength;
+    std::uint32_t blockLengthSize;
+    SparseEntry *sparseIndex;
+    std::size_t sparseIndexSize;
+    std::uint8_t *data;
+    std::vector<std::uint64_t> base64;
+    std::vector<std::uint8_t> symlen;
+    Piece pieces[TB_PIECES];
+    std::uint64_t groupIdx[TB_PIECES + 1];
+    int groupLen[TB_PIECES + 1];
+    std::uint16_t mapIdx[4];
+};
+
+struct TBTable {
+    TBType type;
+    std::atomic_bool ready{false};
+    void *baseAddress = nullptr;
+    std::uint64_t mapping = 0;
+    std::uint8_t *map = nullptr;
+    std::uint64_t key = 0, key2 = 0;
+    int pieceCount = 0;
+    bool hasPawns = false;
+    bool hasUniquePieces = false;
+    std::uint8_t pawnCount[2] = {0, 0}; // [lead color / other color]
+    PairsData items[2][4];              // [stm][file a..d or 0]
+
+    int sides() const { return type == TB_WDL ? 2 : 1; }
+    PairsData *get(int stm, int f) {
+        return &items[stm % sides()][hasPawns ? f : 0];
+    }
+
+    ~TBTable() {
+        if (baseAddress)
+            munmap(baseAddress, mapping);
+    }
+};
+
+std::string tbPaths;
+std::deque<TBTable> wdlTables, dtzTables;
+
+struct TableEntry {
+    std::uint64_t key;
+    TBTable *wdl, *dtz;
+};
+
+constexpr int TABLE_HASH_SIZE = 1 << 12;
+TableEntry tableHash[TABLE_HASH_SIZE + 1];
+
+void insertTable(std::uint64_t key, TBTable *wdl, TBTable *dtz) {
+    TableEntry entry{key, wdl, dtz};
+    std::uint32_t home = key & (TABLE_HASH_SIZE - 1);
+
+    // robin hood insertion, the last slot always stays empty
+    for (std::uint32_t bucket = home; bucket < TABLE_HASH_SIZE; bucket++) {
+        const std::uint64_t otherKey = tableHash[bucket].key;
+        if (otherKey == entry.key || !tableHash[bucket].wdl) {
+            tableHash[bucket] = entry;
+            return;
+        }
+
+        const std::uint32_t otherHome = otherKey & (TABLE_HASH_SIZE - 1);
+        if (otherHome > home) {
+            std::swap(entry, tableHash[bucket]);
+            home = otherHome;
+        }
+    }
+
+    std::cerr << "info string tablebase hash table full" << std::endl;
+}
+
+TBTable *findTable(std::uint64_t key, TBType type) {
+    for (const TableEntry *e = &tableHash[key & (TABLE_HASH_SIZE - 1)];;
+         e++) {
+        if (e->key == key || !e->wdl)
+            return type == TB_WDL ? e->wdl : e->dtz;
+    }
+}
+
+int openTable(const std::string &name) {
+    std::size_t start = 0;
+
+    while (start <= tbPaths.size()) {
+        std::size_t end = tbPaths.find(':', start);
+        if (end == std::string::npos)
+            end = tbPaths.size();
+
+        const std::string dir = tbPaths.substr(start, end - start);
+        if (!dir.empty()) {
+            const int fd = ::open((dir + "/" + name).c_str(), O_RDONLY);
+            if (fd != -1)
+                return fd;
+        }
+
+        start = end + 1;
+    }
+
+    return -1;
+}
+
+std::uint8_t *mapFile(const std::string &name, TBTable &e) {
+    const int fd = openTable(name);
+    if (fd == -1)
+        return nullptr;
+
+    struct stat st;
+    fstat(fd, &st);
+    if (st.st_size % 64 != 16) {
+        std::cerr << "info string corrupt tablebase " << name << std::endl;
+        ::close(fd);
+        return nullptr;
+    }
+
+    void *base = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (base == MAP_FAILED)
+        return nullptr;
+
+    madvise(base, st.st_size, MADV_RANDOM);
+
+    constexpr std::uint8_t magics[2][4] = {{0x71, 0xE8, 0x23, 0x5D},
+                                           {0xD7, 0x66, 0x0C, 0xA5}};
+    if (std::memcmp(base, magics[e.type], 4)) {
+        std::cerr << "info string corrupt tablebase " << name << std::endl;
+        munmap(base, st.st_size);
+        return nullptr;
+    }
+
+    e.baseAddress = base;
+    e.mapping = st.st_size;
+    return (std::uint8_t *)base + 4;
+}
+
+// Values are stored with canonical huffman codes over "recursive pairing"
+// symbols, in blocks of blockSize bytes. A sparse index points into the
+// blockLength table every span values; from there the block holding idx
+// is found, its symbols are decoded until the one covering idx, and that
+// symbol is expanded down the pair tree to the stored value.
+int decompressPairs(PairsData *d, std::uint64_t idx) {
+    if (d->flags & TBF_SINGLE_VALUE)
+        return d->minSymLen;
+
+    const std::uint32_t k = std::uint32_t(idx / d->span);
+
+    std::uint32_t block = readLE<std::uint32_t>(&d->sparseIndex[k].block);
+    int offset = readLE<std::uint16_t>(&d->sparseIndex[k].offset);
+    offset += int(idx % d->span) - int(d->span / 2);
+
+    while (offset < 0)
+        offset += d->blockLength[--block] + 1;
+
+    while (offset > d->blockLength[block])
+        offset -= d->blockLength[block++] + 1;
+
+    const std::uint32_t *ptr =
+          (const std::uint32_t *)(d->data + std::uint64_t(block) * d->blockSize);
+
+    std::uint64_t buf64 = readBE<std::uint64_t>(ptr);
+    ptr += 2;
+    int buf64Size = 64;
+    Sym sym;
+
+    while (true) {
+        int len = 0;
+
+        while (buf64 < d->base64[len])
+            len++;
+
+        sym = Sym((buf64 - d->base64[len]) >> (64 - len - d->minSymLen));
+        sym += readLE<Sym>(&d->lowestSym[len]);
+
+        if (offset < d->symlen[sym] + 1)
+            break;
+
+        offset -= d->symlen[sym] + 1;
+        len += d->minSymLen;
+        buf64 <<= len;
+        buf64Size -= len;
+
+        if (buf64Size <= 32) {
+            buf64Size += 32;
+            buf64 |= std::uint64_t(readBE<std::uint32_t>(ptr++))
+                     << (64 - buf64Size);
+        }
+    }
+
+    while (d->symlen[sym]) {
+        const Sym left = d->btree[sym].left();
+
+        if (offset < d->symlen[left] + 1)
+            sym = left;
+        else {
+            offset -= d->symlen[left] + 1;
+            sym = d->btree[sym].right();
+        }
+    }
+
+    return d->btree[sym].left();
+}
+
+// dtz values are remapped by frequency per wdl class and may be in moves
+int mapScore(TBTable *e, int f, int value, WDLScore wdl) {
+    if (e->type == TB_WDL)
+        return value - 2;
+
+    constexpr int wdlMap[] = {1, 3, 0, 2, 0};
+    PairsData *d = e->get(0, f);
+    const std::uint8_t flags = d->flags;
+
+    if (flags & TBF_MAPPED) {
+        if (flags & TBF_WIDE)
+            value = readLE<std::uint16_t>(
+                  (std::uint16_t *)e->map + d->mapIdx[wdlMap[wdl + 2]] + value);
+        else
+            value = e->map[d->mapIdx[wdlMap[wdl + 2]] + value];
+    }
+
+    if ((wdl == WDL_WIN && !(flags & TBF_WIN_PLIES)) ||
+        (wdl == WDL_LOSS && !(flags & TBF_LOSS_PLIES)) ||
+        wdl == WDL_CURSED_WIN || wdl == WDL_BLESSED_LOSS)
+        value *= 2;
+
+    return value + 1;
+}
+
+// Turn the position into the table index: pieces are grouped as the
+// generator grouped them, symmetry puts the leading piece into a1-d1-d4
+// (or the leading pawn onto files a-d), and each group of k like pieces
+// on sorted squares s1 < ... < sk is encoded as sum(Binomial[i][si]).
+int probeTable(const Board &board, TBTable *e, WDLScore wdl,
+               ProbeState *result) {
+    int squares[TB_PIECES];
+    Piece pieces[TB_PIECES];
+    std::uint64_t idx;
+    int next = 0, size = 0, leadPawnsCnt = 0;
+    Bitboard b, leadPawns = 0;
+    int tbFile = 0;
+
+    const Color turn = board.turn;
+    const bool symmetricBlackToMove = (e->key == e->key2 && turn == BLACK);
+    const bool blackStronger = (board.materialKey() != e->key);
+    const bool flip = symmetricBlackToMove || blackStronger;
+
+    const int flipColor = flip * 8;
+    const int flipSquares = flip * 56;
+    const int stm = flip ^ turn;
+
+    if (e->hasPawns) {
+        const Piece pc = Piece(e->get(0, 0)->pieces[0] ^ flipColor);
+        leadPawns = b = board.pieces(PAWN, Color(pc >> 3));
+
+        while (b) {
+            squares[size++] = (__builtin_ctzll(b) ^ 56) ^ flipSquares;
+            b &= b - 1;
+        }
+
+        leadPawnsCnt = size;
+        std::swap(squares[0], *std::max_element(squares, squares + size,
+                                                pawnsComp));
+        tbFile = edgeDistance(fileOf(squares[0]));
+    }
+
+    // dtz tables only store one side to move
+    if (e->type == TB_DTZ) {
+        const int flags = e->get(stm, tbFile)->flags;
+        if ((flags & TBF_STM) != stm && !(e->key == e->key2 && !e->hasPawns))
+            return *result = PROBE_CHANGE_STM, 0;
+    }
+
+    b = board.pieces() ^ leadPawns;
+    while (b) {
+        const int sq = __builtin_ctzll(b);
+        squares[size] = (sq ^ 56) ^ flipSquares;
+        pieces[size++] = Piece(board.board[sq] ^ flipColor);
+        b &= b - 1;
+    }
+
+    PairsData *d = e->get(stm, tbFile);
+
+    // put the pieces in the order the table was encoded with
+    for (int i = leadPawnsCnt; i < size - 1; i++) {
+        for (int j = i + 1; j < size; j++) {
+            if (d->pieces[i] == pieces[j]) {
+                std::swap(pieces[i], pieces[j]);
+                std::swap(squares[i], squares[j]);
+                break;
+            }
+        }
+    }
+
+    if (fileOf(squares[0]) > 3)
+        for (int i = 0; i < size; i++)
+            squares[i] ^= 7;
+
+    if (e->hasPawns) {
+        idx = LeadPawnIdx[leadPawnsCnt][squares[0]];
+
+        std::stable_sort(squares + 1, squares + leadPawnsCnt, pawnsComp);
+        for (int i = 1; i < leadPawnsCnt; i++)
+            idx += Binomial[i][MapPawns[squares[i]]];
+    } else {
+        if (rankOf(squares[0]) > 3)
+            for (int i = 0; i < size; i++)
+                squares[i] ^= 56;
+
+        // the first leading piece off the a1-h8 diagonal goes below it
+        for (int i = 0; i < d->groupLen[0]; i++) {
+            if (!offA1H8(squares[i]))
+                continue;
+
+            if (offA1H8(squares[i]) > 0)
+                for (int j = i; j < size; j++)
+                    squares[j] = ((squares[j] >> 3) | (squares[j] << 3)) & 63;
+            break;
+        }
+
+        if (e->hasUniquePieces) {
+            const int adjust1 = (squares[1] > squares[0]);
+            const int adjust2 =
+                  (squares[2] > squares[0]) + (squares[2] > squares[1]);
+
+            if (offA1H8(squares[0]))
+                idx = (MapA1D1D4[squares[0]] * 63 + (squares[1] - adjust1)) *
+                            62 +
+                      squares[2] - adjust2;
+            else if (offA1H8(squares[1]))
+                idx = (6 * 63 + rankOf(squares[0]) * 28 +
+                       MapB1H1H7[squares[1]]) *
+                            62 +
+                      squares[2] - adjust2;
+            else if (offA1H8(squares[2]))
+                idx = 6 * 63 * 62 + 4 * 28 * 62 + rankOf(squares[0]) * 7 * 28 +
+                      (rankOf(squares[1]) - adjust1) * 28 +
+                      MapB1H1H7[squares[2]];
+            else
+                idx = 6 * 63 * 62 + 4 * 28 * 62 + 4 * 7 * 28 +
+                      rankOf(squares[0]) * 7 * 6 +
+                      (rankOf(squares[1]) - adjust1) * 6 +
+                      (rankOf(squares[2]) - adjust2);
+        } else {
+            idx = MapKK[MapA1D1D4[squares[0]]][squares[1]];
+        }
+    }
+
+    idx *= d->groupIdx[0];
+    int *groupSq = squares + d->groupLen[0];
+
+    bool remainingPawns = e->hasPawns && e->pawnCount[1];
+
+    while (d->groupLen[++next]) {
+        std::stable_sort(groupSq, groupSq + d->groupLen[next]);
+        std::uint64_t n = 0;
+
+        // skip the squares taken by earlier groups
+        for (int i = 0; i < d->groupLen[next]; i++) {
+            const auto adjust =
+                  std::count_if(squares, groupSq,
+                                [&](int s) { return groupSq[i] > s; });
+            n += Binomial[i + 1][groupSq[i] - adjust - 8 * remainingPawns];
+        }
+
+        remainingPawns = false;
+        idx += n * d->groupIdx[next];
+        groupSq += d->groupLen[next];
+    }
+
+    return mapScore(e, tbFile, decompressPairs(d, idx), wdl);
+}
+
+void setGroups(TBTable &e, PairsData *d, const int order[2], int f) {
+    int n = 0, firstLen = e.hasPawns ? 0 : e.hasUniquePieces ? 3 : 2;
+    d->groupLen[n] = 1;
+
+    for (int i = 1; i < e.pieceCount; i++) {
+        if (--firstLen > 0 || d->pieces[i] == d->pieces[i - 1])
+            d->groupLen[n]++;
+        else
+            d->groupLen[++n] = 1;
+    }
+
+    d->groupLen[++n] = 0;
+
+    const bool pp = e.hasPawns && e.pawnCount[1];
+    int nextGroup = pp ? 2 : 1;
+    int freeSquares = 64 - d->groupLen[0] - (pp ? d->groupLen[1] : 0);
+    std::uint64_t idx = 1;
+
+    for (int k = 0; nextGroup < n || k == order[0] || k == order[1]; k++) {
+        if (k == order[0]) {
+            d->groupIdx[0] = idx;
+            idx *= e.hasPawns           ? LeadPawnsSize[d->groupLen[0]][f]
+                   : e.hasUniquePieces ? 31332
+                                       : 462;
+        } else if (k == order[1]) {
+            d->groupIdx[1] = idx;
+            idx *= Binomial[d->groupLen[1]][48 - d->groupLen[0]];
+        } else {
+            d->groupIdx[nextGroup] = idx;
+            idx *= Binomial[d->groupLen[nextGroup]][freeSquares];
+            freeSquares -= d->groupLen[nextGroup++];
+        }
+    }
+
+    d->groupIdx[n] = idx;
+}
+
+std::uint8_t setSymlen(PairsData *d, Sym s, std::vector<bool> &visited) {
+    visited[s] = true;
+    const Sym sr = d->btree[s].right();
+
+    if (sr == 0xFFF)
+        return 0;
+
+    const Sym sl = d->btree[s].left();
+
+    if (!visited[sl])
+        d->symlen[sl] = setSymlen(d, sl, visited);
+    if (!visited[sr])
+        d->symlen[sr] = setSymlen(d, sr, visited);
+
+    return d->symlen[sl] + d->symlen[sr] + 1;
+}
+
+std::uint8_t *setSizes(PairsData *d, std::uint8_t *data) {
+    d->flags = *data++;
+
+    if (d->flags & TBF_SINGLE_VALUE) {
+        d->numBlocks = d->blockLengthSize = 0;
+        d->span = d->sparseIndexSize = 0;
+        d->minSymLen = *data++; // the single stored value
+        return data;
+    }
+
+    const std::uint64_t tbSize =
+          d->groupIdx[std::find(d->groupLen, d->groupLen + TB_PIECES, 0) -
+                      d->groupLen];
+
+    d->blockSize = 1ULL << *data++;
+    d->span = 1ULL << *data++;
+    d->sparseIndexSize = std::size_t((tbSize + d->span - 1) / d->span);
+    const int padding = *data++;
+    d->numBlocks = readLE<std::uint32_t>(data);
+    data += sizeof(std::uint32_t);
+    d->blockLengthSize = d->numBlocks + padding;
+    d->maxSymLen = *data++;
+    d->minSymLen = *data++;
+    d->lowestSym = (Sym *)data;
+    d->base64.resize(d->maxSymLen - d->minSymLen + 1);
+
+    // canonical huffman: longer codes have lower values, base64[l] is the
+    // lowest code of length minSymLen + l left-aligned to 64 bits
+    for (int i = int(d->base64.size()) - 2; i >= 0; i--) {
+        d->base64[i] = (d->base64[i + 1] + readLE<Sym>(&d->lowestSym[i]) -
+                        readLE<Sym>(&d->lowestSym[i + 1])) /
+                       2;
+    }
+
+    for (std::size_t i = 0; i < d->base64.size(); i++)
+        d->base64[i] <<= 64 - i - d->minSymLen;
+
+    data += d->base64.size() * sizeof(Sym);
+    d->symlen.resize(readLE<std::uint16_t>(data));
+    data += sizeof(std::uint16_t);
+    d->btree = (LR *)data;
+
+    std::vector<bool> visited(d->symlen.size());
+    for (std::size_t sym = 0; sym < d->symlen.size(); sym++) {
+        if (!visited[sym])
+            d->symlen[sym] = setSymlen(d, Sym(sym), visited);
+    }
+
+    return data + d->symlen.size() * sizeof(LR) + (d->symlen.size() & 1);
+}
+
+std::uint8_t *setDtzMap(TBTable &e, std::uint8_t *data, int maxFile) {
+    if (e.type == TB_WDL)
+        return data;
+
+    e.map = data;
+
+    for (int f = 0; f <= maxFile; f++) {
+        PairsData *d = e.get(0, f);
+        if (!(d->flags & TBF_MAPPED))
+            continue;
+
+        if (d->flags & TBF_WIDE) {
+            data += std::uintptr_t(data) & 1;
+            for (int i = 0; i < 4; i++) {
+                d->mapIdx[i] = std::uint16_t(
+                      (std::uint16_t *)data - (std::uint16_t *)e.map + 1);
+                data += 2 * readLE<std::uint16_t>(data) + 2;
+            }
+        } else {
+            for (int i = 0; i < 4; i++) {
+                d->mapIdx[i] = std::uint16_t(data - e.map + 1);
+                data += *data + 1;
+            }
+        }
+    }
+
+    return data + (std::uintptr_t(data) & 1);
+}
+
+void setup(TBTable &e, std::uint8_t *data) {
+    data++; // split / has pawns flags, already known from the material
+
+    const int sides = e.sides() == 2 && (e.key != e.key2) ? 2 : 1;
+    const int maxFile = e.hasPawns ? 3 : 0;
+    const bool pp = e.hasPawns && e.pawnCount[1];
+
+    for (int f = 0; f <= maxFile; f++) {
+        for (int i = 0; i < sides; i++)
+            *e.get(i, f) = PairsData();
+
+        const int order[2][2] = {{*data & 0xF, pp ? *(data + 1) & 0xF : 0xF},
+                                 {*data >> 4, pp ? *(data + 1) >> 4 : 0xF}};
+        data += 1 + pp;
+
+        for (int k = 0; k < e.pieceCount; k++, data++) {
+            for (int i = 0; i < sides; i++)
+                e.get(i, f)->pieces[k] = Piece(i ? *data >> 4 : *data & 0xF);
+        }
+
+        for (int i = 0; i < sides; i++)
+            setGroups(e, e.get(i, f), order[i], f);
+    }
+
+    data += std::uintptr_t(data) & 1;
+
+    for (int f = 0; f <= maxFile; f++)
+        for (int i = 0; i < sides; i++)
+            data = setSizes(e.get(i, f), data);
+
+    data = setDtzMap(e, data, maxFile);
+
+    for (int f = 0; f <= maxFile; f++) {
+        for (int i = 0; i < sides; i++) {
+            PairsData *d = e.get(i, f);
+            d->sparseIndex = (SparseEntry *)data;
+            data += d->sparseIndexSize * sizeof(SparseEntry);
+        }
+    }
+
+    for (int f = 0; f <= maxFile; f++) {
+        for (int i = 0; i < sides; i++) {
+            PairsData *d = e.get(i, f);
+            d->blockLength = (std::uint16_t *)data;
+            data += d->blockLengthSize * sizeof(std::uint16_t);
+        }
+    }
+
+    for (int f = 0; f <= maxFile; f++) {
+        for (int i = 0; i < sides; i++) {
+            data = (std::uint8_t *)((std::uintptr_t(data) + 0x3F) & ~0x3F);
+            PairsData *d = e.get(i, f);
+            d->data = data;
+            data += d->numBlocks * d->blockSize;
+        }
+    }
+}
+
+// file name of the table for the board's material, stronger side first
+std::string tableName(const Board &board, const TBTable &e) {
+    std::string w, bl;
+    constexpr char pieceChars[] = " PNBRQK";
+
+    for (int pt = KING; pt >= PAWN; pt--) {
+        w += std::string(popcount(board.pieces(PieceT(pt), WHITE)),
+                         pieceChars[pt]);
+        bl += std::string(popcount(board.pieces(PieceT(pt), BLACK)),
+                          pieceChars[pt]);
+    }
+
+    return (e.key == board.materialKey() ? w + 'v' + bl : bl + 'v' + w) +
+           (e.type == TB_WDL ? ".rtbw" : ".rtbz");
+}
+
+bool mapped(TBTable &e, const Board &board) {
+    static std::mutex mutex;
+
+    if (e.ready.load(std::memory_order_acquire))
+        return e.baseAddress;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (e.ready.load(std::memory_order_relaxed))
+        return e.baseAddress;
+
+    if (std::uint8_t *data = mapFile(tableName(board, e), e))
+        setup(e, data);
+
+    e.ready.store(true, std::memory_order_release);
+    return e.baseAddress;
+}
+
+int probe(const Board &board, TBType type, ProbeState *result,
+          WDLScore wdl = WDL_DRAW) {
+    if (popcount(board.pieces()) == 2)
+        return type == TB_WDL ? WDL_DRAW : 0;
+
+    TBTable *e = findTable(board.materialKey(), type);
+    if (!e || !mapped(*e, board))
+        return *result = PROBE_FAIL, 0;
+
+    return probeTable(board, e, wdl, result);
+}
+
+// Captures (and for dtz, pawn moves) have to be searched: the tables may
+// store a "don't care" value where a zeroing move wins, and never know
+// about en passant.
+template <bool CheckZeroingMoves>
+WDLScore search(Board &board, ProbeState *result) {
+    WDLScore value, bestValue = WDL_LOSS;
+
+    moveList mList = {{{0}}};
+    generate(board, &mList);
+    int moveCount = 0;
+
+    for (int i = 0; i < mList.nMoves; i++) {
+        const unsigned move = mList.moves[i].move;
+        if (!isCapture(move) &&
+            (!CheckZeroingMoves ||
+             getPcType(board.board[getFrom((unsigned short)move)]) != PAWN))
+            continue;
+
+        moveCount++;
+
+        make(board, move);
+        value = WDLScore(-search<false>(board, result));
+        unmake(board, move);
+
+        if (*result == PROBE_FAIL)
+            return WDL_DRAW;
+
+        if (value > bestValue) {
+            bestValue = value;
+            if (value >= WDL_WIN) {
+                *result = PROBE_ZEROING;
+                return value;
+            }
+        }
+    }
+
+    const bool noMoreMoves = (moveCount && moveCount == mList.nMoves);
+
+    if (noMoreMoves)
+        value = bestValue;
+    else {
+        value = WDLScore(probe(board, TB_WDL, result));
+        if (*result == PROBE_FAIL)
+            return WDL_DRAW;
+    }
+
+    if (bestValue >= value) {
+        *result = (bestValue > WDL_DRAW || noMoreMoves) ? PROBE_ZEROING
+                                                         : PROBE_OK;
+        return bestValue;
+    }
+
+    *result = PROBE_OK;
+    return value;
+}
+
+void addTable(const std::vector<PieceT> &pcs, int &maxPieces) {
+    constexpr char pieceChars[] = " PNBRQK";
+    std::string code;
+
+    for (PieceT pt : pcs)
+        code += pieceChars[pt];
+
+    const std::size_t split = code.find('K', 1);
+    const std::string name =
+          code.substr(0, split) + "v" + code.substr(split) + ".rtbw";
+
+    const int fd = openTable(name);
+    if (fd == -1)
+        return;
+    ::close(fd);
+
+    int counts[2][PT_MAX] = {};
+    for (std::size_t i = 0; i < pcs.size(); i++)
+        counts[i >= split][pcs[i]]++;
+
+    TBTable &wdl = wdlTables.emplace_back();
+    wdl.type = TB_WDL;
+    wdl.key = materialKeyOf(counts);
+    std::swap(counts[WHITE], counts[BLACK]);
+    wdl.key2 = materialKeyOf(counts);
+    std::swap(counts[WHITE], counts[BLACK]);
+
+    wdl.pieceCount = pcs.size();
+    wdl.hasPawns = counts[WHITE][PAWN] || counts[BLACK][PAWN];
+
+    for (int c = WHITE; c <= BLACK; c++)
+        for (int pt = PAWN; pt < KING; pt++)
+            wdl.hasUniquePieces |= counts[c][pt] == 1;
+
+    // the side with fewer pawns leads, it compresses better
+    const int wp = counts[WHITE][PAWN], bp = counts[BLACK][PAWN];
+    const bool whiteLeads = !bp || (wp && bp >= wp);
+    wdl.pawnCount[0] = whiteLeads ? wp : bp;
+    wdl.pawnCount[1] = whiteLeads ? bp : wp;
+
+    TBTable &dtz = dtzTables.emplace_back();
+    dtz.type = TB_DTZ;
+    dtz.key = wdl.key;
+    dtz.key2 = wdl.key2;
+    dtz.pieceCount = wdl.pieceCount;
+    dtz.hasPawns = wdl.hasPawns;
+    dtz.hasUniquePieces = wdl.hasUniquePieces;
+    dtz.pawnCount[0] = wdl.pawnCount[0];
+    dtz.pawnCount[1] = wdl.pawnCount[1];
+
+    maxPieces = std::max(maxPieces, int(pcs.size()));
+
+    insertTable(wdl.key, &wdl, &dtz);
+    insertTable(wdl.key2, &wdl, &dtz);
+}
+
+void initIndexTables() {
+    int code = 0;
+    for (int s = 0; s < 64; s++)
+        if (offA1H8(s) < 0)
+            MapB1H1H7[s] = code++;
+
+    // a1-d1-d4 triangle, the diagonal squares last
+    std::vector<int> diagonal;
+    code = 0;
+    for (int r = 0; r < 4; r++) {
+        for (int f = 0; f < 4; f++) {
+            const int s = r * 8 + f;
+            if (offA1H8(s) < 0)
+                MapA1D1D4[s] = code++;
+            else if (!offA1H8(s))
+                diagonal.push_back(s);
+        }
+    }
+
+    for (int s : diagonal)
+        MapA1D1D4[s] = code++;
+
+    // the 462 legal king pairs with the first king in the triangle
+    std::vector<std::pair<int, int>> bothOnDiagonal;
+    code = 0;
+    for (int idx = 0; idx < 10; idx++) {
+        for (int s1 = 0; s1 <= 27; s1++) {
+            if (MapA1D1D4[s1] != idx || (!idx && s1 != 1))
+                continue;
+
+            for (int s2 = 0; s2 < 64; s2++) {
+                const bool touching =
+                      std::abs(fileOf(s1) - fileOf(s2)) <= 1 &&
+                      std::abs(rankOf(s1) - rankOf(s2)) <= 1;
+
+                if (touching)
+                    continue;
+                else if (!offA1H8(s1) && offA1H8(s2) > 0)
+                    continue;
+                else if (!offA1H8(s1) && !offA1H8(s2))
+                    bothOnDiagonal.emplace_back(idx, s2);
+                else
+                    MapKK[idx][s2] = code++;
+            }
+        }
+    }
+
+    for (auto [idx, s2] : bothOnDiagonal)
+        MapKK[idx][s2] = code++;
+
+    Binomial[0][0] = 1;
+    for (int n = 1; n < 64; n++)
+        for (int k = 0; k < 6 && k <= n; k++)
+            Binomial[k][n] = (k > 0 ? Binomial[k - 1][n - 1] : 0) +
+                             (k < n ? Binomial[k][n - 1] : 0);
+
+    int availableSquares = 47;
+    for (int leadPawnsCnt = 1; leadPawnsCnt <= 5; leadPawnsCnt++) {
+        for (int f = 0; f < 4; f++) {
+            int idx = 0;
+
+            for (int r = 1; r <= 6; r++) {
+                const int sq = r * 8 + f;
+
+                if (leadPawnsCnt == 1) {
+                    MapPawns[sq] = availableSquares--;
+                    MapPawns[sq ^ 7] = availableSquares--;
+                }
+
+                LeadPawnIdx[leadPawnsCnt][sq] = idx;
+                idx += Binomial[leadPawnsCnt - 1][MapPawns[sq]];
+            }
+
+            LeadPawnsSize[leadPawnsCnt][f] = idx;
+        }
+    }
+}
+
+} // namespace
+
+void Tablebases::init(const std::string &paths) {
+    std::memset(tableHash, 0, sizeof(tableHash));
+    wdlTables.clear();
+    dtzTables.clear();
+    maxPieces = 0;
+    tbPaths = paths;
+
+    if (paths.empty() || paths == "<empty>")
+        return;
+
+    static bool indexed = false;
+    if (!indexed) {
+        initIndexTables();
+        indexed = true;
+    }
+
+    for (int p1 = PAWN; p1 < KING; p1++) {
+        const PieceT a = PieceT(p1);
+        addTable({KING, a, KING}, maxPieces);
+
+        for (int p2 = PAWN; p2 <= p1; p2++) {
+            const PieceT b = PieceT(p2);
+            addTable({KING, a, b, KING}, maxPieces);
+            addTable({KING, a, KING, b}, maxPieces);
+
+            for (int p3 = PAWN; p3 < KING; p3++)
+                addTable({KING, a, b, KING, PieceT(p3)}, maxPieces);
+
+            for (int p3 = PAWN; p3 <= p2; p3++) {
+                const PieceT c = PieceT(p3);
+                addTable({KING, a, b, c, KING}, maxPieces);
+
+                for (int p4 = PAWN; p4 <= p3; p4++) {
+                    const PieceT d = PieceT(p4);
+                    addTable({KING, a, b, c, d, KING}, maxPieces);
+
+                    for (int p5 = PAWN; p5 <= p4; p5++)
+                        addTable({KING, a, b, c, d, PieceT(p5), KING},
+                                 maxPieces);
+                    for (int p5 = PAWN; p5 < KING; p5++)
+                        addTable({KING, a, b, c, d, KING, PieceT(p5)},
+                                 maxPieces);
+                }
+
+                for (int p4 = PAWN; p4 < KING; p4++) {
+                    const PieceT d = PieceT(p4);
+                    addTable({KING, a, b, c, KING, d}, maxPieces);
+
+                    for (int p5 = PAWN; p5 <= p4; p5++)
+                        addTable({KING, a, b, c, KING, d, PieceT(p5)},
+                                 maxPieces);
+                }
+            }
+
+            for (int p3 = PAWN; p3 <= p1; p3++)
+                for (int p4 = PAWN; p4 <= (p1 == p3 ? p2 : p3); p4++)
+                    addTable({KING, a, b, KING, PieceT(p3), PieceT(p4)},
+                             maxPieces);
+        }
+    }
+
+    std::cout << "info string found " << wdlTables.size()
+              << " tablebases, up to " << maxPieces << " pieces" << std::endl;
+}
+
+WDLScore Tablebases::probeWDL(Board &board, ProbeState *result) {
+    *result = PROBE_OK;
+    return search<false>(board, result);
+}
+
+// plies to the next zeroing move with optimal play, signed by the outcome
+int Tablebases::probeDTZ(Board &board, ProbeState *result) {
+    *result = PROBE_OK;
+    const WDLScore wdl = search<true>(board, result);
+
+    if (*result == PROBE_FAIL || wdl == WDL_DRAW)
+        return 0;
+
+    if (*result == PROBE_ZEROING)
+        return dtzBeforeZeroing(wdl);
+
+    int dtz = probe(board, TB_DTZ, result, wdl);
+
+    if (*result == PROBE_FAIL)
+        return 0;
+
+    if (*result != PROBE_CHANGE_STM)
+        return (dtz + 100 * (wdl == WDL_BLESSED_LOSS || wdl == WDL_CURSED_WIN)) *
+               signOf(wdl);
+
+    // the table is stored for the other side: take the best reply by dtz
+    int minDTZ = 0xFFFF;
+    moveList mList = {{{0}}};
+    generate(board, &mList);
+
+    for (int i = 0; i < mList.nMoves; i++) {
+        const unsigned move = mList.moves[i].move;
+        const bool zeroing = isZeroing(board, move);
+
+        make(board, move);
+
+        dtz = zeroing ? -dtzBeforeZeroing(search<false>(board, result))
+                      : -probeDTZ(board, result);
+
+        if (dtz == 1 && board.checkPcs) {
+            moveList replies = {{{0}}};
+            generate(board, &replies);
+            if (!replies.nMoves)
+                minDTZ = 1;
+        }
+
+        if (!zeroing)
+            dtz += signOf(dtz);
+
+        if (dtz < minDTZ && signOf(dtz) == signOf(wdl))
+            minDTZ = dtz;
+
+        unmake(board, move);
+
+        if (*result == PROBE_FAIL)
+            return 0;
+    }
+
+    return minDTZ == 0xFFFF ? -1 : minDTZ;
+}
+
+bool Tablebases::rootMoves(Board &board, std::vector<unsigned> &moves) {
+    ProbeState result = PROBE_OK;
+    const int cnt50 = board.halfMoves;
+    const bool rep = board.isRepetition();
+
+    moveList mList = {{{0}}};
+    generate(board, &mList);
+
+    std::vector<std::pair<int, unsigned>> ranked;
+
+    for (int i = 0; i < mList.nMoves; i++) {
+        const unsigned move = mList.moves[i].move;
+        int dtz;
+
+        make(board, move);
+
+        if (board.halfMoves == 0) {
+            dtz = dtzBeforeZeroing(WDLScore(-probeWDL(board, &result)));
+        } else if (board.halfMoves >= 100 || board.isTMR()) {
+            dtz = 0;
+        } else {
+            dtz = -probeDTZ(board, &result);
+            dtz = dtz > 0 ? dtz + 1 : dtz < 0 ? dtz - 1 : dtz;
+        }
+
+        if (board.checkPcs && dtz == 2) {
+            moveList replies = {{{0}}};
+            generate(board, &replies);
+            if (!replies.nMoves)
+                dtz = 1;
+        }
+
+        unmake(board, move);
+
+        if (result == PROBE_FAIL)
+            return false;
+
+        // wins that beat the 50-move rule rank highest, faster ones first;
+        // losses are all equal unless the 50-move rule can still save them
+        const int rank =
+              dtz > 0   ? (dtz + cnt50 <= 99 && !rep ? MAX_DTZ - dtz
+                                                     : MAX_DTZ / 2 - (dtz + cnt50))
+              : dtz < 0 ? (-dtz * 2 + cnt50 < 100 ? -MAX_DTZ - dtz
+                                                  : -MAX_DTZ / 2 + (-dtz + cnt50))
+                        : 0;
+
+        ranked.emplace_back(rank, move);
+    }
+
+    if (ranked.empty())
+        return false;
+
+    const int best = std::max_element(ranked.begin(), ranked.end())->first;
+
+    moves.clear();
+    for (auto [rank, move] : ranked)
+        if (rank == best)
+            moves.push_back(move);
+
+    return true;
+}
+
+} // namespace Yayo
@@ -0,0 +1,70 @@
+/*
+**    Yayo is a UCI chess engine written by am5083 (am@kvasm.us)
+**    Copyright (C) 2022 Ahmed Mohamed (am@kvasm.us)
+**
+**    This program is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**    This program is distributed in the hope that it will be useful,
+**    but WITHOUT ANY WARRANTY; without even the implied warranty of
+**    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**    GNU General Public License for more details.
+**
+**    You should have received a copy of the GNU General Public License
+**    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TBPROBE_H_
+#define TBPROBE_H_
+#include "board.hpp"
+#include "util.hpp"
+#include <string>
+#include <vector>
+
+namespace Yayo {
+
+// scores for tablebase wins stay below the mate range
+constexpr int TB_WIN = CHECKMATE - MAX_PLY - 1;
+
+// cursed wins and blessed losses are draws under the 50-move rule
+enum WDLScore {
+    WDL_LOSS = -2,
+    WDL_BLESSED_LOSS = -1,
+    WDL_DRAW = 0,
+    WDL_CURSED_WIN = 1,
+    WDL_WIN = 2,
+};
+
+enum ProbeState {
+    PROBE_FAIL = 0,
+    PROBE_OK = 1,
+    PROBE_CHANGE_STM = -1, // dtz is stored for the other side to move
+    PROBE_ZEROING = 2,     // best move zeroes the 50-move counter
+};
+
+// Syzygy WDL/DTZ tables. Files are found at init and memory mapped the
+// first time a position with that material is probed.
+class Tablebases {
+  public:
+    // paths is a ':'-separated list of directories, empty disables probing
+    void init(const std::string &paths);
+    int largest() const { return maxPieces; }
+
+    WDLScore probeWDL(Board &board, ProbeState *result);
+    int probeDTZ(Board &board, ProbeState *result);
+
+    // keeps the root moves that preserve the best dtz-ranked outcome,
+    // returns false if a table is missing
+    bool rootMoves(Board &board, std::vector<unsigned> &moves);
+
+  private:
+    int maxPieces = 0;
+};
+
+extern Tablebases tb;
+
+} // namespace Yayo
+
+#endif // TBPROBE_H_
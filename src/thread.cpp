@@ -17,6 +17,7 @@
 */
 #include "thread.hpp"
 #include "eval.hpp"
+#include <algorithm>
 #include <cassert>
 #include <stdio.h>
 #include <vector>
@@ -34,17 +35,36 @@ void Search::startSearch(Info *_info) {
     info->uciStop = false;
     info->uciQuit = false;
     numRep = 0;
+    cmSearched = 0;
+    cmCutoffs = 0;
+    pcSearched = 0;
+    pcCutoffs = 0;
+    tbHits = 0;
 
     memset(&historyMoves, 0, sizeof(historyMoves));
-    memset(&killerMoves, NO_MOVE, sizeof(killerMoves));
-    memset(&killerMates, NO_MOVE, sizeof(killerMates));
-    memset(&pvTableLen, NO_MOVE, sizeof(pvTableLen));
-    memset(&pvTable, NO_MOVE, sizeof(pvTable));
-    memset(&Hist, 0, sizeof(Hist));
+    clearStack();
 
     searchThread = std::make_unique<std::thread>(&Search::search, this);
 }
 
+unsigned Search::searchNow(Info *_info, int &score) {
+    info = _info;
+    nodes = 0;
+    stopCount = 0;
+    stopFlag = 0;
+    info->uciStop = false;
+    info->uciQuit = false;
+    numRep = 0;
+    tbHits = 0;
+
+    memset(&historyMoves, 0, sizeof(historyMoves));
+    clearStack();
+
+    search();
+    score = lastScore;
+    return lastBestMove;
+}
+
 const bool Search::checkForStop() const {
     stopCount++;
     stopCount &= 1023;
@@ -54,7 +74,8 @@ const bool Search::checkForStop() const {
     }
 
     if (!stopCount) {
-        if (info->stopTime <= get_time() && info->timeGiven) {
+        if ((info->stopTime <= get_time() && info->timeGiven) ||
+            (info->nodeLimit && nodes >= info->nodeLimit)) {
             stopFlag = 1;
             info->uciStop = true;
         }
@@ -63,6 +84,128 @@ const bool Search::checkForStop() const {
     return false;
 }
 
+void Search::clearStack() {
+    for (int ply = 0; ply <= stackHigh; ply++) {
+        SearchStack &s = ss[ply];
+        s.move = NO_MOVE;
+        s.eval = 0;
+        s.piece = NO_PC;
+        s.excluded = NO_MOVE;
+        s.killers[0] = s.killers[1] = NO_MOVE;
+        s.mateKillers[0] = s.mateKillers[1] = NO_MOVE;
+        s.contHist = nullptr;
+        s.pv[0] = NO_MOVE;
+        s.pvLen = 0;
+    }
+
+    stackHigh = 0;
+}
+
+PieceToHistory *Search::contHistAt(int ply, int back) {
+    return ply < back ? nullptr : ss[ply - back].contHist;
+}
+
+unsigned Search::counterMove(int ply) const {
+    if (ply < 1 || !ss[ply - 1].move)
+        return NO_MOVE;
+
+    const SearchStack &prev = ss[ply - 1];
+    return counterMoves[prev.piece][getTo(prev.move)];
+}
+
+int Search::quietHistory(unsigned move, Piece pc) {
+    const int ply = _board.ply;
+    const Square to = getTo(move);
+    int score = 0;
+
+    for (int back : {1, 2}) {
+        if (PieceToHistory *ch = contHistAt(ply, back))
+            score += (*ch)[pc][to];
+    }
+
+    return score;
+}
+
+PieceT Search::capturedType(unsigned move) {
+    if (getCapture(move) == EP_CAPTURE)
+        return PAWN;
+
+    const Piece victim = _board.board[getTo(move)];
+    return victim == NO_PC ? NONE : getPcType(victim);
+}
+
+int Search::captureHist(unsigned move, Piece pc) {
+    return captureHistory[pc][getTo(move)][capturedType(move)];
+}
+
+void Search::updateQuietHistories(unsigned move, Piece pc, int bonus) {
+    const int ply = _board.ply;
+    const Square to = getTo(move);
+
+    for (int back : {1, 2}) {
+        if (PieceToHistory *ch = contHistAt(ply, back))
+            updateHistory((*ch)[pc][to], bonus);
+    }
+}
+
+void Search::updateCaptureHistory(unsigned move, Piece pc, int bonus) {
+    updateHistory(captureHistory[pc][getTo(move)][capturedType(move)], bonus);
+}
+
+int Search::correctEval(int rawEval) {
+    const int pawnIdx = _board.pawnKey() % CORR_SIZE;
+    const int matIdx = _board.materialKey() % CORR_SIZE;
+    const int correction = pawnCorrHist[_board.turn][pawnIdx] +
+                           materialCorrHist[_board.turn][matIdx];
+
+    return std::clamp(rawEval + correction / CORR_GRAIN, -CHECKMATE + 1,
+                      CHECKMATE - 1);
+}
+
+int Search::evaluate(Eval<> &eval) {
+    if (!_board.acc)
+        return eval.eval();
+
+    // the network gets the same known-ending adjustment as the classical eval
+    int known = 0;
+    if (popcount(_board.pieces()) <= BB_PIECES) {
+        const BBResult r = bitbases.probe(_board);
+        if (r == BB_DRAW)
+            return 0;
+        known = bbBonus(r);
+    }
+
+    return nnue.evaluate(_board) + known;
+}
+
+// the two corrections are summed, so each table learns what is left of the
+// error after the other one instead of the full error
+void Search::updateCorrHistory(int rawEval, int score, int depth) {
+    const int diff = (score - rawEval) * CORR_GRAIN;
+    const int weight = std::min(depth + 1, 16);
+
+    auto update = [&](std::int16_t &entry, int target) {
+        const int v = (entry * (256 - weight) + target * weight) / 256;
+        entry = std::clamp(v, -CORR_LIMIT, CORR_LIMIT);
+    };
+
+    std::int16_t &pawn =
+        pawnCorrHist[_board.turn][_board.pawnKey() % CORR_SIZE];
+    std::int16_t &material =
+        materialCorrHist[_board.turn][_board.materialKey() % CORR_SIZE];
+
+    update(pawn, diff - material);
+    update(material, diff - pawn);
+}
+
+void Search::clearHistory() {
+    memset(captureHistory, 0, sizeof(captureHistory));
+    memset(contHistory.get(), 0, sizeof(ContinuationHistory));
+    memset(counterMoves, 0, sizeof(counterMoves));
+    memset(pawnCorrHist, 0, sizeof(pawnCorrHist));
+    memset(materialCorrHist, 0, sizeof(materialCorrHist));
+}
+
 moveList Search::generateMoves() {
     moveList mList = {0};
     generate(_board, &mList);
@@ -72,10 +215,12 @@ moveList Search::generateMoves() {
 Board Search::getBoard() { return _board; }
 
 void Search::scoreMoves(moveList *mList, unsigned ttMove) {
+    const unsigned counter = counterMove(_board.ply);
+
     for (int i = 0; i < mList->nMoves; i++) {
         unsigned move = mList->moves[i].move;
 
-        if (move == pvTable[_board.ply][0]) {
+        if (move == ss[_board.ply].pv[0]) {
             mList->moves[i].score = 500000;
             continue;
         } else if (ttMove && move == ttMove) {
@@ -96,43 +241,48 @@ void Search::scoreMoves(moveList *mList, unsigned ttMove) {
 
         else if (moveFlag >= CAPTURE && moveFlag < P_KNIGHT) {
             Square fromSq = getFrom(move), toSq = getTo(move);
-            Piece fromPc = _board.board[fromSq], toPc = _board.board[toSq];
-
-            if (getCapture(move) == EP_CAPTURE) {
-                toPc = _board.board[toSq ^ 8];
-            }
-
-            if (fromPc > toPc) {
-                int see = _board.see(toSq, toPc, fromSq, fromPc);
-
-                if (see > 0) {
-                    see += 20000;
-                }
-
-                mList->moves[i].score = see;
-            }
+            PieceT attacker = getPcType(_board.board[fromSq]);
+            PieceT victim = (moveFlag == EP_CAPTURE)
+                                  ? PAWN
+                                  : getPcType(_board.board[toSq]);
+
+            // MVV/LVA inside each class; losing captures stay negative so
+            // the quiescence search can skip them
+            int mvvLva = victimScores[victim] + 6 - attacker;
+            int capHist = captureHist(move, _board.board[fromSq]);
+            if (_board.seeGE(move, 0))
+                mList->moves[i].score = 20000 + mvvLva + capHist / 16;
+            else
+                mList->moves[i].score = mvvLva - 1000 + capHist / 64;
         }
 
         else if (moveFlag < CAPTURE) {
-            if (killerMates[_board.ply][0] == move) {
+            if (ss[_board.ply].mateKillers[0] == move) {
                 mList->moves[i].score = 18000 + 100;
             }
 
-            else if (killerMates[_board.ply][1] == move) {
+            else if (ss[_board.ply].mateKillers[1] == move) {
                 mList->moves[i].score = 18000 + 95;
             }
 
-            else if (killerMoves[_board.ply][0] == move) {
+            else if (ss[_board.ply].killers[0] == move) {
                 mList->moves[i].score = 16000 + 90;
             }
 
-            else if (killerMoves[_board.ply][1] == move) {
+            else if (ss[_board.ply].killers[1] == move) {
                 mList->moves[i].score = 16000 + 80;
             }
 
+            else if (counter && counter == move) {
+                mList->moves[i].score = 16000 + 70;
+            }
+
             else {
-                mList->moves[i].score =
-                      historyMoves[_board.turn][getFrom(move)][getTo(move)];
+                // stay below the killers whatever the histories say
+                mList->moves[i].score = std::min(
+                      15999,
+                      historyMoves[_board.turn][getFrom(move)][getTo(move)] +
+                            quietHistory(move, _board.board[getFrom(move)]));
             }
         }
     }
@@ -151,10 +301,16 @@ int Search::quiescent(int alpha, int beta) {
     }
 
     selDepth = std::max(selDepth, ply);
+    stackHigh = std::max(stackHigh, ply);
+
+    if (ply >= MAX_PLY) {
+        Eval eval(_board);
+        return evaluate(eval);
+    }
 
     tt.prefetch(_board.key);
     bool pvNode = (beta - alpha) < 1;
-    pvTableLen[_board.ply] = 0;
+    ss[ply].pvLen = 0;
 
     int flag = -1;
     int evalScore = INF;
@@ -180,10 +336,10 @@ int Search::quiescent(int alpha, int beta) {
     Eval eval(_board);
 
     if (evalScore == INF) {
-        evalScore = eval.eval();
-        Hist[ply].eval = evalScore;
+        evalScore = evaluate(eval);
+        ss[ply].eval = evalScore;
     } else {
-        Hist[ply].eval = evalScore;
+        ss[ply].eval = evalScore;
 
         if (!pvNode &&
             (flag == TP_EXACT || (flag == TP_BETA && ttScore >= evalScore) ||
@@ -237,7 +393,9 @@ int Search::quiescent(int alpha, int beta) {
         if (dMargin < alpha && getCapture(move) < P_KNIGHT)
             continue;
 
-        Hist[ply].move = move;
+        ss[ply].move = move;
+        ss[ply].piece = fromPc;
+        ss[ply].contHist = &contHistory->table[fromPc][toSq];
 
         nodes++;
         make(_board, mList.moves[i].move);
@@ -260,7 +418,7 @@ int Search::quiescent(int alpha, int beta) {
         }
     }
 
-    tt.record(_board.key, _board.ply, bestMove, 0, Hist[ply].eval, best, pvNode,
+    tt.record(_board.key, _board.ply, bestMove, 0, ss[ply].eval, best, pvNode,
               hashFlag);
 
     return best;
@@ -270,7 +428,14 @@ int Search::negaMax(int alpha, int beta, int depth, bool cutNode,
                     bool isExtension) {
     int hashFlag = TP_ALPHA;
     const int ply = _board.ply;
-    pvTableLen[ply] = 0;
+    if (ply >= MAX_PLY) {
+        Eval eval(_board);
+        return evaluate(eval);
+    }
+
+    const unsigned excludedMove = ss[ply].excluded;
+    stackHigh = std::max(stackHigh, ply);
+    ss[ply].pvLen = 0;
 
     tt.prefetch(_board.key);
     if (checkForStop()) {
@@ -291,16 +456,26 @@ int Search::negaMax(int alpha, int beta, int depth, bool cutNode,
     bool pvNode = alpha < (beta - 1);
 
     if (_board.ply > 0) {
-        if (_board.halfMoves >= 100 || _board.isDraw() || _board.isTMR())
+        if (_board.halfMoves >= 100 || _board.isDraw() || _board.isTMR() ||
+            bitbases.probe(_board) == BB_DRAW)
             return 1 - (nodes & 3);
 
+        // a reversible move reaches a position already on the path, so
+        // the side to move can always claim at least a draw
+        const int drawScore = 1 - (nodes & 3);
+        if (alpha < drawScore && _board.hasUpcomingRepetition(ply)) {
+            alpha = drawScore;
+            if (alpha >= beta)
+                return alpha;
+        }
+
         alpha = std::max(alpha, -INF + _board.ply);
         beta = std::min(beta, INF - _board.ply);
 
         if (alpha >= beta) {
-            if (killerMates[ply][0] != pvTable[ply][0]) {
-                killerMates[ply][1] = killerMates[ply][0];
-                killerMates[ply][0] = pvTable[ply][0];
+            if (ss[ply].mateKillers[0] != ss[ply].pv[0]) {
+                ss[ply].mateKillers[1] = ss[ply].mateKillers[0];
+                ss[ply].mateKillers[0] = ss[ply].pv[0];
             }
 
             return alpha;
@@ -313,7 +488,9 @@ int Search::negaMax(int alpha, int beta, int depth, bool cutNode,
     unsigned ttMove = 0;
     int flag = -1;
     TTHash entry = {0};
-    if (tt.probe(_board.key, entry)) {
+    // the entry belongs to the full node, not to the search without the
+    // excluded move
+    if (!excludedMove && tt.probe(_board.key, entry)) {
         ttHit = true;
         ttScore = entry.score(_board.ply);
         ttMove = entry.move();
@@ -327,23 +504,59 @@ int Search::negaMax(int alpha, int beta, int depth, bool cutNode,
         }
     }
 
+    // wdl tables are only exact right after a zeroing move with no castling
+    if (ply > 0 && !excludedMove && tb.largest() && !_board.halfMoves &&
+        !_board.castleRights &&
+        (int)popcount(_board.pieces()) <= tb.largest()) {
+        ProbeState result;
+        const WDLScore wdl = tb.probeWDL(_board, &result);
+
+        if (result != PROBE_FAIL) {
+            tbHits++;
+
+            const int tbScore = wdl < WDL_BLESSED_LOSS ? -TB_WIN + ply
+                                : wdl > WDL_CURSED_WIN ? TB_WIN - ply
+                                                       : 0;
+            const int tbFlag = wdl < WDL_BLESSED_LOSS ? TP_ALPHA
+                               : wdl > WDL_CURSED_WIN ? TP_BETA
+                                                      : TP_EXACT;
+
+            if (tbFlag == TP_EXACT || (tbFlag == TP_BETA && tbScore >= beta) ||
+                (tbFlag == TP_ALPHA && tbScore <= alpha)) {
+                tt.record(_board.key, ply, 0, std::min(depth + 6, MAX_PLY - 1),
+                          INF, tbScore, pvNode, tbFlag);
+                return tbScore;
+            }
+        }
+    }
+
     int futilityMargin[] = {0, 100, 300, 700};
 
     Eval eval(_board);
     int best = -INF;
     unsigned move = 0;
     int score = 0;
+    int rawEval;
+    // after a null move the parent's corrected eval is reused. It is not a
+    // raw eval of this position, so it neither trains the correction
+    // history nor goes into the tt
+    bool evalInherited = false;
 
+    // the tt keeps the raw eval, the correction is applied on every probe
     if (evalScore == INF) {
-        if (ply >= 1 && !Hist[ply - 1].move) {
-            evalScore = Hist[ply - 1].eval;
-            Hist[ply].eval = evalScore;
+        if (ply >= 1 && !ss[ply - 1].move) {
+            evalScore = rawEval = ss[ply - 1].eval;
+            evalInherited = true;
+            ss[ply].eval = evalScore;
         } else {
-            evalScore = eval.eval();
-            Hist[ply].eval = evalScore;
+            rawEval = evaluate(eval);
+            evalScore = correctEval(rawEval);
+            ss[ply].eval = evalScore;
         }
     } else {
-        Hist[ply].eval = evalScore;
+        rawEval = evalScore;
+        evalScore = correctEval(rawEval);
+        ss[ply].eval = evalScore;
         // try tt score
 
         if (!pvNode &&
@@ -354,7 +567,7 @@ int Search::negaMax(int alpha, int beta, int depth, bool cutNode,
     }
 
     bool improving =
-          (!inCheck && ply >= 2 && Hist[ply].eval > Hist[ply - 2].eval);
+          (!inCheck && ply >= 2 && ss[ply].eval > ss[ply - 2].eval);
 
     // static NMP
     int evalMargin = evalScore - (75 - 28 * improving) * depth;
@@ -363,7 +576,8 @@ int Search::negaMax(int alpha, int beta, int depth, bool cutNode,
         return evalMargin;
     }
 
-    if (depth > 1 && !_board.checkPcs && !pvNode && Hist[ply - 1].move &&
+    if (depth > 1 && !_board.checkPcs && !pvNode && !excludedMove &&
+        ss[ply - 1].move &&
         evalScore >= beta &&
         (_board.pieces(_board.turn) ^ _board.pieces(PAWN, _board.turn) ^
          _board.pieces(KING, _board.turn)) &&
@@ -372,7 +586,8 @@ int Search::negaMax(int alpha, int beta, int depth, bool cutNode,
                 std::min(3, (evalScore - beta) / (135 - 45 * improving)) +
                 improving;
 
-        Hist[ply].move = NO_MOVE;
+        ss[ply].move = NO_MOVE;
+        ss[ply].contHist = nullptr;
         makeNullMove(_board);
         score = -negaMax(-beta, -beta + 1, depth - R, !cutNode, isExtension);
         unmakeNullMove(_board);
@@ -386,11 +601,64 @@ int Search::negaMax(int alpha, int beta, int depth, bool cutNode,
         }
     }
 
+    // ProbCut: a good capture that beats beta by a margin in a reduced
+    // search will almost surely beat beta in the full one
+    const int probBeta = beta + 200 - 50 * improving;
+    if (!pvNode && !inCheck && !excludedMove && depth >= 5 &&
+        std::abs(beta) < CHECKMATE &&
+        !(ttHit && entry.depth() >= depth - 3 && ttScore < probBeta)) {
+        moveList captures = {0};
+        generateCaptures(_board, &captures);
+        scoreMoves(&captures, ttMove);
+
+        for (int i = 0; i < captures.nMoves; i++) {
+            captures.swapBest(i);
+            const unsigned capt = captures.moves[i].move;
+
+            if (!_board.seeGE(capt, probBeta - evalScore))
+                continue;
+
+            ss[ply].move = capt;
+            ss[ply].piece = _board.board[getFrom(capt)];
+            ss[ply].contHist =
+                  &contHistory->table[ss[ply].piece][getTo(capt)];
+
+            pcSearched++;
+            nodes++;
+            make(_board, capt);
+            score = -quiescent(-probBeta, -probBeta + 1);
+            if (score >= probBeta)
+                score = -negaMax(-probBeta, -probBeta + 1, depth - 4,
+                                 !cutNode);
+            unmake(_board, capt);
+
+            if (score >= probBeta) {
+                pcCutoffs++;
+                tt.record(_board.key, ply, capt, depth - 3,
+                          evalInherited ? INF : rawEval, score, false,
+                          TP_BETA);
+                return score;
+            }
+        }
+    }
+
     // if (!pvNode && depth <= 1 &&
     //     (evalScore <= (alpha - 350 - 15 * (depth - 1))) && !inCheck) {
     //     return quiescent(alpha, beta);
     // }
 
+    if (!ttMove && !excludedMove) {
+        if (pvNode && depth >= IID_DEPTH) {
+            negaMax(alpha, beta, depth - IID_REDUCTION, cutNode, isExtension);
+
+            TTHash iidEntry = {0};
+            if (tt.probe(_board.key, iidEntry))
+                ttMove = iidEntry.move();
+        } else if (!pvNode && depth >= IIR_DEPTH) {
+            depth -= IIR_PLIES;
+        }
+    }
+
     moveList mList = {{{0}}};
     generate(_board, &mList);
     scoreMoves(&mList, ttMove);
@@ -404,21 +672,54 @@ int Search::negaMax(int alpha, int beta, int depth, bool cutNode,
     int movesSearched = 0;
     int skip = 0;
 
-    if (!ttHit && depth >= 4)
-        depth--;
+    const unsigned counter = counterMove(ply);
+    unsigned quietsTried[64], capturesTried[32];
+    int nQuiets = 0, nCaptures = 0;
+
+    // singular extension: if every other move fails low against a bound
+    // just under the tt score, the tt move is the only good one and gets
+    // searched a ply deeper. If they fail high even against beta there
+    // are several refutations and the node is cut (multi-cut).
+    int singularExt = 0;
+    if (!rootNode && !excludedMove && depth >= 8 && ply < 2 * rootDepth &&
+        ttMove && flag != TP_ALPHA && entry.depth() >= depth - 3 &&
+        std::abs(ttScore) < CHECKMATE) {
+        bool found = false;
+        for (int i = 0; i < mList.nMoves; i++)
+            found |= (mList.moves[i].move == ttMove);
+
+        if (found) {
+            const int singularBeta = ttScore - 2 * depth;
+
+            ss[ply].excluded = ttMove;
+            score = negaMax(singularBeta - 1, singularBeta, (depth - 1) / 2,
+                            cutNode, isExtension);
+            ss[ply].excluded = NO_MOVE;
+
+            if (score < singularBeta)
+                singularExt = 1;
+            else if (singularBeta >= beta)
+                return singularBeta;
+        }
+    }
 
     for (int i = 0; i < mList.nMoves; i++) {
         mList.swapBest(i);
         const unsigned curr_move = mList.moves[i].move;
+        if (curr_move == excludedMove)
+            continue;
+
+        // only moves that keep the tablebase result at the root
+        if (!ply && !rootMoves.empty() &&
+            std::find(rootMoves.begin(), rootMoves.end(), curr_move) ==
+                  rootMoves.end())
+            continue;
+
         bool inCheck = _board.checkPcs;
         bool isQuiet = (getCapture(curr_move) < CAPTURE);
 
         Square fromSq = getFrom(curr_move), toSq = getTo(curr_move);
-        Piece fromPc = _board.board[fromSq], toPc = _board.board[toSq];
-
-        if (getCapture(move) == EP_CAPTURE) {
-            toPc = _board.board[toSq ^ 8];
-        }
+        Piece fromPc = _board.board[fromSq];
 
         if (_board.ply > 0 && best > -CHECKMATE) {
             if (getCapture(curr_move) < CAPTURE) {
@@ -441,8 +742,12 @@ int Search::negaMax(int alpha, int beta, int depth, bool cutNode,
                 }
 
                 if (depth <= 8 && !_board.checkPcs &&
-                    _board.see(toSq, toPc, fromSq, fromPc) < -80 * depth)
+                    !_board.seeGE(curr_move, -80 * depth))
                     continue;
+            } else if (depth <= 6 && !_board.checkPcs &&
+                       mList.moves[i].score < 0 &&
+                       !_board.seeGE(curr_move, -100 * depth)) {
+                continue;
             }
         }
 
@@ -483,13 +788,27 @@ int Search::negaMax(int alpha, int beta, int depth, bool cutNode,
             R += cutNode;
 
             R -= 2 * (mList.moves[i].score > 19500);
-            int mHist = historyMoves[_board.turn][fromSq][toSq] / 125;
-            R -= std::min(2, mHist) * isQuiet;
+            int mHist = std::min(2, historyMoves[_board.turn][fromSq][toSq] /
+                                          125) +
+                        std::min(0, quietHistory(curr_move, fromPc) / 2048);
+            R -= std::clamp(mHist, -2, 2) * isQuiet;
 
             R = std::min(depth - 1, std::max(1, R));
         }
 
-        Hist[ply].move = curr_move;
+        ss[ply].move = curr_move;
+        ss[ply].piece = fromPc;
+        ss[ply].contHist = &contHistory->table[fromPc][toSq];
+
+        if (isQuiet && nQuiets < 64)
+            quietsTried[nQuiets++] = curr_move;
+        else if (!isQuiet && nCaptures < 32)
+            capturesTried[nCaptures++] = curr_move;
+
+        if (isQuiet && counter && curr_move == counter)
+            cmSearched++;
+
+        const int newDepth = depth - 1 + (curr_move == ttMove) * singularExt;
 
         nodes++;
         movesSearched++;
@@ -501,11 +820,11 @@ int Search::negaMax(int alpha, int beta, int depth, bool cutNode,
 
         if ((R != 1 && score > alpha) ||
             (R == 1 && !(pvNode && movesSearched == 1))) {
-            score = -negaMax(-alpha - 1, -alpha, depth - 1, !cutNode);
+            score = -negaMax(-alpha - 1, -alpha, newDepth, !cutNode);
         }
 
         if (pvNode && (movesSearched == 1 || score > alpha)) {
-            score = -negaMax(-beta, -alpha, depth - 1, false);
+            score = -negaMax(-beta, -alpha, newDepth, false);
         }
 
         unmake(_board, mList.moves[i].move);
@@ -530,7 +849,7 @@ int Search::negaMax(int alpha, int beta, int depth, bool cutNode,
 
     tt.prefetch(_board.key);
 
-    if (mList.nMoves == 0) {
+    if (mList.nMoves == 0 && !excludedMove) {
         if (_board.checkPcs) {
             return -INF + ply;
         }
@@ -538,18 +857,58 @@ int Search::negaMax(int alpha, int beta, int depth, bool cutNode,
         return 0;
     }
 
-    if (best >= beta && getCapture(bestMove) < CAPTURE) {
-        if (killerMoves[ply][0] != bestMove) {
-            killerMoves[ply][1] = killerMoves[ply][0];
-            killerMoves[ply][0] = bestMove;
+    if (best >= beta) {
+        const int bonus = historyBonus(depth);
+        const Piece bestPc = _board.board[getFrom(bestMove)];
+
+        if (getCapture(bestMove) < CAPTURE) {
+            if (ss[ply].killers[0] != bestMove) {
+                ss[ply].killers[1] = ss[ply].killers[0];
+                ss[ply].killers[0] = bestMove;
+            }
+
+            if (ply > 0 && ss[ply - 1].move) {
+                const SearchStack &prev = ss[ply - 1];
+                counterMoves[prev.piece][getTo(prev.move)] = bestMove;
+            }
+
+            if (counter && bestMove == counter)
+                cmCutoffs++;
+
+            historyMoves[_board.turn][getFrom(bestMove)][getTo(bestMove)] +=
+                  depth * depth;
+
+            updateQuietHistories(bestMove, bestPc, bonus);
+            for (int i = 0; i < nQuiets; i++) {
+                if (quietsTried[i] != bestMove)
+                    updateQuietHistories(
+                          quietsTried[i],
+                          _board.board[getFrom(quietsTried[i])], -bonus);
+            }
+        } else {
+            updateCaptureHistory(bestMove, bestPc, bonus);
         }
 
-        historyMoves[_board.turn][getFrom(bestMove)][getTo(bestMove)] +=
-              depth * depth;
+        for (int i = 0; i < nCaptures; i++) {
+            if (capturesTried[i] != bestMove)
+                updateCaptureHistory(capturesTried[i],
+                                     _board.board[getFrom(capturesTried[i])],
+                                     -bonus);
+        }
     }
 
-    tt.record(_board.key, _board.ply, bestMove, depth, Hist[ply].eval, best,
-              pvNode, hashFlag);
+    // learn the eval error from quiet nodes whose bound says something
+    // about it
+    if (!inCheck && !excludedMove && !stopFlag && !evalInherited &&
+        (!bestMove || getCapture(bestMove) < CAPTURE) &&
+        std::abs(best) < CHECKMATE &&
+        !(hashFlag == TP_BETA && best <= ss[ply].eval) &&
+        !(hashFlag == TP_ALPHA && best >= ss[ply].eval))
+        updateCorrHistory(rawEval, best, depth);
+
+    if (!excludedMove)
+        tt.record(_board.key, _board.ply, bestMove, depth,
+                  evalInherited ? INF : rawEval, best, pvNode, hashFlag);
 
     return best;
 }
@@ -560,9 +919,25 @@ int Search::search() {
     int num = 2;
 
     int alpha = -INF, beta = INF;
-    int score = 0, prevScore = -INF;
+    int score = 0, prevScore = -INF, bestScore = 0;
     unsigned bestMove = 0;
 
+    _board.pawnTable = pawnTable.get();
+
+    // the stack starts from a full refresh of the root position
+    _board.acc = nullptr;
+    if (nnue.loaded()) {
+        _board.acc = accStack;
+        accStack->computed[WHITE] = accStack->computed[BLACK] = false;
+        accStack->dirty.refresh[WHITE] = accStack->dirty.refresh[BLACK] = true;
+    }
+
+    rootMoves.clear();
+    if (tb.largest() && !_board.castleRights &&
+        (int)popcount(_board.pieces()) <= tb.largest() &&
+        !tb.rootMoves(_board, rootMoves))
+        rootMoves.clear();
+
     double totalTime = 0;
     for (int j = 1; j <= depth; j++) {
         double start = get_time();
@@ -590,6 +965,7 @@ int Search::search() {
             num++;
             aspirationDepth = std::max(1, aspirationDepth);
             selDepth = 0;
+            rootDepth = aspirationDepth;
             score = negaMax(alpha, beta, aspirationDepth, false);
 
             if (score <= alpha) {
@@ -606,12 +982,16 @@ int Search::search() {
                 // if (std::abs(score) < (INF / 2))
                 //     aspirationDepth--;
 
-                if (pvTableLen[0] && !bestMove)
-                    bestMove = pvTable[0][0];
+                if (ss[0].pvLen && !bestMove)
+                    bestMove = ss[0].pv[0];
 
             } else {
-                if (pvTableLen[0])
-                    bestMove = pvTable[0][0];
+                if (ss[0].pvLen)
+                    bestMove = ss[0].pv[0];
+                bestScore = score;
+
+                if (info->silent)
+                    break;
 
                 double end = ((get_time() - start) + 1) / 1000.0;
                 totalTime += end;
@@ -661,26 +1041,36 @@ int Search::search() {
         bestMove = mList.moves[0].move;
     }
 
+    _board.acc = nullptr;
+    _board.pawnTable = nullptr;
+    lastBestMove = bestMove;
+    lastScore = bestScore;
+    bench_nodes += nodes;
+
+    if (info->silent)
+        return 0;
+
     std::cout << "bestmove ";
     print_move(bestMove);
     std::cout << std::endl;
-    bench_nodes += nodes;
 
     return 0;
 }
 
 void Search::updatePv(int ply, unsigned move) {
-    pvTable[ply][0] = move;
+    SearchStack &s = ss[ply];
+    const SearchStack &child = ss[ply + 1];
 
-    for (int i = 0; i < pvTableLen[ply + 1]; i++)
-        pvTable[ply][i + 1] = pvTable[ply + 1][i];
+    s.pv[0] = move;
+    for (int i = 0; i < child.pvLen; i++)
+        s.pv[i + 1] = child.pv[i];
 
-    pvTableLen[ply] = 1 + pvTableLen[ply + 1];
+    s.pvLen = 1 + child.pvLen;
 }
 
 void Search::printPv() {
-    for (int i = 0; i < pvTableLen[0]; i++) {
-        print_move(pvTable[0][i]);
+    for (int i = 0; i < ss[0].pvLen; i++) {
+        print_move(ss[0].pv[i]);
         std::cout << " ";
     }
 }
@@ -688,8 +1078,8 @@ void Search::printPv() {
 std::vector<int> Search::getPv() {
     std::vector<int> x;
 
-    for (int i = 0; i < pvTableLen[0]; i++) {
-        x.push_back(pvTable[0][i]);
+    for (int i = 0; i < ss[0].pvLen; i++) {
+        x.push_back(ss[0].pv[i]);
     }
 
     return x;
@@ -22,6 +22,8 @@
 #include "eval.hpp"
 #include "move.hpp"
 #include "movegen.hpp"
+#include "nnue.hpp"
+#include "tbprobe.hpp"
 #include "tt.hpp"
 #include "util.hpp"
 #include <cmath>
@@ -32,17 +34,75 @@
 #include <utility>
 #include <vector>
 
+// internal iterative deepening/reductions for nodes without a tt move:
+// PV nodes at IID_DEPTH or more run a search IID_REDUCTION plies shallower
+// to find one, other nodes at IIR_DEPTH or more are reduced by IIR_PLIES
+#define IID_DEPTH 6
+#define IID_REDUCTION 4
+#define IIR_DEPTH 4
+#define IIR_PLIES 1
+
+// correction history: learned static eval error per pawn structure and
+// material balance, stored in 1/CORR_GRAIN of a centipawn
+#define CORR_SIZE 16384
+#define CORR_GRAIN 256
+#define CORR_LIMIT (CORR_GRAIN * 32)
+
 namespace Yayo {
 
-struct HistEntry {
+// gravity-style history tables saturate at +-MAX_HISTORY
+constexpr int MAX_HISTORY = 16384;
+
+typedef std::int16_t PieceToHistory[PC_MAX][SQUARE_CT];
+
+// indexed by the piece and to-square of an earlier move in the line
+struct ContinuationHistory {
+    PieceToHistory table[PC_MAX][SQUARE_CT];
+};
+
+constexpr int STACK_SIZE = MAX_PLY + 6;
+// each ply gets a PV slice one shorter than the ply before it
+constexpr int PV_BUFFER_SIZE = STACK_SIZE * (STACK_SIZE + 1) / 2;
+
+// everything the search keeps per ply, in one place
+struct SearchStack {
     int move, eval;
+    Piece piece;
+    unsigned excluded; // move skipped by a singular verification search
+    int killers[2];
+    int mateKillers[2];
+    // continuation history of the move made at this ply
+    PieceToHistory *contHist;
+    int *pv;
+    int pvLen;
 };
 
+template <typename T> constexpr void updateHistory(T &entry, int bonus) {
+    entry += bonus - entry * std::abs(bonus) / MAX_HISTORY;
+}
+
+constexpr int historyBonus(int depth) {
+    return std::min(1536, 16 * depth * depth + 32 * depth);
+}
+
 class Search {
   public:
     Search() {
         info = nullptr;
+        contHistory = std::make_unique<ContinuationHistory>();
+        pawnTable = std::make_unique<PawnTable>();
+
+        for (int ply = 0, offset = 0; ply < STACK_SIZE; ply++) {
+            ss[ply].pv = pvBuffer + offset;
+            offset += STACK_SIZE - ply;
+        }
+        stackHigh = STACK_SIZE - 1;
+        clearStack();
         memset(lmrDepthReduction, 0, sizeof(lmrDepthReduction));
+        memset(captureHistory, 0, sizeof(captureHistory));
+        memset(counterMoves, 0, sizeof(counterMoves));
+        memset(pawnCorrHist, 0, sizeof(pawnCorrHist));
+        memset(materialCorrHist, 0, sizeof(materialCorrHist));
 
         for (int depth = 0; depth < 64; depth++) {
             // std::cout << "depth: " << depth << std::endl;
@@ -62,8 +122,11 @@ class Search {
     constexpr bool canReduce(int alpha, int move, Move &m);
 
     void startSearch(Info *_info);
+    // searches on the calling thread, returns the best move and its score
+    unsigned searchNow(Info *_info, int &score);
 
     void clearTT(int size);
+    void clearHistory();
     void wait();
     void isReady();
     void joinThread();
@@ -81,14 +144,32 @@ class Search {
     int search();
 
   private:
-    int pvTable[MAX_PLY + 6][MAX_PLY + 6];
-    int pvTableLen[MAX_PLY + 6];
-    int killerMoves[MAX_PLY + 6][2];
-    int killerMates[MAX_PLY + 6][2];
+    SearchStack ss[STACK_SIZE];
+    int pvBuffer[PV_BUFFER_SIZE];
+    // highest ply touched since the stack was last cleared
+    int stackHigh;
     int historyMoves[2][64][64];
+    unsigned counterMoves[PC_MAX][SQUARE_CT];
+    int captureHistory[PC_MAX][SQUARE_CT][PT_MAX];
+    std::unique_ptr<ContinuationHistory> contHistory;
+    std::unique_ptr<PawnTable> pawnTable;
+    std::int16_t pawnCorrHist[2][CORR_SIZE];
+    std::int16_t materialCorrHist[2][CORR_SIZE];
     long lmrDepthReduction[64][64];
-    HistEntry Hist[512];
 
+    PieceToHistory *contHistAt(int ply, int back);
+    unsigned counterMove(int ply) const;
+    PieceT capturedType(unsigned move);
+    int quietHistory(unsigned move, Piece pc);
+    int captureHist(unsigned move, Piece pc);
+    void updateQuietHistories(unsigned move, Piece pc, int bonus);
+    void updateCaptureHistory(unsigned move, Piece pc, int bonus);
+    int correctEval(int rawEval);
+    // the network when one is loaded, the classical eval otherwise
+    int evaluate(Eval<> &eval);
+    void updateCorrHistory(int rawEval, int score, int depth);
+
+    void clearStack();
     void updatePv(int ply, unsigned move);
     void printPv();
 
@@ -101,12 +182,23 @@ class Search {
     std::uint64_t get_nodes() const { return this->bench_nodes; }
     std::uint64_t bench_nodes = 0;
 
+    // how often the countermove was searched and how often it cut off
+    std::uint64_t cmSearched = 0, cmCutoffs = 0;
+    // captures tried by ProbCut and the nodes they cut
+    std::uint64_t pcSearched = 0, pcCutoffs = 0;
+    std::uint64_t tbHits = 0;
+
   private:
     int abortDepth;
+    int rootDepth;
     int numRep;
     int selDepth;
     int quiescentDepth;
     bool searched = false;
+    unsigned lastBestMove = 0;
+    int lastScore = 0;
+    // root moves allowed by the tablebases, empty when not probing
+    std::vector<unsigned> rootMoves;
 
     mutable int stopFlag = 0;
     mutable std::uint64_t stopCount = 0;
@@ -115,6 +207,8 @@ class Search {
     std::uint64_t nodes;
     Board _board;
     Info *info;
+    // one accumulator per ply, _board.acc points into it during a search
+    Accumulator accStack[STACK_SIZE];
 };
 
 constexpr bool Search::canReduce(int alpha, int move, Move &m) {
@@ -131,7 +225,7 @@ constexpr bool Search::canReduce(int alpha, int move, Move &m) {
     if (getPcType(_board.board[getFrom(move)]) == PAWN)
         return false;
 
-    if (killerMoves[_board.ply][0] == move)
+    if (ss[_board.ply].killers[0] == move)
         return false;
     // if (eval(_board, mList) > alpha)
     //     return false;
@@ -23,7 +23,14 @@
 */
 
 #include "tuner.hpp"
-#include <limits>
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <random>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #define THREADS 8
 
@@ -33,106 +40,220 @@ double sigmoid(double K, double E) {
     return 1.0 / (1.0 + exp(-K * E / 400.00));
 }
 
-TunerEntries::TunerEntries(std::string file) {
-    entries = new TEntry[NUM_ENTRIES];
+std::size_t TunerData::bytes() const {
+    return offset.size() * sizeof(offset[0]) + index.size() * sizeof(index[0]) +
+           coeff.size() * sizeof(coeff[0]) +
+           mgPhase.size() * sizeof(mgPhase[0]) +
+           result.size() * sizeof(result[0]) +
+           staticEval.size() * sizeof(staticEval[0]);
+}
 
-    std::ifstream games;
-    games.open(file);
+void TunerData::add(const Trace &trace, int phase, float res, int eval) {
+    const int *traceArray = (const int *)&trace; // lol
 
-    if (!games.is_open()) {
-        std::cerr << "ERROR: COULD NOT LOCATE TRAINING DATASET\n";
-        return;
-    }
-
-    std::string line;
-    std::vector<std::string> fens;
-    for (int i = 0; i < NUM_ENTRIES; i++) {
-        getline(games, line);
-        fens.push_back(line);
+    for (int i = 0, w = 0; w < NUM_FEATURES; i += 2, w++) {
+        if (traceArray[i] - traceArray[i + 1]) {
+            index.push_back(w);
+            coeff.push_back(traceArray[i] - traceArray[i + 1]);
+        }
     }
 
-#pragma omp parallel for schedule(dynamic) num_threads(THREADS)
-    for (int i = 0; i < NUM_ENTRIES; i++) {
-        std::string line = fens[i];
+    offset.push_back(index.size());
+    mgPhase.push_back(phase);
+    result.push_back(res);
+    staticEval.push_back(eval);
+}
 
-        if (line.find("[1.0]") != std::string::npos)
-            entries[i].result = 1.0;
-        else if (line.find("[0.5]") != std::string::npos)
-            entries[i].result = 0.5;
-        else if (line.find("[0.0]") != std::string::npos)
-            entries[i].result = 0.0;
+void TunerData::append(const TunerData &other) {
+    const std::uint32_t base = index.size();
+    for (std::size_t i = 1; i < other.offset.size(); i++)
+        offset.push_back(base + other.offset[i]);
+
+    index.insert(index.end(), other.index.begin(), other.index.end());
+    coeff.insert(coeff.end(), other.coeff.begin(), other.coeff.end());
+    mgPhase.insert(mgPhase.end(), other.mgPhase.begin(), other.mgPhase.end());
+    result.insert(result.end(), other.result.begin(), other.result.end());
+    staticEval.insert(staticEval.end(), other.staticEval.begin(),
+                      other.staticEval.end());
+}
 
-        Board board;
-        board.setFen(line);
-        entries[i].init(board, std::move(line));
+int QResolver::resolve(Board &board) {
+    const int score = qsearch(board, -INF, INF, 0);
 
-        if (!(i % 5000)) {
-            std::cout << "initializing tuner entry #" << i << " of "
-                      << NUM_ENTRIES << "\n";
-        }
+    for (int i = 0; i < pvLen[0]; i++) {
+        make(board, pv[0][i]);
     }
 
-    games.close();
+    return score;
 }
 
-void TEntry::init(Board &board, std::string fen) {
-    Trace trace = Trace();
-    Info info[1];
-    info->timeGiven = false;
+// stand pat and winning captures, every evasion when in check
+int QResolver::qsearch(Board &board, int alpha, int beta, int ply) {
+    pvLen[ply] = 0;
+    nodes++;
+
+    const bool inCheck = board.checkPcs;
+    if (ply >= QS_MAX_PLY)
+        return Eval(board).eval();
+
+    int best = -INF;
+    if (!inCheck) {
+        best = Eval(board).eval();
+        if (best >= beta)
+            return best;
+        alpha = std::max(alpha, best);
+    }
 
-    Search search;
-    search.setInfo(info);
-    search._setFen(fen);
-    search.probe = false;
+    moveList mList = {0};
+    if (inCheck)
+        generate(board, &mList);
+    else
+        generateCaptures(board, &mList);
 
-    // turn = board.turn;
-    search.negaMax(-INF, INF, 2, false);
-    auto pvMoves = search.getPv();
+    if (inCheck && !mList.nMoves)
+        return -CHECKMATE + ply;
+
+    for (int i = 0; i < mList.nMoves; i++) {
+        mList.swapBest(i);
+        const unsigned short move = mList.moves[i].move;
+
+        if (!inCheck && getCapture(move) < P_KNIGHT && !board.seeGE(move, 0))
+            continue;
 
-    for (auto move : pvMoves) {
         make(board, move);
+        const int score = -qsearch(board, -beta, -alpha, ply + 1);
+        unmake(board, move);
+
+        if (score > best) {
+            best = score;
+
+            if (score > alpha) {
+                alpha = score;
+
+                pv[ply][0] = move;
+                for (int j = 0; j < pvLen[ply + 1]; j++)
+                    pv[ply][j + 1] = pv[ply + 1][j];
+                pvLen[ply] = pvLen[ply + 1] + 1;
+
+                if (alpha >= beta)
+                    break;
+            }
+        }
     }
 
-    // staticEval = search.quiescent(-INF, INF);
+    return best;
+}
+
+// traces the eval of the quiet position the resolver ends in
+static void initEntry(TunerData &data, const PackedPos &pos, Board &board,
+                      QResolver &resolver) {
+    unpack(pos, board);
+    resolver.resolve(board);
 
+    Trace trace = Trace();
     Eval<TRACE> eval(board, trace);
-    staticEval = eval.eval();
+    int staticEval = eval.eval();
 
     if (board.turn == BLACK) {
         staticEval *= -1;
     }
 
     // clang-format off
-    phase = 4 * popcount(board.pieces(QUEEN)) +
-            2 * popcount(board.pieces(ROOK)) +
-            1 * popcount(board.pieces(BISHOP)) +
-            1 * popcount(board.pieces(KNIGHT));
+    int phase = 4 * popcount(board.pieces(QUEEN)) +
+                2 * popcount(board.pieces(ROOK)) +
+                1 * popcount(board.pieces(BISHOP)) +
+                1 * popcount(board.pieces(KNIGHT));
     // clang-format on
 
-    mgPhase = phase;
-    if (mgPhase > 24)
-        mgPhase = 24;
-    egPhase = 24 - mgPhase;
+    data.add(trace, std::min(phase, 24), pos.result / 2.0, staticEval);
+}
 
-    int *TraceArray = (int *)&trace; // lol
-    TTuple temp_tuples[NUM_FEATURES * 2];
+// each thread traces a contiguous slice into its own arena, the slices are
+// then joined in order
+void TunerEntries::addPositions(const PackedPos *positions, int count) {
+    std::vector<TunerData> parts(THREADS);
 
-    for (int i = 0, w = 0; w < NUM_FEATURES; i += 2, w++) {
-        if (TraceArray[i] - TraceArray[i + 1]) {
-            temp_tuples[nTuples].index = w;
-            temp_tuples[nTuples].whiteScore = TraceArray[i];
-            temp_tuples[nTuples].blackScore = TraceArray[i + 1];
+#pragma omp parallel for schedule(static, 1) num_threads(THREADS)
+    for (int t = 0; t < THREADS; t++) {
+        Board board;
+        QResolver resolver;
 
-            nTuples++;
+        const int end = (long)count * (t + 1) / THREADS;
+        for (int i = (long)count * t / THREADS; i < end; i++) {
+            initEntry(parts[t], positions[i], board, resolver);
         }
     }
 
-    tuples = new TTuple[nTuples];
-    for (int i = 0; i < nTuples; i++) {
-        tuples[i] = temp_tuples[i];
+    for (auto &part : parts) {
+        data.append(part);
+        part = TunerData();
     }
 }
 
+// Packed datasets are mapped and consumed a chunk at a time, anything else is
+// read as the text format.
+TunerEntries::TunerEntries(std::string file) {
+    const std::uint64_t startTime = get_time();
+
+    Dataset dataset;
+    if (dataset.open(file)) {
+        const std::size_t count = dataset.size();
+
+        for (std::size_t start = 0; start < count; start += LOAD_CHUNK) {
+            const std::size_t end = std::min(start + LOAD_CHUNK, count);
+            addPositions(&dataset[start], end - start);
+            dataset.release(start, end);
+
+            std::cout << "initialized tuner entries " << end << " of "
+                      << count << "\n";
+        }
+    } else {
+        std::ifstream games;
+        games.open(file);
+
+        if (!games.is_open()) {
+            std::cerr << "ERROR: COULD NOT LOCATE TRAINING DATASET\n";
+            return;
+        }
+
+        Board board;
+        std::string line;
+        std::vector<PackedPos> positions;
+        while ((int)positions.size() < NUM_ENTRIES && getline(games, line)) {
+            int result = 0;
+
+            if (line.find("[1.0]") != std::string::npos)
+                result = 2;
+            else if (line.find("[0.5]") != std::string::npos)
+                result = 1;
+
+            board.setFen(line);
+            positions.push_back(pack(board, result, PACKED_NO_SCORE));
+        }
+
+        for (std::size_t start = 0; start < positions.size();
+             start += LOAD_CHUNK) {
+            const std::size_t end =
+                  std::min<std::size_t>(start + LOAD_CHUNK, positions.size());
+            addPositions(&positions[start], end - start);
+        }
+    }
+
+    nEntries = data.size();
+    simd = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+
+    const std::uint64_t elapsed =
+          std::max<std::uint64_t>(1, get_time() - startTime);
+    std::cout << "loaded " << nEntries << " entries, " << data.index.size()
+              << " features, " << data.bytes() / (1024 * 1024) << " MB in "
+              << elapsed / 1000.0 << "s (" << nEntries * 1000 / elapsed
+              << " positions/s)\n";
+
+    // lets the vector kernel read 8 features past the last position
+    data.index.resize(data.index.size() + 8, 0);
+    data.coeff.resize(data.coeff.size() + 8, 0);
+}
+
 double TunerEntries::computeOptimalK() {
     double start = 0.0, end = 10, step = 1.0;
     double curr = start, err;
@@ -165,295 +286,1011 @@ double TunerEntries::staticEvalErrors(double K) {
 
     #pragma omp parallel shared(total)
     {
-        #pragma omp for schedule(static, NUM_ENTRIES / THREADS) reduction(+:total)
-        for (int i = 0; i < NUM_ENTRIES; i++) {
-            total += pow(entries[i].result - sigmoid(K, entries[i].staticEval), 2);
+        #pragma omp for schedule(static) reduction(+:total)
+        for (int i = 0; i < nEntries; i++) {
+            total += pow(data.result[i] - sigmoid(K, data.staticEval[i]), 2);
         }
     }
-    return total / (double)NUM_ENTRIES;
+    return total / (double)nEntries;
 }
 
-double TunerEntries::tunedEvalErrors(double params[NUM_FEATURES][2], double K) {
+double TunerEntries::tunedEvalErrors(double weights[NUM_FEATURES][2], double K, const std::vector<int> &set) {
+    const int count = set.size();
     double total = 0.0;
 
     #pragma omp parallel shared(total)
     {
-        #pragma omp for schedule(static, NUM_ENTRIES / THREADS) reduction(+:total)
-        for (int i = 0; i < NUM_ENTRIES; i++) {
-            total += pow(entries[i].result - sigmoid(K, entries[i].linearEval(params)), 2.0);
+        #pragma omp for schedule(static) reduction(+:total)
+        for (int i = 0; i < count; i++) {
+            total += pow(data.result[set[i]] - sigmoid(K, linearEval(set[i], weights)), 2.0);
         }
     }
 
-    return total / (double)NUM_ENTRIES;
+    return total / std::max(1, count);
 }
 // clang-format on
 
-double TEntry::linearEval(double params[NUM_FEATURES][2]) {
-    Score *weights = &((Score *)&w)[0];
-    int mgScore = 0, egScore = 0;
+double TunerEntries::linearEval(std::size_t i,
+                                double weights[NUM_FEATURES][2]) const {
+    const double mg = data.mgPhase[i], eg = 24 - mg;
+    double mgScore = 0, egScore = 0;
+
+    const std::uint32_t start = data.offset[i], end = data.offset[i + 1];
+    const std::uint16_t *index = &data.index[0];
+    const std::int8_t *coeff = &data.coeff[0];
+
+#pragma omp simd reduction(+ : mgScore, egScore)
+    for (std::uint32_t k = start; k < end; k++) {
+        mgScore += coeff[k] * weights[index[k]][0];
+        egScore += coeff[k] * weights[index[k]][1];
+    }
+
+    return TEMPO + (mg * mgScore + eg * egScore) / 24;
+}
+
+#define AVX2_TARGET __attribute__((target("avx2,fma")))
+
+namespace {
+
+AVX2_TARGET inline float hsum(__m256 v) {
+    __m128 x = _mm_add_ps(_mm256_castps256_ps128(v),
+                          _mm256_extractf128_ps(v, 1));
+    x = _mm_add_ps(x, _mm_movehl_ps(x, x));
+    x = _mm_add_ss(x, _mm_movehdup_ps(x));
+    return _mm_cvtss_f32(x);
+}
 
-    double linearEval = TEMPO;
-    for (int i = 0; i < nTuples; i++) {
-        int Fi = tuples[i].whiteScore - tuples[i].blackScore;
-        Score s = weights[tuples[i].index];
+// e^x as 2^n * e^r with |r| <= ln2 / 2, good to about 1e-7 relative
+AVX2_TARGET inline __m256 exp8(__m256 x) {
+    x = _mm256_max_ps(_mm256_min_ps(x, _mm256_set1_ps(88.0f)),
+                      _mm256_set1_ps(-87.0f));
+
+    const __m256 n = _mm256_round_ps(
+          _mm256_mul_ps(x, _mm256_set1_ps(1.44269504f)),
+          _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    const __m256 r = _mm256_fnmadd_ps(n, _mm256_set1_ps(0.69314718f), x);
+
+    __m256 p = _mm256_set1_ps(1.0f / 720);
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(1.0f / 120));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(1.0f / 24));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(1.0f / 6));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(0.5f));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(1.0f));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(1.0f));
+
+    const __m256i e = _mm256_slli_epi32(
+          _mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127)), 23);
+    return _mm256_mul_ps(p, _mm256_castsi256_ps(e));
+}
 
-        double eval =
-              (Fi *
-               (double)(mgPhase * (MgScore(s) + params[tuples[i].index][0]) +
-                        egPhase * (EgScore(s) + params[tuples[i].index][1]))) /
-              24;
+} // namespace
+
+// Float kernel for a slice of a batch. Each position's features are read 8 at
+// a time and the weights gathered, the sigmoid and error run 8 positions
+// wide, and the gradient is added into grad. Returns the summed squared
+// error. Relies on the arena padding to keep the last loads in bounds.
+AVX2_TARGET double TunerEntries::gradientAVX2(const int *batch, int count,
+                                              const float *wmg,
+                                              const float *weg, float K,
+                                              float grad[NUM_FEATURES][2]) {
+    const std::uint16_t *index = &data.index[0];
+    const std::int8_t *coeff = &data.coeff[0];
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+    double error = 0;
+    for (int b = 0; b < count; b += 8) {
+        const int n = std::min(8, count - b);
+        alignas(32) float E[8] = {0}, R[8] = {0}, X[8];
+
+        for (int j = 0; j < n; j++) {
+            const int i = batch[b + j];
+            const int end = data.offset[i + 1];
+            __m256 mg = _mm256_setzero_ps(), eg = _mm256_setzero_ps();
+
+            for (int k = data.offset[i]; k < end; k += 8) {
+                const __m256i live =
+                      _mm256_cmpgt_epi32(_mm256_set1_epi32(end - k), lanes);
+                const __m256i idx = _mm256_cvtepu16_epi32(
+                      _mm_loadu_si128((const __m128i *)&index[k]));
+                const __m256 c = _mm256_cvtepi32_ps(_mm256_and_si256(
+                      _mm256_cvtepi8_epi32(
+                            _mm_loadl_epi64((const __m128i *)&coeff[k])),
+                      live));
+
+                mg = _mm256_fmadd_ps(c, _mm256_i32gather_ps(wmg, idx, 4), mg);
+                eg = _mm256_fmadd_ps(c, _mm256_i32gather_ps(weg, idx, 4), eg);
+            }
 
-        linearEval += eval;
+            const float phase = data.mgPhase[i];
+            E[j] = TEMPO + (phase * hsum(mg) + (24 - phase) * hsum(eg)) / 24;
+            R[j] = data.result[i];
+        }
+
+        const __m256 one = _mm256_set1_ps(1.0f);
+        const __m256 S = _mm256_div_ps(
+              one, _mm256_add_ps(one, exp8(_mm256_mul_ps(
+                                            _mm256_load_ps(E),
+                                            _mm256_set1_ps(-K / 400.0f)))));
+        const __m256 diff = _mm256_sub_ps(_mm256_load_ps(R), S);
+        _mm256_store_ps(X, _mm256_mul_ps(_mm256_mul_ps(diff, S),
+                                         _mm256_sub_ps(one, S)));
+
+        alignas(32) float sq[8];
+        _mm256_store_ps(sq, _mm256_mul_ps(diff, diff));
+        for (int j = 0; j < n; j++)
+            error += sq[j];
+
+        // AVX2 has no scatter, the updates go out one feature at a time
+        for (int j = 0; j < n; j++) {
+            const int i = batch[b + j];
+            const float mgBase = X[j] * data.mgPhase[i] / 24;
+            const __m128 base = _mm_setr_ps(mgBase, X[j] - mgBase, 0, 0);
+
+            // mg and eg sit next to each other, one 64-bit update each
+            for (std::uint32_t k = data.offset[i]; k < data.offset[i + 1];
+                 k++) {
+                __m128 *g = (__m128 *)grad[index[k]];
+                const __m128 old = _mm_castpd_ps(_mm_load_sd((double *)g));
+                const __m128 upd = _mm_fmadd_ps(_mm_set1_ps(coeff[k]), base,
+                                                old);
+                _mm_store_sd((double *)g, _mm_castps_pd(upd));
+            }
+        }
     }
 
-    return linearEval;
+    return error;
 }
 
-// clang-format off
-void TunerEntries::computeGradient(double gradient[NUM_FEATURES][2], double params[NUM_FEATURES][2], double K, int batch) {
-    double local[NUM_FEATURES][2] = {{0}};
+// Each thread accumulates its share of the batch into its own buffer, the
+// buffers are then summed feature by feature, so no locks are taken. Returns
+// the summed squared error of the batch.
+double TunerEntries::computeGradient(double gradient[NUM_FEATURES][2],
+                                     double weights[NUM_FEATURES][2],
+                                     double K, const int *batch, int count,
+                                     bool vector) {
+    static double local[THREADS][NUM_FEATURES][2];
+    alignas(32) static float flocal[THREADS][NUM_FEATURES][2];
+    alignas(32) static float wmg[NUM_FEATURES], weg[NUM_FEATURES];
+
+    if (vector) {
+        std::memset(flocal, 0, sizeof(flocal));
+        for (int f = 0; f < NUM_FEATURES; f++) {
+            wmg[f] = weights[f][0];
+            weg[f] = weights[f][1];
+        }
+    } else {
+        std::memset(local, 0, sizeof(local));
+    }
 
-    for (int i = batch * BATCH_SIZE; i < (batch + 1) * BATCH_SIZE; i++) {
-        updateSingleGradient(entries[i], local, params, K);
+    double error = 0;
 
-        for (int i = 1; i < NUM_FEATURES; i++) {
-            gradient[i][0] += local[i][0];
-            gradient[i][1] += local[i][1];
+#pragma omp parallel num_threads(THREADS) reduction(+ : error)
+    {
+#ifdef _OPENMP
+        const int t = omp_get_thread_num();
+        const int nThreads = omp_get_num_threads();
+#else
+        const int t = 0, nThreads = 1;
+#endif
+
+        if (vector) {
+            // whole groups of 8 per thread keep the kernel's lanes full
+            const int groups = (count + 7) / 8;
+            const int start = 8 * (groups * t / nThreads);
+            const int end = std::min(count, 8 * (groups * (t + 1) / nThreads));
+
+            if (start < end)
+                error += gradientAVX2(batch + start, end - start, wmg, weg, K,
+                                      flocal[t]);
+        } else {
+#pragma omp for schedule(static)
+            for (int i = 0; i < count; i++) {
+                error += updateSingleGradient(batch[i], local[t], weights, K);
+            }
+        }
+
+#pragma omp barrier
+
+#pragma omp for schedule(static)
+        for (int f = 0; f < NUM_FEATURES; f++) {
+            double mg = 0, eg = 0;
+            if (vector) {
+                for (int i = 0; i < THREADS; i++) {
+                    mg += flocal[i][f][0];
+                    eg += flocal[i][f][1];
+                }
+            } else {
+#pragma omp simd reduction(+ : mg, eg)
+                for (int i = 0; i < THREADS; i++) {
+                    mg += local[i][f][0];
+                    eg += local[i][f][1];
+                }
+            }
+            gradient[f][0] += mg;
+            gradient[f][1] += eg;
         }
     }
+
+    return error;
 }
-// clang-format on
 
-void TunerEntries::updateSingleGradient(TEntry &entry,
-                                        double gradient[NUM_FEATURES][2],
-                                        double params[NUM_FEATURES][2],
-                                        double K) {
-    double E = entry.linearEval(params);
+// dE/dw is the coefficient scaled by the phase weight of w, the remaining
+// factors are applied by the caller. Returns the squared error.
+double TunerEntries::updateSingleGradient(std::size_t i,
+                                          double gradient[NUM_FEATURES][2],
+                                          double weights[NUM_FEATURES][2],
+                                          double K) {
+    double E = linearEval(i, weights);
     double S = sigmoid(K, E);
-    double X = (entry.result - S) * S * (1 - S);
+    double X = (data.result[i] - S) * S * (1 - S);
 
-    double mgBase = X * entry.mgPhase, egBase = X * entry.egPhase;
+    const double mgPhase = data.mgPhase[i], egPhase = 24 - mgPhase;
+    double mgBase = X * mgPhase / 24, egBase = X * egPhase / 24;
 
-    for (int i = 0; i < entry.nTuples; i++) {
-        int idx = entry.tuples[i].index;
-        int wcoeff = entry.tuples[i].whiteScore;
-        int bcoeff = entry.tuples[i].blackScore;
+    const std::uint32_t start = data.offset[i], end = data.offset[i + 1];
+    const std::uint16_t *index = &data.index[0];
+    const std::int8_t *coeff = &data.coeff[0];
 
-        gradient[idx][0] =
-              (wcoeff - bcoeff) * mgBase * ((double)entry.mgPhase / 24);
-        gradient[idx][1] =
-              (wcoeff - bcoeff) * egBase * ((double)entry.egPhase / 24);
+    for (std::uint32_t k = start; k < end; k++) {
+        gradient[index[k]][0] += coeff[k] * mgBase;
+        gradient[index[k]][1] += coeff[k] * egBase;
     }
+
+    return (data.result[i] - S) * (data.result[i] - S);
 }
 
-// clang-format off
-inline void printParams(double cparams[NUM_FEATURES][2], double params[NUM_FEATURES][2]) {
-    printf("\n");
-    printf("constexpr Score pawnScore   = S(%4d, %4d);\n", (int)cparams[0][0] + (int)params[0][0], (int)cparams[0][1] + (int)params[0][1]);
-    printf("constexpr Score knightScore = S(%4d, %4d);\n", (int)cparams[1][0] + (int)params[1][0], (int)cparams[1][1] + (int)params[1][1]);
-    printf("constexpr Score bishopScore = S(%4d, %4d);\n", (int)cparams[2][0] + (int)params[2][0], (int)cparams[2][1] + (int)params[2][1]);
-    printf("constexpr Score rookScore   = S(%4d, %4d);\n", (int)cparams[3][0] + (int)params[3][0], (int)cparams[3][1] + (int)params[3][1]);
-    printf("constexpr Score queenScore  = S(%4d, %4d);\n\n", (int)cparams[4][0] + (int)params[4][0], (int)cparams[4][1] + (int)params[4][1]);
-
-    printf("constexpr Score taperedPawnPcSq[SQUARE_CT] = {");
-    for (int i = 0, start = 5; i < 64; i++) {
-        if (!(i % 8))
-            printf("\n");
-        printf("S(%4d, %4d), ", (int)cparams[start + i][0] + (int)params[start + i][0], (int)cparams[start + i][1] + (int)params[start + i][1]);
-    }
-    printf("\n};\n");
-
-    printf("constexpr Score taperedKnightPcSq[SQUARE_CT] = {");
-    for (int i = 0, start = 69; i < 64; i++) {
-        if (!(i % 8))
-            printf("\n");
-        printf("S(%4d, %4d), ", (int)cparams[start + i][0] + (int)params[start + i][0], (int)cparams[start + i][1] + (int)params[start + i][1]);
-    }
-    printf("\n};\n");
-
-    printf("constexpr Score taperedBishopPcSq[SQUARE_CT] = {");
-    for (int i = 0, start = 133; i < 64; i++) {
-        if (!(i % 8))
-            printf("\n");
-        printf("S(%4d, %4d), ", (int)cparams[start + i][0] + (int)params[start + i][0], (int)cparams[start + i][1] + (int)params[start + i][1]);
-    }
-    printf("\n};\n");
-
-    printf("constexpr Score taperedRookPcSq[SQUARE_CT] = {");
-    for (int i = 0, start = 197; i < 64; i++) {
-        if (!(i % 8))
-            printf("\n");
-        printf("S(%4d, %4d), ", (int)cparams[start + i][0] + (int)params[start + i][0], (int)cparams[start + i][1] + (int)params[start + i][1]);
-    }
-    printf("\n};\n");
-
-    printf("constexpr Score taperedQueenPcSq[SQUARE_CT] = {");
-    for (int i = 0, start = 261; i < 64; i++) {
-        if (!(i % 8))
-            printf("\n");
-        printf("S(%4d, %4d), ", (int)cparams[start + i][0] + (int)params[start + i][0], (int)cparams[start + i][1] + (int)params[start + i][1]);
-    }
-    printf("\n};\n");
-
-    printf("constexpr Score taperedKingPcSq[SQUARE_CT] = {");
-    for (int i = 0, start = 325; i < 64; i++) {
-        if (!(i % 8))
-            printf("\n");
-        printf("S(%4d, %4d), ", (int)cparams[start + i][0] + (int)params[start + i][0], (int)cparams[start + i][1] + (int)params[start + i][1]);
-    }
-    printf("\n};\n");
-
-    printf("constexpr Score passedPawnRankBonus[8] = {");
-    for (int i = 0, start = 389; i < 8; i++) {
-        if (!(i % 4))
-            printf("\n");
-        printf("S(%4d, %4d), ", (int)cparams[start + i][0] + (int)params[start + i][0], (int)cparams[start + i][1] + (int)params[start + i][1]);
-    }
-    printf("\n};\n");
-
-    printf("constexpr Score doubledPawnRankBonus[8] = {");
-    for (int i = 0, start = 397; i < 8; i++) {
-        if (!(i % 4))
-            printf("\n");
-        printf("S(%4d, %4d), ", (int)cparams[start + i][0] + (int)params[start + i][0], (int)cparams[start + i][1] + (int)params[start + i][1]);
-    }
-    printf("\n};\n");
-
-    printf("constexpr Score isolatedPawnRankBonus[8] = {");
-    for (int i = 0, start = 405; i < 8; i++) {
-        if (!(i % 4))
-            printf("\n");
-        printf("S(%4d, %4d), ", (int)cparams[start + i][0] + (int)params[start + i][0], (int)cparams[start + i][1] + (int)params[start + i][1]);
-    }
-    printf("\n};\n");
-
-    printf("constexpr Score backwardPawnRankBonus[8] = {");
-    for (int i = 0, start = 413; i < 8; i++) {
-        if (!(i % 4))
-            printf("\n");
-        printf("S(%4d, %4d), ", (int)cparams[start + i][0] + (int)params[start + i][0], (int)cparams[start + i][1] + (int)params[start + i][1]);
-    }
-    printf("\n};\n");
-
-    printf("constexpr Score KnightMobilityScore[9] = {");
-    for (int i = 0, start = 421; i < 9; i++) {
-        if (!(i % 4))
-            printf("\n");
-        printf("S(%4d, %4d), ", (int)cparams[start + i][0] + (int)params[start + i][0], (int)cparams[start + i][1] + (int)params[start + i][1]);
-    }
-    printf("\n};\n");
-
-    printf("constexpr Score BishopMobilityScore[14] = {");
-    for (int i = 0, start = 430; i < 14; i++) {
-        if (!(i % 4))
-            printf("\n");
-        printf("S(%4d, %4d), ", (int)cparams[start + i][0] + (int)params[start + i][0], (int)cparams[start + i][1] + (int)params[start + i][1]);
+// Times full passes of the scalar and the vector gradient over every entry
+// and checks that they agree.
+void TunerEntries::benchmark() {
+    std::vector<int> all(nEntries);
+    for (int i = 0; i < nEntries; i++)
+        all[i] = i;
+
+    double weights[NUM_FEATURES][2];
+    const Score *w = (const Score *)&evalWeights;
+    for (int i = 0; i < NUM_FEATURES; i++) {
+        weights[i][0] = MgScore(w[i]);
+        weights[i][1] = EgScore(w[i]);
+    }
+
+    const double K = 1.0;
+    const int passes = std::max(5, 20000000 / std::max(1, nEntries));
+    double gradient[2][NUM_FEATURES][2] = {{{0}}};
+    double error[2] = {0}, rate[2] = {0};
+
+    for (int vector = 0; vector < 1 + simd; vector++) {
+        const std::uint64_t start = get_time();
+        for (int p = 0; p < passes; p++) {
+            std::memset(gradient[vector], 0, sizeof(gradient[vector]));
+            error[vector] = computeGradient(gradient[vector], weights, K,
+                                            &all[0], nEntries, vector);
+        }
+
+        const std::uint64_t elapsed =
+              std::max<std::uint64_t>(1, get_time() - start);
+        rate[vector] = 1000.0 * passes * nEntries / elapsed;
+        printf("%-6s %12.0f positions/s  error = [%.9f]\n",
+               vector ? "avx2" : "scalar", rate[vector],
+               error[vector] / nEntries);
+    }
+
+    if (!simd) {
+        printf("no avx2 on this cpu\n");
+        return;
     }
-    printf("\n};\n");
 
-    printf("constexpr Score RookMobilityScore[15] = {");
-    for (int i = 0, start = 444; i < 15; i++) {
-        if (!(i % 4))
-            printf("\n");
-        printf("S(%4d, %4d), ", (int)cparams[start + i][0] + (int)params[start + i][0], (int)cparams[start + i][1] + (int)params[start + i][1]);
+    double worst = 0, scale = 0;
+    for (int f = 0; f < NUM_FEATURES; f++) {
+        for (int j = 0; j < 2; j++) {
+            worst = std::max(worst,
+                             fabs(gradient[0][f][j] - gradient[1][f][j]));
+            scale = std::max(scale, fabs(gradient[0][f][j]));
+        }
     }
-    printf("\n};\n");
 
-    printf("constexpr Score QueenMobilityScore[28] = {");
-    for (int i = 0, start = 459; i < 28; i++) {
-        if (!(i % 4))
-            printf("\n");
-        printf("S(%4d, %4d), ", (int)cparams[start + i][0] + (int)params[start + i][0], (int)cparams[start + i][1] + (int)params[start + i][1]);
+    printf("speedup %.2fx, max gradient difference %.3g of %.3g\n",
+           rate[1] / rate[0], worst, scale);
+}
+
+bool Optimizer::save(std::FILE *file) const {
+    return std::fwrite(m, sizeof(m), 1, file) == 1 &&
+           std::fwrite(v, sizeof(v), 1, file) == 1 &&
+           std::fwrite(&steps, sizeof(steps), 1, file) == 1;
+}
+
+bool Optimizer::load(std::FILE *file) {
+    return std::fread(m, sizeof(m), 1, file) == 1 &&
+           std::fread(v, sizeof(v), 1, file) == 1 &&
+           std::fread(&steps, sizeof(steps), 1, file) == 1;
+}
+
+void AdaGrad::step(double weights[NUM_FEATURES][2],
+                   double gradient[NUM_FEATURES][2], double rate) {
+    steps++;
+    for (int i = 0; i < NUM_FEATURES; i++) {
+        for (int j = 0; j < 2; j++) {
+            v[i][j] += gradient[i][j] * gradient[i][j];
+            weights[i][j] -= rate * gradient[i][j] / sqrt(1e-16 + v[i][j]);
+        }
     }
-    printf("\n};\n");
 }
-// clang-format on
 
-void TunerEntries::initUntunedWeights(double weights[NUM_FEATURES][2]) {
-    Score *_w = &((Score *)&entries[0].w)[0];
+void Adam::step(double weights[NUM_FEATURES][2],
+                double gradient[NUM_FEATURES][2], double rate) {
+    steps++;
+    const double c1 = 1.0 - pow(ADAM_BETA1, steps);
+    const double c2 = 1.0 - pow(ADAM_BETA2, steps);
+
     for (int i = 0; i < NUM_FEATURES; i++) {
-        weights[i][0] = MgScore(_w[i]);
-        weights[i][1] = EgScore(_w[i]);
+        for (int j = 0; j < 2; j++) {
+            const double g = gradient[i][j];
+            m[i][j] = ADAM_BETA1 * m[i][j] + (1.0 - ADAM_BETA1) * g;
+            v[i][j] = ADAM_BETA2 * v[i][j] + (1.0 - ADAM_BETA2) * g * g;
+            weights[i][j] -=
+                  rate * (m[i][j] / c1) / (sqrt(v[i][j] / c2) + 1e-12);
+        }
     }
 }
 
-void TunerEntries::runTuner() {
-    double params[NUM_FEATURES][2] = {0}, cparams[NUM_FEATURES][2] = {0},
-           adagrad[NUM_FEATURES][2] = {0};
+void MomentumSGD::step(double weights[NUM_FEATURES][2],
+                       double gradient[NUM_FEATURES][2], double rate) {
+    steps++;
+    for (int i = 0; i < NUM_FEATURES; i++) {
+        for (int j = 0; j < 2; j++) {
+            m[i][j] = SGD_MOMENTUM * m[i][j] - rate * gradient[i][j];
+            weights[i][j] += m[i][j];
+        }
+    }
+}
 
-    double K, prev_err, error, rate = LRRATE;
+std::unique_ptr<Optimizer> makeOptimizer(const std::string &name) {
+    if (name == "adam")
+        return std::make_unique<Adam>();
+    if (name == "sgd")
+        return std::make_unique<MomentumSGD>();
+    if (name == "adagrad")
+        return std::make_unique<AdaGrad>();
+    return nullptr;
+}
 
-    K = computeOptimalK();
-    initUntunedWeights(cparams);
+namespace {
+
+// one declaration of weights.hpp, at its offset into the feature vector
+struct WeightBlock {
+    const char *name;
+    const char *size; // nullptr for a single Score
+    int start, count;
+};
+
+constexpr WeightBlock weightBlocks[] = {
+      {"pawnScore", nullptr, 0, 1},
+      {"knightScore", nullptr, 1, 1},
+      {"bishopScore", nullptr, 2, 1},
+      {"rookScore", nullptr, 3, 1},
+      {"queenScore", nullptr, 4, 1},
+      {"taperedPawnPcSq", "SQUARE_CT", 5, 64},
+      {"taperedKnightPcSq", "SQUARE_CT", 69, 64},
+      {"taperedBishopPcSq", "SQUARE_CT", 133, 64},
+      {"taperedRookPcSq", "SQUARE_CT", 197, 64},
+      {"taperedQueenPcSq", "SQUARE_CT", 261, 64},
+      {"taperedKingPcSq", "SQUARE_CT", 325, 64},
+      {"passedPawnRankBonus", "8", 389, 8},
+      {"doubledPawnRankBonus", "8", 397, 8},
+      {"isolatedPawnRankBonus", "8", 405, 8},
+      {"backwardPawnRankBonus", "8", 413, 8},
+      {"KnightMobilityScore", "9", 421, 9},
+      {"BishopMobilityScore", "14", 430, 14},
+      {"RookMobilityScore", "15", 444, 15},
+      {"QueenMobilityScore", "28", 459, 28},
+      {"kingAttackWeight", "4", 487, 4},
+      {"kingAttackerCount", "8", 491, 8},
+      {"safeCheckPenalty", "4", 499, 4},
+      {"kingShelterRank", "8", 503, 8},
+      {"kingStormRank", "8", 511, 8},
+};
+
+void writeBlocks(std::FILE *out, double weights[NUM_FEATURES][2],
+                 const char *qualifier, const char *indent) {
+    for (const auto &b : weightBlocks) {
+        if (!b.size) {
+            std::fprintf(out, "%s%s Score %s = S(%d, %d);\n", indent,
+                         qualifier, b.name, (int)lround(weights[b.start][0]),
+                         (int)lround(weights[b.start][1]));
+            if (b.start == 4)
+                std::fprintf(out, "\n");
+            continue;
+        }
 
-    prev_err = staticEvalErrors(K);
-    double init_err = 0;
+        std::fprintf(out, "%s%s Score %s[%s] = {", indent, qualifier, b.name,
+                     b.size);
+        for (int i = 0; i < b.count; i++) {
+            if (!(i % 4))
+                std::fprintf(out, "\n%s      ", indent);
+            std::fprintf(out, "S(%d, %d),%s",
+                         (int)lround(weights[b.start + i][0]),
+                         (int)lround(weights[b.start + i][1]),
+                         i % 4 == 3 || i == b.count - 1 ? "" : " ");
+        }
+        std::fprintf(out, "\n%s};\n", indent);
+    }
+}
 
-    int count = 0;
+} // namespace
 
-    std::ofstream out("new_weights.txt");
-    for (int epoch = 0; epoch < MAX_EPOCHS; epoch++) {
-        for (int batch = 0; batch < NUM_ENTRIES / BATCH_SIZE; batch++) {
-            double gradient[NUM_FEATURES][2] = {0};
-            computeGradient(gradient, params, K, batch);
+bool writeWeights(const std::string &path, double weights[NUM_FEATURES][2]) {
+    std::FILE *out = std::fopen(path.c_str(), "w");
+    if (!out)
+        return false;
 
-            for (int i = 1; i < NUM_FEATURES; i++) {
-                adagrad[i][0] += pow(2.0 * gradient[i][0] / BATCH_SIZE, 2.0);
-                adagrad[i][1] += pow(2.0 * gradient[i][1] / BATCH_SIZE, 2.0);
+    std::fprintf(out, "#ifndef WEIGHTS_H_\n#define WEIGHTS_H_\n"
+                      "#include \"util.hpp\"\n\n");
+    writeBlocks(out, weights, "constexpr", "");
+    std::fprintf(out, "\nstruct EvalWeights {\n");
+    writeBlocks(out, weights, "const", "    ");
+    std::fprintf(out, "};\n#endif // WEIGHTS_H_\n");
 
-                params[i][0] += (K * 2.0 / BATCH_SIZE) * gradient[i][0] *
-                                (rate / sqrt(1e-8 + adagrad[i][0]));
-                params[i][1] += (K * 2.0 / BATCH_SIZE) * gradient[i][1] *
-                                (rate / sqrt(1e-8 + adagrad[i][1]));
-            }
+    return std::fclose(out) == 0;
+}
+
+namespace {
+
+bool saveCheckpoint(const std::string &path, const TunerCheckpoint &ckpt,
+                    const Optimizer &opt) {
+    const std::string tmp = path + ".tmp";
+    std::FILE *file = std::fopen(tmp.c_str(), "wb");
+    if (!file)
+        return false;
+
+    bool ok = std::fwrite(&ckpt, sizeof(ckpt), 1, file) == 1 && opt.save(file);
+    ok = std::fclose(file) == 0 && ok;
+
+    return ok && std::rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+bool loadCheckpoint(const std::string &path, TunerCheckpoint &ckpt,
+                    Optimizer &opt) {
+    std::FILE *file = std::fopen(path.c_str(), "rb");
+    if (!file)
+        return false;
+
+    bool ok = std::fread(&ckpt, sizeof(ckpt), 1, file) == 1 &&
+              ckpt.magic == CHECKPOINT_MAGIC &&
+              ckpt.features == NUM_FEATURES &&
+              !std::strcmp(ckpt.optimizer, opt.name()) && opt.load(file);
+    std::fclose(file);
+    return ok;
+}
+
+} // namespace
+
+// Shuffles the positions once with a fixed seed and holds back the tail for
+// validation, so a resumed run sees the same split.
+void TunerEntries::splitValidation() {
+    std::vector<int> order(nEntries);
+    for (int i = 0; i < nEntries; i++)
+        order[i] = i;
+
+    std::shuffle(order.begin(), order.end(), std::mt19937_64(0x7E5E1));
+
+    const int nValid = (long)nEntries * VALIDATION_PERCENT / 100;
+    train.assign(order.begin(), order.end() - nValid);
+    valid.assign(order.end() - nValid, order.end());
+}
+
+void TunerEntries::runTuner(const std::string &optimizer, bool resume) {
+    std::unique_ptr<Optimizer> opt = makeOptimizer(optimizer);
+    if (!opt) {
+        std::cerr << "ERROR: UNKNOWN OPTIMIZER " << optimizer << "\n";
+        return;
+    }
+
+    splitValidation();
+    if (train.empty() || valid.empty()) {
+        std::cerr << "ERROR: NOT ENOUGH TUNER ENTRIES\n";
+        return;
+    }
+
+    TunerCheckpoint ckpt = {};
+    double(*weights)[2] = ckpt.weights;
+    double(*best)[2] = ckpt.best;
+
+    if (resume && loadCheckpoint("tuner.ckpt", ckpt, *opt)) {
+        std::cout << "resuming " << opt->name() << " at epoch " << ckpt.epoch
+                  << "\n";
+    } else {
+        if (resume)
+            std::cerr << "no usable checkpoint, starting over\n";
+
+        ckpt.magic = CHECKPOINT_MAGIC;
+        ckpt.features = NUM_FEATURES;
+        std::snprintf(ckpt.optimizer, sizeof(ckpt.optimizer), "%s",
+                      opt->name());
+        ckpt.K = computeOptimalK();
+        ckpt.rate = opt->defaultRate();
+
+        const Score *w = (const Score *)&evalWeights;
+        for (int i = 0; i < NUM_FEATURES; i++) {
+            weights[i][0] = best[i][0] = MgScore(w[i]);
+            weights[i][1] = best[i][1] = EgScore(w[i]);
         }
 
-        error = tunedEvalErrors(params, K);
+        ckpt.bestError = tunedEvalErrors(weights, ckpt.K, valid);
+    }
+
+    const double K = ckpt.K;
+    const int startEpoch = ckpt.epoch;
+    const std::uint64_t startTime = get_time();
 
-        if (init_err == 0)
-            init_err = error;
+    printf("%d training, %d validation entries, initial error = [%.9f]\n",
+           (int)train.size(), (int)valid.size(), ckpt.bestError);
 
-        if (epoch && epoch % LRSTEPRATE == 0)
-            rate = rate / LRDROPRATE;
-        if (rate <= 0.1)
-            rate = 0.1;
+    std::vector<int> order;
+    for (int epoch = startEpoch; epoch < MAX_EPOCHS; epoch++) {
+        double trainError = 0;
 
-        if (prev_err - error < 0) {
-            count++;
+        // the order depends only on the epoch, so a resumed run replays it
+        order = train;
+        std::shuffle(order.begin(), order.end(), std::mt19937_64(epoch));
 
-            if (count == 50) {
-                break;
+        for (std::size_t start = 0; start < order.size(); start += BATCH_SIZE) {
+            const int count =
+                  std::min<std::size_t>(BATCH_SIZE, order.size() - start);
+
+            double gradient[NUM_FEATURES][2] = {{0}};
+            trainError += computeGradient(gradient, weights, K, &order[start],
+                                          count, simd);
+
+            // gradient of the mean squared error, the pawn value stays put
+            const double scale = -K / 200.0 / count;
+            for (int i = 0; i < NUM_FEATURES; i++) {
+                gradient[i][0] *= i ? scale : 0;
+                gradient[i][1] *= i ? scale : 0;
             }
+
+            opt->step(weights, gradient, ckpt.rate);
+        }
+
+        // averaged over the epoch as the weights moved
+        trainError /= order.size();
+        const double validError = tunedEvalErrors(weights, K, valid);
+
+        if (validError < ckpt.bestError) {
+            ckpt.bestError = validError;
+            ckpt.stale = 0;
+            std::memcpy(best, weights, sizeof(ckpt.best));
         } else {
-            count = 0;
+            ckpt.stale++;
         }
 
-        if (epoch % REPORTING == 0) {
-            printParams(cparams, params);
+        ckpt.epoch = epoch + 1;
+        if (ckpt.epoch % LRSTEPRATE == 0)
+            ckpt.rate = ckpt.rate / LRDROPRATE;
 
-            for (int i = 0; i < NUM_FEATURES; i++) {
-                out << "index: " << i << ", "
-                    << "deltaMg: " << params[i][0]
-                    << ", deltaEg: " << params[i][1] << std::endl;
+        const bool done = ckpt.stale >= EARLY_STOPPING;
+
+        if (done || ckpt.epoch % REPORTING == 0)
+            writeWeights("weights.hpp", best);
+        if (done || ckpt.epoch % CHECKPOINT_RATE == 0)
+            saveCheckpoint("tuner.ckpt", ckpt, *opt);
+
+        printf("Epoch  [%d]  Rate = [%g], Train = [%.9f], Valid = [%.9f], "
+               "Best = [%.9f];   Speed = [%.2f epochs/s]\n",
+               epoch, ckpt.rate, trainError, validError, ckpt.bestError,
+               (epoch + 1 - startEpoch) * 1000.0 /
+                     std::max<std::uint64_t>(1, get_time() - startTime));
+
+        if (done) {
+            printf("no improvement for %d epochs, stopping\n",
+                   EARLY_STOPPING);
+            break;
+        }
+    }
+
+    writeWeights("weights.hpp", best);
+}
+NNUETrainer::NNUETrainer(const std::string &file) {
+    if (!dataset.open(file)) {
+        std::cerr << "ERROR: NNUE TRAINING NEEDS A PACKED DATASET, SEE "
+                     "yayo convert\n";
+        return;
+    }
+
+    // the same fixed split as the tuner
+    std::vector<int> order(dataset.size());
+    for (std::size_t i = 0; i < order.size(); i++)
+        order[i] = i;
+    std::shuffle(order.begin(), order.end(), std::mt19937_64(0x7E5E1));
+
+    const std::size_t nValid = order.size() * VALIDATION_PERCENT / 100;
+    train.assign(order.begin(), order.end() - nValid);
+    valid.assign(order.end() - nValid, order.end());
+
+    params = std::make_unique<NNUEParams>();
+    bestParams = std::make_unique<NNUEParams>();
+    m = std::make_unique<NNUEParams>();
+    v = std::make_unique<NNUEParams>();
+    std::memset(m.get(), 0, sizeof(NNUEParams));
+    std::memset(v.get(), 0, sizeof(NNUEParams));
+
+    for (int t = 0; t < THREADS; t++) {
+        grads.push_back(std::make_unique<NNUEParams>());
+        std::memset(grads.back().get(), 0, sizeof(NNUEParams));
+        touched.emplace_back(NNUE_INPUTS, 0);
+    }
+
+    // uniform in 1 / sqrt(fan in), about 32 inputs are active in the first
+    // layer
+    std::mt19937_64 rng(0x4E4E5545);
+    auto init = [&](float *w, int count, double fanIn) {
+        std::uniform_real_distribution<float> dist(-1.0 / sqrt(fanIn),
+                                                   1.0 / sqrt(fanIn));
+        for (int i = 0; i < count; i++)
+            w[i] = dist(rng);
+    };
+
+    NNUEParams &p = *params;
+    std::memset(&p, 0, sizeof(p));
+    init(&p.ftWeights[0][0], NNUE_INPUTS * NNUE_HIDDEN, 32);
+    init(&p.l2Weights[0][0], NNUE_L2 * 2 * NNUE_HIDDEN, 2 * NNUE_HIDDEN);
+    init(&p.l3Weights[0][0], NNUE_L3 * NNUE_L2, NNUE_L2);
+    init(p.outWeights, NNUE_L3, NNUE_L3);
+    std::memcpy(bestParams.get(), &p, sizeof(p));
+
+    std::cout << "loaded " << dataset.size() << " positions, " << train.size()
+              << " training, " << valid.size() << " validation\n";
+}
+
+// Runs one position through the network and returns its squared error. With
+// a gradient buffer it also backpropagates into it, marking the first layer
+// rows it touched.
+float NNUETrainer::forward(const PackedPos &pos, NNUEParams *grad,
+                           std::uint8_t *rows, double lambda,
+                           float *output) const {
+    const NNUEParams &p = *params;
+
+    // decode the pieces straight from the packed position
+    Piece pcs[32];
+    Square sqs[32], ksq[2] = {SQUARE_64, SQUARE_64};
+    int n = 0;
+    for (Bitboard occ = pos.occupancy; occ; occ &= occ - 1, n++) {
+        sqs[n] = Square(lsb_index(occ));
+        pcs[n] = Piece((pos.pieces[n / 2] >> (4 * (n & 1))) & 15);
+        if (getPcType(pcs[n]) == KING)
+            ksq[pcs[n] >> 3] = sqs[n];
+    }
+
+    const Color stm = Color(pos.turn);
+    int features[2][32];
+    for (int side = 0; side < 2; side++) {
+        const Color persp = side ? ~stm : stm;
+        for (int i = 0; i < n; i++)
+            features[side][i] = nnueFeature(persp, ksq[persp], pcs[i], sqs[i]);
+    }
+
+    // the side to move's half first, as in the engine
+    alignas(32) float acc[2 * NNUE_HIDDEN], a2[NNUE_L2], a3[NNUE_L3];
+    for (int side = 0; side < 2; side++) {
+        float *a = acc + side * NNUE_HIDDEN;
+        std::memcpy(a, p.ftBias, sizeof(p.ftBias));
+        for (int i = 0; i < n; i++) {
+            const float *row = p.ftWeights[features[side][i]];
+#pragma omp simd
+            for (int j = 0; j < NNUE_HIDDEN; j++)
+                a[j] += row[j];
+        }
+    }
+
+    float a1[2 * NNUE_HIDDEN];
+    for (int j = 0; j < 2 * NNUE_HIDDEN; j++)
+        a1[j] = std::clamp(acc[j], 0.0f, 1.0f);
+
+    float z2[NNUE_L2], z3[NNUE_L3];
+    for (int o = 0; o < NNUE_L2; o++) {
+        float sum = p.l2Bias[o];
+#pragma omp simd reduction(+ : sum)
+        for (int j = 0; j < 2 * NNUE_HIDDEN; j++)
+            sum += p.l2Weights[o][j] * a1[j];
+        z2[o] = sum;
+        a2[o] = std::clamp(sum, 0.0f, 1.0f);
+    }
+
+    for (int o = 0; o < NNUE_L3; o++) {
+        float sum = p.l3Bias[o];
+        for (int j = 0; j < NNUE_L2; j++)
+            sum += p.l3Weights[o][j] * a2[j];
+        z3[o] = sum;
+        a3[o] = std::clamp(sum, 0.0f, 1.0f);
+    }
+
+    float out = p.outBias;
+    for (int j = 0; j < NNUE_L3; j++)
+        out += p.outWeights[j] * a3[j];
+
+    // an output of 1.0 is NNUE_SCALE centipawns, the sigmoid maps those the
+    // way the data's scores are mapped
+    const float predicted = 1.0f / (1.0f + std::exp(-out));
+    float target = pos.result / 2.0f;
+    if (stm == BLACK)
+        target = 1.0f - target;
+    if (pos.score != PACKED_NO_SCORE) {
+        const float score = stm == WHITE ? pos.score : -pos.score;
+        const float wdl = 1.0f / (1.0f + std::exp(-score / NNUE_SCALE));
+        target = lambda * wdl + (1.0 - lambda) * target;
+    }
+
+    const float error = predicted - target;
+    if (output)
+        *output = out * NNUE_SCALE;
+    if (!grad)
+        return error * error;
+
+    const float dOut = 2.0f * error * predicted * (1.0f - predicted);
+    float d3[NNUE_L3], d2[NNUE_L2], d1[2 * NNUE_HIDDEN] = {0};
+
+    grad->outBias += dOut;
+    for (int j = 0; j < NNUE_L3; j++) {
+        grad->outWeights[j] += dOut * a3[j];
+        d3[j] = z3[j] > 0.0f && z3[j] < 1.0f ? dOut * p.outWeights[j] : 0.0f;
+    }
+
+    for (int j = 0; j < NNUE_L2; j++)
+        d2[j] = 0.0f;
+    for (int o = 0; o < NNUE_L3; o++) {
+        grad->l3Bias[o] += d3[o];
+        for (int j = 0; j < NNUE_L2; j++) {
+            grad->l3Weights[o][j] += d3[o] * a2[j];
+            d2[j] += d3[o] * p.l3Weights[o][j];
+        }
+    }
+
+    for (int o = 0; o < NNUE_L2; o++) {
+        const float d = z2[o] > 0.0f && z2[o] < 1.0f ? d2[o] : 0.0f;
+        if (d == 0.0f)
+            continue;
+
+        grad->l2Bias[o] += d;
+#pragma omp simd
+        for (int j = 0; j < 2 * NNUE_HIDDEN; j++) {
+            grad->l2Weights[o][j] += d * a1[j];
+            d1[j] += d * p.l2Weights[o][j];
+        }
+    }
+
+    for (int j = 0; j < 2 * NNUE_HIDDEN; j++)
+        if (acc[j] <= 0.0f || acc[j] >= 1.0f)
+            d1[j] = 0.0f;
+
+    // only the rows of the active features get a gradient
+    for (int side = 0; side < 2; side++) {
+        const float *d = d1 + side * NNUE_HIDDEN;
+        for (int j = 0; j < NNUE_HIDDEN; j++)
+            grad->ftBias[j] += d[j];
+
+        for (int i = 0; i < n; i++) {
+            float *row = grad->ftWeights[features[side][i]];
+            rows[features[side][i]] = 1;
+#pragma omp simd
+            for (int j = 0; j < NNUE_HIDDEN; j++)
+                row[j] += d[j];
+        }
+    }
+
+    return error * error;
+}
+
+namespace {
+
+// Adam on a run of weights, leaving the gradient zeroed for the next batch
+void adam(float *w, float *g, float *m, float *v, int count, float rate,
+          float c1, float c2, float clip, float scale) {
+    for (int i = 0; i < count; i++) {
+        const float grad = g[i] * scale;
+        m[i] = ADAM_BETA1 * m[i] + (1.0f - ADAM_BETA1) * grad;
+        v[i] = ADAM_BETA2 * v[i] + (1.0f - ADAM_BETA2) * grad * grad;
+        w[i] -= rate * (m[i] / c1) / (std::sqrt(v[i] / c2) + 1e-8f);
+        w[i] = std::clamp(w[i], -clip, clip);
+        g[i] = 0.0f;
+    }
+}
+
+} // namespace
+
+// Sums the thread gradients and applies their mean over the batch. First
+// layer rows no position in the batch touched are skipped, their moments
+// included.
+void NNUETrainer::step(float rate, std::uint64_t steps, int count) {
+    const float c1 = 1.0 - pow(ADAM_BETA1, steps);
+    const float c2 = 1.0 - pow(ADAM_BETA2, steps);
+    const float scale = 1.0f / count;
+
+    // int16 accumulators hold about 32 active rows, the int32 biases are
+    // practically unbounded
+    const float ftClip = 32767.0f / NNUE_QA / 32;
+    const float biasClip = 1e6f;
+
+    NNUEParams &g0 = *grads[0];
+
+#pragma omp parallel for schedule(dynamic, 16) num_threads(THREADS)
+    for (int f = 0; f < NNUE_INPUTS; f++) {
+        bool any = false;
+        for (int t = 0; t < THREADS; t++) {
+            if (!touched[t][f])
+                continue;
+
+            any = true;
+            touched[t][f] = 0;
+            if (t) {
+                float *row = grads[t]->ftWeights[f];
+                for (int j = 0; j < NNUE_HIDDEN; j++) {
+                    g0.ftWeights[f][j] += row[j];
+                    row[j] = 0.0f;
+                }
             }
+        }
+
+        if (any)
+            adam(params->ftWeights[f], g0.ftWeights[f], m->ftWeights[f],
+                 v->ftWeights[f], NNUE_HIDDEN, rate, c1, c2, ftClip, scale);
+    }
 
-            out << "-----------------------" << std::endl;
-            out << std::endl;
+    // everything after the first layer weights is dense and small
+    const std::size_t dense = offsetof(NNUEParams, ftBias) / sizeof(float);
+    const std::size_t total = sizeof(NNUEParams) / sizeof(float);
+    for (int t = 1; t < THREADS; t++) {
+        float *sum = (float *)&g0, *g = (float *)grads[t].get();
+        for (std::size_t i = dense; i < total; i++) {
+            sum[i] += g[i];
+            g[i] = 0.0f;
         }
+    }
+
+    auto block = [&](std::size_t offset, int size, float clip) {
+        offset /= sizeof(float);
+        adam((float *)params.get() + offset, (float *)&g0 + offset,
+             (float *)m.get() + offset, (float *)v.get() + offset, size, rate,
+             c1, c2, clip, scale);
+    };
+
+    block(offsetof(NNUEParams, ftBias), NNUE_HIDDEN, ftClip);
+    block(offsetof(NNUEParams, l2Weights), NNUE_L2 * 2 * NNUE_HIDDEN,
+          NNUE_WEIGHT_CLIP);
+    block(offsetof(NNUEParams, l2Bias), NNUE_L2, biasClip);
+    block(offsetof(NNUEParams, l3Weights), NNUE_L3 * NNUE_L2,
+          NNUE_WEIGHT_CLIP);
+    block(offsetof(NNUEParams, l3Bias), NNUE_L3, biasClip);
+    block(offsetof(NNUEParams, outWeights), NNUE_L3, NNUE_WEIGHT_CLIP);
+    block(offsetof(NNUEParams, outBias), 1, biasClip);
+}
 
-        if (error - (init_err - 0.001) <= 0) {
-            init_err = error;
+double NNUETrainer::validationLoss(double lambda) const {
+    double loss = 0;
+
+#pragma omp parallel for reduction(+ : loss) num_threads(THREADS)
+    for (std::size_t i = 0; i < valid.size(); i++)
+        loss += forward(dataset[valid[i]], nullptr, nullptr, lambda);
+
+    return loss / valid.size();
+}
+
+// rounds the weights into the engine's fixed point layout
+bool NNUETrainer::exportNetwork(const std::string &path) const {
+    const NNUEParams &p = *params;
+    NNUE out;
+    out.net = std::make_unique<Network>();
+    Network &net = *out.net;
+
+    auto q = [](double x, double scale, double limit) {
+        return std::clamp(std::round(x * scale), -limit, limit);
+    };
+
+    for (int f = 0; f < NNUE_INPUTS; f++)
+        for (int j = 0; j < NNUE_HIDDEN; j++)
+            net.ftWeights[f][j] = q(p.ftWeights[f][j], NNUE_QA, 32767);
+    for (int j = 0; j < NNUE_HIDDEN; j++)
+        net.ftBias[j] = q(p.ftBias[j], NNUE_QA, 32767);
+
+    for (int o = 0; o < NNUE_L2; o++) {
+        net.l2Bias[o] = q(p.l2Bias[o], NNUE_QA * NNUE_QB, 1 << 30);
+        for (int j = 0; j < 2 * NNUE_HIDDEN; j++)
+            net.l2Weights[o][j] = q(p.l2Weights[o][j], NNUE_QB, 127);
+    }
+
+    for (int o = 0; o < NNUE_L3; o++) {
+        net.l3Bias[o] = q(p.l3Bias[o], NNUE_QA * NNUE_QB, 1 << 30);
+        for (int j = 0; j < NNUE_L2; j++)
+            net.l3Weights[o][j] = q(p.l3Weights[o][j], NNUE_QB, 127);
+    }
+
+    net.outBias = q(p.outBias, NNUE_QA * NNUE_QB, 1 << 30);
+    for (int j = 0; j < NNUE_L3; j++)
+        net.outWeights[j] = q(p.outWeights[j], NNUE_QB, 127);
+
+    return out.save(path);
+}
+
+void NNUETrainer::run(const std::string &out, int epochs, double rate,
+                      double lambda) {
+    if (train.empty() || valid.empty()) {
+        std::cerr << "ERROR: NOT ENOUGH TRAINING POSITIONS\n";
+        return;
+    }
+
+    double best = validationLoss(lambda);
+    printf("%d training, %d validation positions, initial loss = [%.9f]\n",
+           (int)train.size(), (int)valid.size(), best);
+
+    std::uint64_t steps = 0;
+    std::vector<int> order;
+    for (int epoch = 0; epoch < epochs; epoch++) {
+        const std::uint64_t start = get_time();
+        double trainLoss = 0;
+
+        order = train;
+        std::shuffle(order.begin(), order.end(), std::mt19937_64(epoch));
+
+        for (std::size_t b = 0; b < order.size(); b += NNUE_TRAIN_BATCH) {
+            const int count =
+                  std::min<std::size_t>(NNUE_TRAIN_BATCH, order.size() - b);
+            double loss = 0;
+
+#pragma omp parallel num_threads(THREADS) reduction(+ : loss)
+            {
+#ifdef _OPENMP
+                const int t = omp_get_thread_num();
+#else
+                const int t = 0;
+#endif
+#pragma omp for schedule(static)
+                for (int i = 0; i < count; i++)
+                    loss += forward(dataset[order[b + i]], grads[t].get(),
+                                    touched[t].data(), lambda);
+            }
+
+            step(rate, ++steps, count);
+            trainLoss += loss;
         }
 
-        printf("Epoch  [%d]  Rate = [%g], ", epoch, rate);
-        std::cout.precision(std::numeric_limits<double>::max_digits10);
-        std::cout << "Error = [" << error << "];  "
-                  << "ΔErr = [" << std::fixed << prev_err - error << "]"
-                  << ";   TT1 = [" << std::fixed
-                  << (error - (init_err - 0.001)) / (prev_err - error) << "]"
-                  << "\n";
+        trainLoss /= order.size();
+        const double validLoss = validationLoss(lambda);
+        const double secs =
+              std::max<std::uint64_t>(1, get_time() - start) / 1000.0;
+
+        if (validLoss < best) {
+            best = validLoss;
+            std::memcpy(bestParams.get(), params.get(), sizeof(NNUEParams));
+            if (!exportNetwork(out))
+                std::cerr << "ERROR: COULD NOT WRITE " << out << "\n";
+        }
+
+        printf("Epoch  [%d]  Rate = [%g], Train = [%.9f], Valid = [%.9f], "
+               "Best = [%.9f];   Speed = [%.0f positions/s]\n",
+               epoch, rate, trainLoss, validLoss, best,
+               order.size() / secs);
+        fflush(stdout);
 
-        prev_err = error;
+        if ((epoch + 1) % NNUE_TRAIN_DROP == 0)
+            rate *= NNUE_TRAIN_GAMMA;
     }
+
+    // what rounding cost, on the engine's own inference
+    std::swap(params, bestParams);
+    NNUE check;
+    if (!exportNetwork(out) || !check.load(out)) {
+        std::cerr << "ERROR: COULD NOT READ BACK " << out << "\n";
+        return;
+    }
+
+    const std::size_t samples = std::min<std::size_t>(valid.size(), 10000);
+    double diff = 0;
+    Board board;
+    for (std::size_t i = 0; i < samples; i++) {
+        float reference;
+        forward(dataset[valid[i]], nullptr, nullptr, lambda, &reference);
+        unpack(dataset[valid[i]], board);
+        diff += std::abs(check.evaluate(board) - reference);
+    }
+    printf("wrote %s, quantization error %.2f cp\n", out.c_str(),
+           diff / samples);
 }
+
 } // namespace Yayo
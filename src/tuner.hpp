@@ -1,68 +1,219 @@
 #ifndef TUNER_H_
 #define TUNER_H_
 
+#include "dataset.hpp"
 #include "eval.hpp"
+#include "nnue.hpp"
 #include "thread.hpp"
+#include <cstdint>
+#include <cstdio>
 #include <fstream>
+#include <memory>
+#include <vector>
 
 #define NUM_ENTRIES 500000
 #define MAX_EPOCHS 100000
-#define BATCH_SIZE 500000
-#define LRRATE 0.10
+#define BATCH_SIZE 16384
 #define LRDROPRATE 2.00
 #define LRSTEPRATE 500
 #define REPORTING 50
-#define NUM_FEATURES 487
+#define CHECKPOINT_RATE 10
+#define VALIDATION_PERCENT 10
+#define EARLY_STOPPING 50
+#define ADAM_BETA1 0.9
+#define ADAM_BETA2 0.999
+#define SGD_MOMENTUM 0.9
+#define NUM_FEATURES 519
+#define LOAD_CHUNK (1 << 20)
+#define QS_MAX_PLY 32
+#define NNUE_TRAIN_BATCH 16384
+#define NNUE_TRAIN_EPOCHS 40
+#define NNUE_TRAIN_RATE 0.001
+#define NNUE_TRAIN_DROP 15
+#define NNUE_TRAIN_GAMMA 0.3
+// weight of the search score against the game result in the target
+#define NNUE_TRAIN_LAMBDA 0.75
+// int8 layers hold weights up to 127 / QB
+#define NNUE_WEIGHT_CLIP (127.0f / NNUE_QB)
 
 namespace Yayo {
 double sigmoid(double K, double E);
 
-struct TTuple {
-    int index = 0;
-    int whiteScore = 0;
-    int blackScore = 0;
+// All training positions in one arena, structure of arrays. The features of
+// position i are index[k], coeff[k] for offset[i] <= k < offset[i + 1], coeff
+// being the white count minus the black count. Evals are from white's view.
+struct TunerData {
+    std::vector<std::uint32_t> offset = {0};
+    std::vector<std::uint16_t> index;
+    std::vector<std::int8_t> coeff;
+    std::vector<std::uint8_t> mgPhase;
+    std::vector<float> result;
+    std::vector<std::int16_t> staticEval;
+
+    std::size_t size() const { return mgPhase.size(); }
+    std::size_t bytes() const;
+
+    void add(const Trace &trace, int phase, float res, int eval);
+    void append(const TunerData &other);
 };
 
-struct TEntry {
-    int turn = 0;
-    int phase = 0;
-    int mgPhase = 0;
-    int egPhase = 0;
-    int staticEval = 0;
-    int egEval;
+// Quiets a position before it is traced by following the principal variation
+// of a capture search. Keeps no tables and allocates nothing, so each thread
+// reuses one across all of its positions.
+class QResolver {
+  public:
+    // plays the quiescence pv out on board, returns its score for the side to
+    // move
+    int resolve(Board &board);
+
+    std::uint64_t nodes = 0;
+
+  private:
+    int qsearch(Board &board, int alpha, int beta, int ply);
+
+    unsigned short pv[QS_MAX_PLY + 1][QS_MAX_PLY + 1];
+    int pvLen[QS_MAX_PLY + 1];
+};
+
+// Moves the weights against the gradient of the loss. The state lives in the
+// base class as plain arrays so a checkpoint can write it out as is.
+class Optimizer {
+  public:
+    virtual ~Optimizer() = default;
 
-    double result;
+    virtual const char *name() const = 0;
+    virtual double defaultRate() const = 0;
+    virtual void step(double weights[NUM_FEATURES][2],
+                      double gradient[NUM_FEATURES][2], double rate) = 0;
 
-    EvalWeights w;
-    TTuple *tuples;
-    int nTuples = 0;
+    bool save(std::FILE *file) const;
+    bool load(std::FILE *file);
 
-    void init(Board &board, std::string fen);
-    double linearEval(double params[NUM_FEATURES][2]);
+  protected:
+    double m[NUM_FEATURES][2] = {{0}};
+    double v[NUM_FEATURES][2] = {{0}};
+    std::uint64_t steps = 0;
 };
 
+class AdaGrad : public Optimizer {
+  public:
+    const char *name() const override { return "adagrad"; }
+    double defaultRate() const override { return 5.0; }
+    void step(double weights[NUM_FEATURES][2],
+              double gradient[NUM_FEATURES][2], double rate) override;
+};
+
+class Adam : public Optimizer {
+  public:
+    const char *name() const override { return "adam"; }
+    double defaultRate() const override { return 0.5; }
+    void step(double weights[NUM_FEATURES][2],
+              double gradient[NUM_FEATURES][2], double rate) override;
+};
+
+class MomentumSGD : public Optimizer {
+  public:
+    const char *name() const override { return "sgd"; }
+    double defaultRate() const override { return 20000.0; }
+    void step(double weights[NUM_FEATURES][2],
+              double gradient[NUM_FEATURES][2], double rate) override;
+};
+
+// nullptr for an unknown name
+std::unique_ptr<Optimizer> makeOptimizer(const std::string &name);
+
+// Everything besides the optimizer state needed to resume a run. Checkpoints
+// are this struct followed by Optimizer::save.
+struct TunerCheckpoint {
+    std::uint32_t magic;
+    std::uint32_t features;
+    char optimizer[16];
+    std::int32_t epoch;
+    std::int32_t stale;
+    double K, rate, bestError;
+    double weights[NUM_FEATURES][2];
+    double best[NUM_FEATURES][2];
+};
+
+#define CHECKPOINT_MAGIC 0x31435459
+
 class TunerEntries {
   public:
     TunerEntries(std::string file);
-    ~TunerEntries() { delete[] entries; }
 
-    void runTuner();
+    void runTuner(const std::string &optimizer = "adam", bool resume = false);
+    void benchmark();
 
   private:
-    TEntry *entries;
+    TunerData data;
+    int nEntries = 0;
+    bool simd = false;
+    std::vector<int> train, valid;
+
+    void addPositions(const PackedPos *positions, int count);
+    void splitValidation();
 
     double staticEvalErrors(double K);
-    double tunedEvalErrors(double params[NUM_FEATURES][2], double K);
+    double tunedEvalErrors(double weights[NUM_FEATURES][2], double K,
+                           const std::vector<int> &set);
     double computeOptimalK();
 
-    void computeGradient(double gradient[NUM_FEATURES][2],
-                         double params[NUM_FEATURES][2], double K, int batch);
+    double linearEval(std::size_t i, double weights[NUM_FEATURES][2]) const;
+
+    double computeGradient(double gradient[NUM_FEATURES][2],
+                           double weights[NUM_FEATURES][2], double K,
+                           const int *batch, int count, bool vector);
 
-    void updateSingleGradient(TEntry &entry, double gradient[NUM_FEATURES][2],
-                              double params[NUM_FEATURES][2], double K);
+    double updateSingleGradient(std::size_t i,
+                                double gradient[NUM_FEATURES][2],
+                                double weights[NUM_FEATURES][2], double K);
+
+    double gradientAVX2(const int *batch, int count, const float *wmg,
+                        const float *weg, float K,
+                        float grad[NUM_FEATURES][2]);
+};
 
-    void initUntunedWeights(double params[NUM_FEATURES][2]);
+// the network in floats, laid out like Network
+struct NNUEParams {
+    float ftWeights[NNUE_INPUTS][NNUE_HIDDEN];
+    float ftBias[NNUE_HIDDEN];
+    float l2Weights[NNUE_L2][2 * NNUE_HIDDEN];
+    float l2Bias[NNUE_L2];
+    float l3Weights[NNUE_L3][NNUE_L2];
+    float l3Bias[NNUE_L3];
+    float outWeights[NNUE_L3];
+    float outBias;
 };
 
+// Trains the engine's network on a packed dataset with Adam. The first layer
+// only gets gradients on the feature rows a batch touched, and the weights
+// are clipped to what the quantized network can hold, so the export loses
+// little more than rounding.
+class NNUETrainer {
+  public:
+    NNUETrainer(const std::string &file);
+
+    void run(const std::string &out, int epochs, double rate, double lambda);
+
+  private:
+    Dataset dataset;
+    std::vector<int> train, valid;
+    std::unique_ptr<NNUEParams> params, bestParams, m, v;
+
+    // per thread: a gradient and the first layer rows it touched
+    std::vector<std::unique_ptr<NNUEParams>> grads;
+    std::vector<std::vector<std::uint8_t>> touched;
+
+    float forward(const PackedPos &pos, NNUEParams *grad,
+                  std::uint8_t *rows, double lambda,
+                  float *output = nullptr) const;
+    void step(float rate, std::uint64_t steps, int count);
+    double validationLoss(double lambda) const;
+    bool exportNetwork(const std::string &path) const;
+};
+
+// writes the weights as a drop-in replacement for weights.hpp
+bool writeWeights(const std::string &path, double weights[NUM_FEATURES][2]);
+
 } // namespace Yayo
 #endif // TUNER_H_
@@ -93,9 +93,12 @@ void UCI::Bench() {
     std::uint64_t start_time = get_time();
     std::uint64_t total_nodes = 0;
     std::uint64_t total_time = 0;
+    std::uint64_t cmSearched = 0, cmCutoffs = 0;
+    std::uint64_t pcSearched = 0, pcCutoffs = 0;
 
     for (auto &fen : benchPos) {
         search.clearTT(8);
+        search.clearHistory();
         search._setFen(fen);
         info->timeGiven = false;
         info->depth = 5;
@@ -104,6 +107,10 @@ void UCI::Bench() {
         search.wait();
         total_time += get_time() - start_time;
         total_nodes += search.get_nodes();
+        cmSearched += search.cmSearched;
+        cmCutoffs += search.cmCutoffs;
+        pcSearched += search.pcSearched;
+        pcCutoffs += search.pcCutoffs;
     }
 
     search.joinThread();
@@ -114,6 +121,232 @@ void UCI::Bench() {
 
     std::cout << total_nodes << " nodes " << (long)(total_nodes / total_time)
               << " nps" << std::endl;
+    std::cout << "countermove: " << cmSearched << " searched, " << cmCutoffs
+              << " cutoffs" << std::endl;
+    std::cout << "probcut: " << pcSearched << " searched, " << pcCutoffs
+              << " cutoffs" << std::endl;
+}
+
+void UCI::SeeBench() {
+    init_arrays();
+    initMvvLva();
+
+    constexpr int reps = 20000;
+    std::vector<std::pair<Board, unsigned short>> captures;
+
+    for (auto &fen : benchPos) {
+        Board board;
+        board.setFen(fen);
+
+        moveList mList = {0};
+        generateCaptures(board, &mList);
+        for (int i = 0; i < mList.nMoves; i++)
+            captures.push_back({board, mList.moves[i].move});
+    }
+
+    std::uint64_t calls = 0, agree = 0;
+    volatile int sink = 0;
+
+    std::uint64_t start = get_time();
+    for (int r = 0; r < reps; r++) {
+        for (auto &[board, move] : captures) {
+            Square from = getFrom(move), to = getTo(move);
+            Piece toPc = getCapture(move) == EP_CAPTURE ? board.board[to ^ 8]
+                                                        : board.board[to];
+            sink = sink + board.see(to, toPc, from, board.board[from]);
+        }
+    }
+    std::uint64_t seeTime = std::max<std::uint64_t>(1, get_time() - start);
+
+    start = get_time();
+    for (int r = 0; r < reps; r++) {
+        for (auto &[board, move] : captures)
+            sink = sink + board.seeGE(move, 0);
+    }
+    std::uint64_t seeGETime = std::max<std::uint64_t>(1, get_time() - start);
+
+    for (auto &[board, move] : captures) {
+        Square from = getFrom(move), to = getTo(move);
+        Piece toPc = getCapture(move) == EP_CAPTURE ? board.board[to ^ 8]
+                                                    : board.board[to];
+        agree += (board.see(to, toPc, from, board.board[from]) >= 0) ==
+                 board.seeGE(move, 0);
+    }
+
+    calls = reps * captures.size();
+    std::cout << captures.size() << " captures, " << calls << " calls each"
+              << std::endl;
+    std::cout << "see:   " << calls * 1000 / seeTime << " calls/s" << std::endl;
+    std::cout << "seeGE: " << calls * 1000 / seeGETime << " calls/s"
+              << std::endl;
+    std::cout << "sign agreement: " << agree << "/" << captures.size()
+              << std::endl;
+}
+
+void UCI::BookBench(const std::string &file) {
+    init_arrays();
+    initMvvLva();
+
+    if (!book.open(file)) {
+        std::cout << "could not open book " << file << std::endl;
+        return;
+    }
+
+    // bench positions are mostly out of book, walks from the start
+    // position give the hits
+    std::vector<Board> positions;
+    for (auto &fen : benchPos) {
+        positions.emplace_back();
+        positions.back().setFen(fen);
+    }
+
+    for (int walk = 0; walk < 32; walk++) {
+        Board board;
+        board.setFen(START_POS);
+
+        for (int ply = 0; ply < 16; ply++) {
+            const unsigned short move = book.probe(board);
+            if (!move)
+                break;
+
+            positions.push_back(board);
+            make(board, move);
+            board.ply = 0;
+        }
+    }
+
+    constexpr int reps = 2000;
+    std::uint64_t hits = 0;
+
+    std::uint64_t start = get_time();
+    for (int r = 0; r < reps; r++)
+        for (auto &board : positions)
+            hits += book.probe(board) != 0;
+    std::uint64_t elapsed = std::max<std::uint64_t>(1, get_time() - start);
+
+    const std::uint64_t calls = reps * positions.size();
+    std::cout << book.size() << " entries, " << positions.size()
+              << " positions, " << hits / reps << " in book" << std::endl;
+    std::cout << "probe: " << elapsed * 1000000 / calls << " ns/call, "
+              << calls * 1000 / elapsed << " calls/s" << std::endl;
+}
+
+void UCI::NNUEBench(const std::string &file) {
+    init_arrays();
+    initMvvLva();
+
+    if (!nnue.load(file)) {
+        std::cout << "could not load network " << file << std::endl;
+        return;
+    }
+
+    // random walks from the bench positions, made and unmade through an
+    // accumulator stack the way the search does it
+    constexpr int walks = 64, plies = 48;
+    std::mt19937_64 rng(1);
+    std::vector<std::vector<unsigned short>> lines;
+    std::uint64_t evals = 0, mismatches = 0, signs = 0;
+    double absDiff = 0, sx = 0, sy = 0, sxx = 0, syy = 0, sxy = 0;
+    auto stack = std::make_unique<Accumulator[]>(plies + 1);
+
+    for (auto &fen : benchPos) {
+        for (int w = 0; w < walks; w++) {
+            Board board;
+            board.setFen(fen);
+            board.acc = stack.get();
+            stack[0].computed[WHITE] = stack[0].computed[BLACK] = false;
+            stack[0].dirty.refresh[WHITE] = stack[0].dirty.refresh[BLACK] =
+                  true;
+
+            std::vector<unsigned short> line;
+            for (int ply = 0; ply < plies; ply++) {
+                moveList mList = {0};
+                generate(board, &mList);
+                if (!mList.nMoves)
+                    break;
+
+                line.push_back(mList.moves[rng() % mList.nMoves].move);
+                make(board, line.back());
+
+                // from scratch through the scalar layers, so this checks
+                // both the updates and the avx2 kernel
+                const int incremental = nnue.evaluate(board);
+                Accumulator *acc = board.acc;
+                const bool simd = nnue.simd;
+                board.acc = nullptr;
+                nnue.simd = false;
+                const int scratch = nnue.evaluate(board);
+                const int classical = Eval(board).eval();
+                board.acc = acc;
+                nnue.simd = simd;
+
+                mismatches += incremental != scratch;
+                signs += (incremental > 0) == (classical > 0);
+                absDiff += std::abs(incremental - classical);
+                sx += classical, sy += incremental;
+                sxx += double(classical) * classical;
+                syy += double(incremental) * incremental;
+                sxy += double(classical) * incremental;
+                evals++;
+            }
+
+            // unmake walks the stack back down, the root has to match
+            for (int i = line.size() - 1; i >= 0; i--)
+                unmake(board, line[i]);
+            const int root = nnue.evaluate(board);
+            board.acc = nullptr;
+            mismatches += root != nnue.evaluate(board);
+
+            lines.push_back(std::move(line));
+        }
+    }
+
+    const double n = evals;
+    const double corr = (sxy - sx * sy / n) /
+                        std::sqrt((sxx - sx * sx / n) * (syy - sy * sy / n));
+    std::cout << evals << " positions, " << mismatches
+              << " mismatches against a scalar refresh" << std::endl;
+    std::cout << "vs classical: mean abs diff " << absDiff / n
+              << ", sign agreement " << 100.0 * signs / n
+              << "%, correlation " << corr << std::endl;
+
+    // eval speed along the same walks, make and unmake included
+    constexpr int reps = 20;
+    volatile int sink = 0;
+    for (int mode = 0; mode < 3; mode++) {
+        std::uint64_t start = get_time();
+        for (int r = 0; r < reps; r++) {
+            for (std::size_t l = 0; l < lines.size(); l++) {
+                Board board;
+                board.setFen(benchPos[l / walks]);
+                board.acc = mode == 2 ? stack.get() : nullptr;
+                stack[0].computed[WHITE] = stack[0].computed[BLACK] = false;
+
+                for (auto move : lines[l]) {
+                    make(board, move);
+                    sink = sink + (mode ? nnue.evaluate(board)
+                                        : Eval(board).eval());
+                }
+                for (int i = lines[l].size() - 1; i >= 0; i--)
+                    unmake(board, lines[l][i]);
+            }
+        }
+
+        const std::uint64_t elapsed =
+              std::max<std::uint64_t>(1, get_time() - start);
+        const char *name[] = {"classical", "nnue refresh", "nnue incremental"};
+        std::cout << name[mode] << ": " << reps * evals * 1000 / elapsed
+                  << " evals/s" << std::endl;
+    }
+
+    // node counts add up across benches, each one starts over
+    std::cout << "bench, nnue:" << std::endl;
+    search.bench_nodes = 0;
+    Bench();
+    nnue.unload();
+    std::cout << "bench, classical:" << std::endl;
+    search.bench_nodes = 0;
+    Bench();
 }
 
 void UCI::Uci() {
@@ -126,18 +359,38 @@ void UCI::Uci() {
     std::cout << "option name Hash type spin default " << TP_INIT_SIZE
               << " min 1 max 1024" << std::endl;
     std::cout << "option name Ponder type check default False" << std::endl;
+    std::cout << "option name SyzygyPath type string default <empty>"
+              << std::endl;
+    std::cout << "option name BitbasePath type string default <empty>"
+              << std::endl;
+    std::cout << "option name OwnBook type check default false" << std::endl;
+    std::cout << "option name BookFile type string default <empty>"
+              << std::endl;
+    std::cout << "option name EvalFile type string default <empty>"
+              << std::endl;
     std::cout << "uciok" << std::endl;
 }
 
 void UCI::NewGame() {
     tt.reset();
     search.clearTT(ttSize);
+    search.clearHistory();
     search._setFen(START_POS);
 }
 
 void UCI::IsReady() { search.isReady(); }
 
-void UCI::Go(Info *info) {
+void UCI::Go(Info *info, bool useBook) {
+    if (useBook && ownBook && book.isOpen()) {
+        const unsigned short move = book.probe(search.getBoard());
+        if (move) {
+            std::cout << "bestmove ";
+            print_move(move);
+            std::cout << std::endl;
+            return;
+        }
+    }
+
     tt.increaseAge();
     search.startSearch(info);
 }
@@ -255,6 +508,8 @@ void UCI::Main() {
             int movetime = -1;
             int time = -1;
             int increment = 0;
+            std::uint64_t nodes = 0;
+            bool useBook = true;
             bool turn = board.turn;
             info->timeGiven = false;
 
@@ -263,7 +518,10 @@ void UCI::Main() {
             while (iss >> tc) {
                 if (tc == "infinite") {
                     depth = 2000;
+                    useBook = false;
                     continue;
+                } else if (tc == "ponder") {
+                    useBook = false;
                 } else if (tc == "binc" && turn == BLACK) {
                     iss >> increment;
                 } else if (tc == "winc" && turn == WHITE) {
@@ -278,6 +536,8 @@ void UCI::Main() {
                     iss >> movetime;
                 } else if (tc == "depth") {
                     iss >> depth;
+                } else if (tc == "nodes") {
+                    iss >> nodes;
                 }
             }
 
@@ -288,6 +548,7 @@ void UCI::Main() {
 
             info->startTime = get_time();
             info->depth = depth;
+            info->nodeLimit = nodes;
 
             int cStopTime, hStopTime;
 
@@ -315,9 +576,11 @@ void UCI::Main() {
             info->uciStop = false;
             info->uciQuit = false;
 
-            Go(info);
+            Go(info, useBook);
         } else if (cmd == "quit") {
+            // a search thread left joinable would abort the exit
             Stop();
+            search.joinThread();
             break;
         } else if (cmd == "stop") {
             Stop();
@@ -364,6 +627,56 @@ void UCI::Main() {
                         ttSize = size;
                         NewGame();
                     }
+                } else if (args == "SyzygyPath") {
+                    iss >> args;
+
+                    // paths may contain spaces, take the rest of the line
+                    if (args == "value") {
+                        std::string path;
+                        std::getline(iss >> std::ws, path);
+                        tb.init(path);
+                    }
+                } else if (args == "OwnBook") {
+                    iss >> args;
+
+                    if (args == "value") {
+                        iss >> args;
+                        ownBook = args == "true";
+                    }
+                } else if (args == "BookFile") {
+                    iss >> args;
+
+                    if (args == "value") {
+                        std::string path;
+                        std::getline(iss >> std::ws, path);
+                        if (path == "<empty>")
+                            book.close();
+                        else if (!book.open(path))
+                            std::cout << "info string could not open book "
+                                      << path << std::endl;
+                    }
+                } else if (args == "EvalFile") {
+                    iss >> args;
+
+                    // without a network the classical eval is used
+                    if (args == "value") {
+                        std::string path;
+                        std::getline(iss >> std::ws, path);
+                        nnue.unload();
+                        if (path != "<empty>" && !nnue.load(path))
+                            std::cout << "info string could not load network "
+                                      << path << std::endl;
+                    }
+                } else if (args == "BitbasePath") {
+                    iss >> args;
+
+                    if (args == "value") {
+                        std::string path;
+                        std::getline(iss >> std::ws, path);
+                        std::cout << "info string loaded "
+                                  << bitbases.load(path) << " bitbases"
+                                  << std::endl;
+                    }
                 }
             }
 
@@ -371,6 +684,8 @@ void UCI::Main() {
             moveList mList = {0};
             generate(board, &mList);
             std::cout << Eval(board).eval() << std::endl;
+            if (nnue.loaded())
+                std::cout << "nnue: " << nnue.evaluate(board) << std::endl;
         } else if (cmd == "perft") {
             int depth;
             iss >> depth;
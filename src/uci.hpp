@@ -19,6 +19,7 @@
 #ifndef UCI_H_
 #define UCI_H_
 #include "board.hpp"
+#include "book.hpp"
 #include "eval.hpp"
 #include "move.hpp"
 #include "movegen.hpp"
@@ -97,18 +98,25 @@ class UCI {
     UCI(Search &searcher) : search(searcher){};
     void Main();
     void Bench();
+    void SeeBench();
+    void BookBench(const std::string &file);
+    // eval agreement and speed of a network against the classical eval
+    void NNUEBench(const std::string &file);
     std::uint64_t Perft(int depth);
 
   private:
     void Uci();
     void NewGame();
     void IsReady();
-    void Go(Info *info);
+    // the book only answers searches that end on their own, infinite and
+    // ponder searches have to wait for stop
+    void Go(Info *info, bool useBook);
     void Stop();
 
   private:
     Search &search;
     int ttSize = TP_INIT_SIZE;
+    bool ownBook = false;
 };
 
 } // namespace Yayo
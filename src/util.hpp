@@ -97,7 +97,7 @@ enum Color : std::uint8_t { WHITE, BLACK, NO_COLOR, NUM_COLOR = 2 };
 constexpr Color operator~(Color color) { return Color(1 ^ std::uint8_t(color)); }
 
 enum PieceT { NONE, PAWN, KNIGHT, BISHOP, ROOK, QUEEN, KING, PT_MAX = KING+1 };
-enum Piece {
+enum Piece : std::uint8_t {
     W_PAWN = PAWN,     W_KNIGHT, W_BISHOP, W_ROOK, W_QUEEN, W_KING,
     B_PAWN = PAWN + 8, B_KNIGHT, B_BISHOP, B_ROOK, B_QUEEN, B_KING,
     PC_MAX = 16,
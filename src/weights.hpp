@@ -115,22 +115,40 @@ constexpr Score KnightMobilityScore[9] = {
       S(6, 57),    S(16, 49), S(26, 43),  S(34, 25),
 };
 constexpr Score BishopMobilityScore[14] = {
-      S(-38, -85), S(-16, -79), S(-8, -35), S(2, -36),  S(10, -22),
-      S(15, -11),  S(21, -6),   S(28, -2),  S(32, -2),  S(36, -2),
-      S(45, -5),   S(53, -13),  S(70, -18), S(94, -38),
+      S(-47, -90), S(-26, -62), S(3, -46), S(10, -34), S(20, -25),
+      S(30, -11),  S(33, -2),   S(39, 0),  S(39, 7),   S(43, 13),
+      S(53, 17),   S(53, 23),   S(61, 25), S(67, 32),
 };
 constexpr Score RookMobilityScore[15] = {
-      S(-97, -117), S(-67, -61), S(-52, -54), S(-87, 42), S(-76, -44),
-      S(-27, -29),  S(-41, 8),   S(-25, -10), S(-28, 10), S(-25, 20),
-      S(-20, 22),   S(-12, 23),  S(-2, 25),   S(9, 27),   S(14, 30),
+      S(-72, -125), S(-48, -79), S(-39, -44), S(-35, -22), S(-31, -12),
+      S(-29, -1),   S(-20, 22),  S(-15, 27),  S(-4, 38),   S(-4, 45),
+      S(-2, 56),    S(3, 63),    S(9, 64),    S(10, 66),   S(18, 68),
 };
 constexpr Score QueenMobilityScore[28] = {
-      S(-150, -200), S(-112, -111), S(-47, -95), S(-93, -105), S(-35, -87),
-      S(-61, 65),    S(-52, 22),    S(-92, -6),  S(-72, 61),   S(-12, 16),
-      S(-47, 97),    S(-31, 86),    S(-31, 119), S(-27, 125),  S(-20, 122),
-      S(-16, 123),   S(-11, 126),   S(-7, 130),  S(-1, 128),   S(-2, 132),
-      S(5, 125),     S(12, 119),    S(14, 127),  S(21, 112),   S(33, 110),
-      S(48, 91),     S(51, 100),    S(91, 84),
+      S(-72, 9),  S(-58, 25), S(-39, 43), S(-39, 51), S(-31, 63),
+      S(-25, 79), S(-20, 84), S(-10, 94), S(-8, 98),  S(-4, 109),
+      S(2, 110),  S(5, 118),  S(5, 125),  S(10, 130), S(10, 133),
+      S(13, 135), S(14, 141), S(15, 143), S(20, 146), S(27, 148),
+      S(27, 152), S(35, 166), S(38, 169), S(38, 173), S(41, 180),
+      S(43, 186), S(46, 198), S(49, 202),
+};
+constexpr Score kingAttackWeight[4] = {
+      S(-8, -2), S(-6, -2), S(-7, -3), S(-10, -4),
+};
+constexpr Score kingAttackerCount[8] = {
+      S(0, 0),     S(0, 0),      S(-15, 0),    S(-40, -5),
+      S(-70, -10), S(-100, -15), S(-130, -20), S(-160, -25),
+};
+constexpr Score safeCheckPenalty[4] = {
+      S(-40, -5), S(-25, -5), S(-40, -5), S(-30, -5),
+};
+constexpr Score kingShelterRank[8] = {
+      S(-25, -5), S(20, 0),  S(10, 0),  S(-5, 0),
+      S(-10, 0),  S(-15, 0), S(-15, 0), S(0, 0),
+};
+constexpr Score kingStormRank[8] = {
+      S(0, 0),  S(-5, 0), S(-30, -5), S(-15, 0),
+      S(-5, 0), S(0, 0),  S(0, 0),    S(0, 0),
 };
 
 struct EvalWeights {
@@ -251,22 +269,40 @@ struct EvalWeights {
           S(6, 57),    S(16, 49), S(26, 43),  S(34, 25),
     };
     const Score BishopMobilityScore[14] = {
-          S(-38, -85), S(-16, -79), S(-8, -35), S(2, -36),  S(10, -22),
-          S(15, -11),  S(21, -6),   S(28, -2),  S(32, -2),  S(36, -2),
-          S(45, -5),   S(53, -13),  S(70, -18), S(94, -38),
+          S(-47, -90), S(-26, -62), S(3, -46), S(10, -34), S(20, -25),
+          S(30, -11),  S(33, -2),   S(39, 0),  S(39, 7),   S(43, 13),
+          S(53, 17),   S(53, 23),   S(61, 25), S(67, 32),
     };
     const Score RookMobilityScore[15] = {
-          S(-97, -117), S(-67, -61), S(-52, -54), S(-87, 42), S(-76, -44),
-          S(-27, -29),  S(-41, 8),   S(-25, -10), S(-28, 10), S(-25, 20),
-          S(-20, 22),   S(-12, 23),  S(-2, 25),   S(9, 27),   S(14, 30),
+          S(-72, -125), S(-48, -79), S(-39, -44), S(-35, -22), S(-31, -12),
+          S(-29, -1),   S(-20, 22),  S(-15, 27),  S(-4, 38),   S(-4, 45),
+          S(-2, 56),    S(3, 63),    S(9, 64),    S(10, 66),   S(18, 68),
     };
     const Score QueenMobilityScore[28] = {
-          S(-150, -200), S(-112, -111), S(-47, -95), S(-93, -105), S(-35, -87),
-          S(-61, 65),    S(-52, 22),    S(-92, -6),  S(-72, 61),   S(-12, 16),
-          S(-47, 97),    S(-31, 86),    S(-31, 119), S(-27, 125),  S(-20, 122),
-          S(-16, 123),   S(-11, 126),   S(-7, 130),  S(-1, 128),   S(-2, 132),
-          S(5, 125),     S(12, 119),    S(14, 127),  S(21, 112),   S(33, 110),
-          S(48, 91),     S(51, 100),    S(91, 84),
+          S(-72, 9),  S(-58, 25), S(-39, 43), S(-39, 51), S(-31, 63),
+          S(-25, 79), S(-20, 84), S(-10, 94), S(-8, 98),  S(-4, 109),
+          S(2, 110),  S(5, 118),  S(5, 125),  S(10, 130), S(10, 133),
+          S(13, 135), S(14, 141), S(15, 143), S(20, 146), S(27, 148),
+          S(27, 152), S(35, 166), S(38, 169), S(38, 173), S(41, 180),
+          S(43, 186), S(46, 198), S(49, 202),
+    };
+    const Score kingAttackWeight[4] = {
+          S(-8, -2), S(-6, -2), S(-7, -3), S(-10, -4),
+    };
+    const Score kingAttackerCount[8] = {
+          S(0, 0),     S(0, 0),      S(-15, 0),    S(-40, -5),
+          S(-70, -10), S(-100, -15), S(-130, -20), S(-160, -25),
+    };
+    const Score safeCheckPenalty[4] = {
+          S(-40, -5), S(-25, -5), S(-40, -5), S(-30, -5),
+    };
+    const Score kingShelterRank[8] = {
+          S(-25, -5), S(20, 0),  S(10, 0),  S(-5, 0),
+          S(-10, 0),  S(-15, 0), S(-15, 0), S(0, 0),
+    };
+    const Score kingStormRank[8] = {
+          S(0, 0),  S(-5, 0), S(-30, -5), S(-15, 0),
+          S(-5, 0), S(0, 0),  S(0, 0),    S(0, 0),
     };
 };
 #endif // WEIGHTS_H_
@@ -0,0 +1,167 @@
+/*
+**    Yayo is a UCI chess engine written by am5083 (am@kvasm.us)
+**    Copyright (C) 2022 Ahmed Mohamed (am@kvasm.us)
+**
+**    This program is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**    This program is distributed in the hope that it will be useful,
+**    but WITHOUT ANY WARRANTY; without even the implied warranty of
+**    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**    GNU General Public License for more details.
+**
+**    You should have received a copy of the GNU General Public License
+**    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+** Builds the bitbases the tests need into a scratch directory and checks
+** them against the Syzygy tables in tests/syzygy:
+** test_bitbase <syzygy dir> <scratch dir>
+**
+** Known positions first, which are also probed in Syzygy when it has the
+** table; there is none for KRKP here. Then random positions of the other
+** tables from both sides.
+*/
+
+#include "src/bitbase.hpp"
+#include "src/board.hpp"
+#include "src/movegen.hpp"
+#include "src/tbprobe.hpp"
+#include "tests/check.hpp"
+#include <filesystem>
+#include <memory>
+#include <random>
+
+using namespace Yayo;
+using namespace Yayo::Bitboards;
+
+namespace {
+
+struct Known {
+    std::string fen;
+    BBResult result;
+};
+
+// rook pawn draws against a king in the corner or stalemated, opposition,
+// and KRKP won by the rook, won by the pawn and drawn
+const Known known[] = {
+      {"k7/8/8/8/8/8/P7/K7 w - - 0 1", BB_DRAW},
+      {"7k/8/8/8/8/8/7P/7K w - - 0 1", BB_DRAW},
+      {"7k/7P/7K/8/8/8/8/8 b - - 0 1", BB_DRAW},
+      {"8/6KP/8/8/8/8/k7/8 w - - 0 1", BB_WIN},
+      {"8/4k3/8/4K3/4P3/8/8/8 w - - 0 1", BB_DRAW},
+      {"8/4k3/8/4K3/4P3/8/8/8 b - - 0 1", BB_LOSS},
+      {"4k3/p7/8/8/8/8/8/R3K3 w - - 0 1", BB_WIN},
+      {"4k3/p7/8/8/8/8/8/R3K3 b - - 0 1", BB_LOSS},
+      {"K7/8/8/8/7p/8/4k3/3R4 b - - 0 1", BB_WIN},
+      {"8/8/8/8/8/7p/4k3/3R2K1 b - - 0 1", BB_DRAW},
+      {"K7/8/8/8/8/8/1kp5/7R w - - 0 1", BB_DRAW},
+};
+
+// tables built for the test, KRKP needs the ones between KBNK and it
+const std::vector<std::string> built = {"KQK",  "KRK",  "KPK",
+                                        "KBNK", "KQKR", "KRKR",
+                                        "KRKB", "KRKN", "KRKP"};
+
+// compared against Syzygy, the first side is the stronger one
+const std::string compared[] = {"KQk", "KRk", "KPk", "KBNk"};
+
+// half of the positions have the colors swapped
+std::string randomFen(std::mt19937_64 &rng, std::string pcs) {
+    if (rng() & 1)
+        for (char &pc : pcs)
+            pc ^= 0x20;
+
+    char grid[64];
+    while (true) {
+        std::fill(grid, grid + 64, '1');
+
+        bool ok = true;
+        for (char pc : pcs) {
+            const int sq = rng() % 64;
+            ok &= grid[sq] == '1' &&
+                  ((pc | 0x20) != 'p' || (sq >= 8 && sq < 56));
+            grid[sq] = pc;
+        }
+
+        if (!ok)
+            continue;
+
+        std::string fen;
+        for (int r = 0; r < 8; r++) {
+            fen.append(grid + 8 * r, grid + 8 * r + 8);
+            fen += r < 7 ? "/" : rng() & 1 ? " w" : " b";
+        }
+
+        return fen + " - - 0 1";
+    }
+}
+
+// the side that just moved can't be in check
+bool legal(const Board &board) {
+    const Color other = Color(board.turn ^ 1);
+    const Square ksq = Square(__builtin_ctzll(board.pieces(KING, other)));
+    return !board.isSqAttacked(ksq, board.pieces(), board.turn);
+}
+
+// false when there is no Syzygy table for the position
+bool checkAgainstSyzygy(Board &board) {
+    ProbeState state;
+    const WDLScore wdl = tb.probeWDL(board, &state);
+    if (state == PROBE_FAIL)
+        return false;
+
+    const BBResult expected = wdl > WDL_DRAW   ? BB_WIN
+                              : wdl < WDL_DRAW ? BB_LOSS
+                                               : BB_DRAW;
+    CHECK_EQ(int(bitbases.probe(board)), int(expected));
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        std::cerr << "usage: test_bitbase <syzygy dir> <scratch dir>"
+                  << std::endl;
+        return 1;
+    }
+
+    init_arrays();
+    initMvvLva();
+
+    const std::filesystem::path dir(argv[2]);
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+
+    tb.init(argv[1]);
+    bitbases.generate(dir.string(), built);
+    CHECK_EQ(bitbases.load(dir.string()), int(built.size()));
+
+    auto board = std::make_unique<Board>();
+
+    for (const Known &k : known) {
+        board->setFen(k.fen);
+        CHECK(legal(*board));
+        CHECK_EQ(int(bitbases.probe(*board)), int(k.result));
+        checkAgainstSyzygy(*board);
+    }
+
+    std::mt19937_64 rng(2022);
+    for (const std::string &pcs : compared) {
+        for (int n = 0; n < 100000;) {
+            board->setFen(randomFen(rng, pcs));
+            if (!legal(*board))
+                continue;
+
+            CHECK(checkAgainstSyzygy(*board));
+            n++;
+        }
+    }
+
+    std::cout << (failures ? "FAILED" : "ok") << std::endl;
+    return failures != 0;
+}
@@ -0,0 +1,59 @@
+/*
+**    Yayo is a UCI chess engine written by am5083 (am@kvasm.us)
+**    Copyright (C) 2022 Ahmed Mohamed (am@kvasm.us)
+**
+**    This program is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**    This program is distributed in the hope that it will be useful,
+**    but WITHOUT ANY WARRANTY; without even the implied warranty of
+**    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**    GNU General Public License for more details.
+**
+**    You should have received a copy of the GNU General Public License
+**    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CHECK_H_
+#define CHECK_H_
+
+#include <cmath>
+#include <iostream>
+
+// minimal assertions for the test programs, main returns failures != 0
+inline int failures = 0;
+
+#define CHECK(cond)                                                            \
+    do {                                                                       \
+        if (!(cond)) {                                                         \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #cond       \
+                      << ") failed" << std::endl;                              \
+            failures++;                                                        \
+        }                                                                      \
+    } while (0)
+
+#define CHECK_EQ(a, b)                                                         \
+    do {                                                                       \
+        const auto va = (a);                                                   \
+        const auto vb = (b);                                                   \
+        if (!(va == vb)) {                                                     \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": " #a " == " #b      \
+                      << " failed: " << va << " vs " << vb << std::endl;       \
+            failures++;                                                        \
+        }                                                                      \
+    } while (0)
+
+#define CHECK_NEAR(a, b, eps)                                                  \
+    do {                                                                       \
+        const double va = (a);                                                 \
+        const double vb = (b);                                                 \
+        if (!(std::abs(va - vb) <= (eps))) {                                   \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": " #a " ~ " #b       \
+                      << " failed: " << va << " vs " << vb << std::endl;       \
+            failures++;                                                        \
+        }                                                                      \
+    } while (0)
+
+#endif // CHECK_H_
@@ -0,0 +1,80 @@
+/*
+**    Yayo is a UCI chess engine written by am5083 (am@kvasm.us)
+**    Copyright (C) 2022 Ahmed Mohamed (am@kvasm.us)
+**
+**    This program is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**    This program is distributed in the hope that it will be useful,
+**    but WITHOUT ANY WARRANTY; without even the implied warranty of
+**    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**    GNU General Public License for more details.
+**
+**    You should have received a copy of the GNU General Public License
+**    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+** Pentanomial statistics of the match runner against values worked out by
+** hand from the pair counts
+*/
+
+#include "src/match.hpp"
+#include "tests/check.hpp"
+
+using namespace Yayo;
+
+namespace {
+
+Pentanomial fromPairs(std::uint64_t l, std::uint64_t ld, std::uint64_t d,
+                      std::uint64_t wd, std::uint64_t w) {
+    Pentanomial p;
+    const std::uint64_t pairs[5] = {l, ld, d, wd, w};
+    std::copy(pairs, pairs + 5, p.pairs);
+    return p;
+}
+
+} // namespace
+
+int main() {
+    // nothing played yet
+    const Pentanomial empty;
+    CHECK_EQ(empty.count(), 0u);
+    CHECK_NEAR(empty.score(), 0.5, 1e-12);
+    CHECK_NEAR(empty.elo(), 0.0, 1e-9);
+    CHECK_NEAR(empty.llr(0.0, 5.0), 0.0, 1e-12);
+
+    // symmetric: no elo, and an llr slightly towards elo0
+    const Pentanomial even = fromPairs(10, 20, 40, 20, 10);
+    CHECK_EQ(even.count(), 100u);
+    CHECK_NEAR(even.score(), 0.5, 1e-12);
+    CHECK_NEAR(even.variance(), 0.075, 1e-12);
+    CHECK_NEAR(even.elo(), 0.0, 1e-9);
+    CHECK_NEAR(even.eloError(), 37.4428, 1e-3);
+    CHECK_NEAR(even.llr(0.0, 5.0), -0.0345128, 1e-6);
+    CHECK_NEAR(even.llr(0.0, 10.0), -0.1379940, 1e-6);
+
+    // a score of 3/4 is 400 * log10(3) elo
+    const Pentanomial quarter = fromPairs(0, 0, 2, 4, 2);
+    CHECK_NEAR(quarter.score(), 0.75, 1e-12);
+    CHECK_NEAR(quarter.elo(), 400.0 * std::log10(3.0), 1e-9);
+
+    const Pentanomial ahead = fromPairs(1, 10, 40, 30, 19);
+    CHECK_NEAR(ahead.score(), 0.64, 1e-12);
+    CHECK_NEAR(ahead.variance(), 0.0554, 1e-12);
+    CHECK_NEAR(ahead.elo(), 99.95099, 1e-4);
+    CHECK_NEAR(ahead.eloError(), 34.92829, 1e-4);
+    CHECK_NEAR(ahead.llr(0.0, 5.0), 1.7715286, 1e-6);
+    CHECK_NEAR(ahead.llr(0.0, 10.0), 3.4489355, 1e-6);
+
+    // identical pairs have no variance, the 1e-3 floor applies
+    const Pentanomial draws = fromPairs(0, 0, 50, 0, 0);
+    CHECK_NEAR(draws.variance(), 0.0, 1e-12);
+    CHECK_NEAR(draws.llr(0.0, 5.0), -1.2942300, 1e-6);
+    CHECK_NEAR(draws.llr(0.0, 10.0), -5.1747767, 1e-6);
+
+    std::cout << (failures ? "FAILED" : "ok") << std::endl;
+    return failures != 0;
+}
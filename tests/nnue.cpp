@@ -0,0 +1,165 @@
+/*
+**    Yayo is a UCI chess engine written by am5083 (am@kvasm.us)
+**    Copyright (C) 2022 Ahmed Mohamed (am@kvasm.us)
+**
+**    This program is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**    This program is distributed in the hope that it will be useful,
+**    but WITHOUT ANY WARRANTY; without even the implied warranty of
+**    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**    GNU General Public License for more details.
+**
+**    You should have received a copy of the GNU General Public License
+**    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+** The lazily updated NNUE accumulators against a full refresh, over random
+** walks of moves and null moves that are made and unmade the way the search
+** does it. The network is random, only the feature bookkeeping and the
+** agreement of the AVX2 and scalar output layers are tested.
+*/
+
+#include "src/board.hpp"
+#include "src/movegen.hpp"
+#include "src/nnue.hpp"
+#include "tests/check.hpp"
+#include <cstring>
+#include <memory>
+#include <random>
+
+using namespace Yayo;
+using namespace Yayo::Bitboards;
+
+namespace {
+
+// castling both ways, en passant, promotions with and without a capture,
+// and bare kings crossing the mirroring and bucket lines
+const std::string fens[] = {
+      "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+      "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+      "rnbqkbnr/ppp1p1pp/8/3pPp2/8/8/PPPP1PPP/RNBQKBNR w KQkq f6 0 3",
+      "n1n5/PPPk4/8/8/8/8/4Kppp/5N1N b - - 0 1",
+      "8/2k5/8/8/8/8/5K2/8 w - - 0 1",
+};
+
+void randomNetwork(std::mt19937_64 &rng) {
+    auto net = std::make_unique<Network>();
+    auto small = [&](int range) {
+        return int(rng() % (2 * range + 1)) - range;
+    };
+
+    for (auto &b : net->ftBias)
+        b = small(32);
+    for (auto &row : net->ftWeights)
+        for (auto &w : row)
+            w = small(32);
+    for (auto &b : net->l2Bias)
+        b = small(1000);
+    for (auto &row : net->l2Weights)
+        for (auto &w : row)
+            w = small(16);
+    for (auto &b : net->l3Bias)
+        b = small(1000);
+    for (auto &row : net->l3Weights)
+        for (auto &w : row)
+            w = small(16);
+    net->outBias = small(1000);
+    for (auto &w : net->outWeights)
+        w = small(16);
+
+    nnue.net = std::move(net);
+}
+
+bool avx2 = false;
+
+// the accumulator on top of the stack has to equal one built from scratch
+void checkAgainstRefresh(Board &board) {
+    const int incremental = nnue.evaluate(board);
+
+    Accumulator fresh;
+    for (Color c : {WHITE, BLACK}) {
+        nnue.refresh(board, fresh, c);
+        CHECK(!std::memcmp(board.acc->values[c], fresh.values[c],
+                           sizeof(fresh.values[c])));
+    }
+
+    // the AVX2 layers have to agree with the scalar ones bit for bit
+    if (avx2) {
+        nnue.simd = false;
+        const int scalar = nnue.propagate(*board.acc, board.turn);
+        nnue.simd = true;
+        CHECK_EQ(nnue.propagate(*board.acc, board.turn), scalar);
+    }
+
+    Accumulator *acc = board.acc;
+    board.acc = nullptr;
+    CHECK_EQ(incremental, nnue.evaluate(board));
+    board.acc = acc;
+}
+
+void walk(const std::string &fen, std::mt19937_64 &rng) {
+    constexpr int plies = 64;
+    auto stack = std::make_unique<Accumulator[]>(plies + 1);
+    auto board = std::make_unique<Board>();
+
+    board->setFen(fen);
+    board->acc = stack.get();
+    stack[0].computed[WHITE] = stack[0].computed[BLACK] = false;
+    stack[0].dirty.refresh[WHITE] = stack[0].dirty.refresh[BLACK] = true;
+
+    // 0 stands for a null move
+    std::vector<unsigned short> line;
+    for (int ply = 0; ply < plies; ply++) {
+        moveList mList = {{{0}}};
+        generate(*board, &mList);
+        if (!mList.nMoves)
+            break;
+
+        if (!board->checkPcs && rng() % 8 == 0) {
+            line.push_back(0);
+            makeNullMove(*board);
+        } else {
+            line.push_back(mList.moves[rng() % mList.nMoves].move);
+            make(*board, line.back());
+        }
+
+        // skipped plies have to be caught up from further down the stack
+        if (rng() % 2)
+            checkAgainstRefresh(*board);
+    }
+
+    for (int i = int(line.size()) - 1; i >= 0; i--) {
+        if (line[i])
+            unmake(*board, line[i]);
+        else
+            unmakeNullMove(*board);
+
+        if (rng() % 4 == 0)
+            checkAgainstRefresh(*board);
+    }
+
+    CHECK(board->acc == stack.get());
+    checkAgainstRefresh(*board);
+}
+
+} // namespace
+
+int main() {
+    init_arrays();
+    initMvvLva();
+
+    std::mt19937_64 rng(2022);
+    randomNetwork(rng);
+    avx2 = nnue.simd = __builtin_cpu_supports("avx2");
+
+    for (const std::string &fen : fens)
+        for (int w = 0; w < 32; w++)
+            walk(fen, rng);
+
+    std::cout << (failures ? "FAILED" : "ok") << std::endl;
+    return failures != 0;
+}
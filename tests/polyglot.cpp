@@ -0,0 +1,81 @@
+/*
+**    Yayo is a UCI chess engine written by am5083 (am@kvasm.us)
+**    Copyright (C) 2022 Ahmed Mohamed (am@kvasm.us)
+**
+**    This program is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**    This program is distributed in the hope that it will be useful,
+**    but WITHOUT ANY WARRANTY; without even the implied warranty of
+**    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**    GNU General Public License for more details.
+**
+**    You should have received a copy of the GNU General Public License
+**    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+** Polyglot keys of the reference positions from the book format
+** description, the moves after the start position are in the comments
+*/
+
+#include "src/board.hpp"
+#include "tests/check.hpp"
+#include <memory>
+
+using namespace Yayo;
+using namespace Yayo::Bitboards;
+
+namespace {
+
+struct Reference {
+    std::string fen;
+    std::uint64_t key;
+};
+
+const Reference references[] = {
+      {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+       0x463b96181691fc9c},
+      // e4
+      {"rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq e3 0 1",
+       0x823c9b50fd114196},
+      // e4 d5
+      {"rnbqkbnr/ppp1pppp/8/3p4/4P3/8/PPPP1PPP/RNBQKBNR w KQkq d6 0 2",
+       0x0756b94461c50fb0},
+      // e4 d5 e5
+      {"rnbqkbnr/ppp1pppp/8/3pP3/8/8/PPPP1PPP/RNBQKBNR b KQkq - 0 2",
+       0x662fafb965db29d4},
+      // e4 d5 e5 f5
+      {"rnbqkbnr/ppp1p1pp/8/3pPp2/8/8/PPPP1PPP/RNBQKBNR w KQkq f6 0 3",
+       0x22a48b5a8e47ff78},
+      // e4 d5 e5 f5 Ke2
+      {"rnbqkbnr/ppp1p1pp/8/3pPp2/8/8/PPPPKPPP/RNBQ1BNR b kq - 0 3",
+       0x652a607ca3f242c1},
+      // e4 d5 e5 f5 Ke2 Kf7
+      {"rnbq1bnr/ppp1pkpp/8/3pPp2/8/8/PPPPKPPP/RNBQ1BNR w - - 0 4",
+       0x00fdd303c946bdd9},
+      // a4 b5 h4 b4 c4
+      {"rnbqkbnr/p1pppppp/8/8/PpP4P/8/1P1PPPP1/RNBQKBNR b KQkq c3 0 3",
+       0x3c8123ea7b067637},
+      // a4 b5 h4 b4 c4 bxc3 Ra3
+      {"rnbqkbnr/p1pppppp/8/8/P6P/R1p5/1P1PPPP1/1NBQKBNR b Kkq - 0 4",
+       0x5c3f9b829b279560},
+};
+
+} // namespace
+
+int main() {
+    init_arrays();
+
+    std::unique_ptr<Board> board = std::make_unique<Board>();
+
+    for (const Reference &r : references) {
+        board->setFen(r.fen);
+        CHECK_EQ(board->polyglotKey(), r.key);
+    }
+
+    std::cout << (failures ? "FAILED" : "ok") << std::endl;
+    return failures != 0;
+}
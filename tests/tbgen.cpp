@@ -0,0 +1,1103 @@
+/*
+**    Yayo is a UCI chess engine written by am5083 (am@kvasm.us)
+**    Copyright (C) 2022 Ahmed Mohamed (am@kvasm.us)
+**
+**    This program is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**    This program is distributed in the hope that it will be useful,
+**    but WITHOUT ANY WARRANTY; without even the implied warranty of
+**    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**    GNU General Public License for more details.
+**
+**    You should have received a copy of the GNU General Public License
+**    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+** Writes the small Syzygy tables in tests/syzygy: tbgen <dir>
+**
+** Each ending is solved by retrograde analysis, first win/draw/loss and then
+** dtz in plies, and stored in the compressed format of the real tables:
+** recursive pairing, canonical huffman codes, blocks with a sparse index and
+** per-class dtz maps. The index layout is written out separately from
+** tbprobe.cpp's, so a mistake in either shows up as misread values.
+*/
+
+#include "src/board.hpp"
+#include "src/movegen.hpp"
+#include "src/tbprobe.hpp"
+#include <algorithm>
+#include <array>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <queue>
+#include <unordered_map>
+
+using namespace Yayo;
+using namespace Yayo::Bitboards;
+
+namespace {
+
+constexpr int TB_PIECES = 7;
+
+enum TBType { TB_WDL, TB_DTZ };
+enum TBFlag {
+    TBF_MAPPED = 2,
+    TBF_WIN_PLIES = 4,
+    TBF_LOSS_PLIES = 8,
+    TBF_SINGLE_VALUE = 128,
+};
+
+// solver state of a raw position, S_MATED is or-ed into S_LOSS
+enum State : std::uint8_t { S_INVALID, S_UNKNOWN, S_WIN, S_LOSS, S_DRAW };
+constexpr std::uint8_t S_MATED = 8;
+
+constexpr int BLOCK_BITS = 6;
+constexpr int SPAN_BITS = 10;
+constexpr int MAX_SYMBOLS = 1024;
+constexpr int MIN_PAIRS = 16;
+
+// one material combination, white is the stronger side. Raw positions are
+// indexed by side to move and then 6 bits per piece in pcs order.
+struct Ending {
+    std::string name;
+    std::vector<Piece> pcs;
+    Color dtzSide;
+    std::uint64_t key, key2;
+    std::size_t size;
+    std::vector<std::uint8_t> state, dtz;
+};
+
+std::map<std::uint64_t, Ending *> endings;
+
+Ending makeEnding(const std::string &name, Color dtzSide) {
+    Ending t;
+    int counts[2][PT_MAX] = {};
+    int side = -1;
+
+    t.name = name;
+    t.dtzSide = dtzSide;
+
+    for (char c : name) {
+        if (c == 'v')
+            continue;
+
+        const PieceT pt = c == 'P'   ? PAWN
+                          : c == 'N' ? KNIGHT
+                          : c == 'B' ? BISHOP
+                          : c == 'R' ? ROOK
+                          : c == 'Q' ? QUEEN
+                                     : KING;
+        side += pt == KING;
+        t.pcs.push_back(getCPiece(Color(side), pt));
+        counts[side][pt]++;
+    }
+
+    t.key = materialKeyOf(counts);
+    std::swap(counts[WHITE], counts[BLACK]);
+    t.key2 = materialKeyOf(counts);
+
+    t.size = 2;
+    for (std::size_t i = 0; i < t.pcs.size(); i++)
+        t.size *= 64;
+
+    return t;
+}
+
+void decode(const Ending &t, std::size_t idx, int &stm, int *sq) {
+    for (int i = int(t.pcs.size()) - 1; i >= 0; i--) {
+        sq[i] = idx & 63;
+        idx >>= 6;
+    }
+
+    stm = int(idx);
+}
+
+std::size_t encode(const Ending &t, int stm, const int *sq) {
+    std::size_t idx = stm;
+    for (std::size_t i = 0; i < t.pcs.size(); i++)
+        idx = idx * 64 + sq[i];
+
+    return idx;
+}
+
+bool isPawnRank(int sq) { return sq >= 8 && sq < 56; }
+
+void place(Board &board, const Ending &t, int stm, const int *sq) {
+    for (std::size_t i = 0; i < t.pcs.size(); i++) {
+        const Piece pc = t.pcs[i];
+        const Bitboard bb = SQUARE_BB(Square(sq[i]));
+
+        board.board[sq[i]] = pc;
+        board.pieceBB[pc] |= bb;
+        board.cPieceBB[getPcType(pc)] |= bb;
+        board.color[pc >> 3] |= bb;
+    }
+
+    board.turn = Color(stm);
+    const Square ksq = Square(__builtin_ctzll(board.pieces(KING, Color(stm))));
+    board.checkPcs = stm == WHITE
+                           ? board.attacksToKing<BLACK>(ksq, board.pieces())
+                           : board.attacksToKing<WHITE>(ksq, board.pieces());
+}
+
+void remove(Board &board, const Ending &t, const int *sq) {
+    for (std::size_t i = 0; i < t.pcs.size(); i++) {
+        const Piece pc = t.pcs[i];
+
+        board.board[sq[i]] = NO_PC;
+        board.pieceBB[pc] = 0;
+        board.cPieceBB[getPcType(pc)] = 0;
+    }
+
+    board.color[WHITE] = board.color[BLACK] = 0;
+    board.checkPcs = 0;
+}
+
+// distinct squares, pawns off the back ranks and the side that just moved
+// not in check
+bool legal(Board &board, const Ending &t, int stm, const int *sq) {
+    for (std::size_t a = 0; a < t.pcs.size(); a++) {
+        if (getPcType(t.pcs[a]) == PAWN && !isPawnRank(sq[a]))
+            return false;
+        for (std::size_t b = a + 1; b < t.pcs.size(); b++)
+            if (sq[a] == sq[b])
+                return false;
+    }
+
+    place(board, t, stm, sq);
+    const Color other = Color(stm ^ 1);
+    const Square ksq = Square(__builtin_ctzll(board.pieces(KING, other)));
+    const bool ok = !board.isSqAttacked(ksq, board.pieces(), Color(stm));
+    remove(board, t, sq);
+
+    return ok;
+}
+
+// state of the position on the board from its side to move, out of the
+// ending solved for its material
+std::uint8_t lookup(const Board &board) {
+    if (popcount(board.pieces()) == 2)
+        return S_DRAW;
+
+    const auto it = endings.find(board.materialKey());
+    if (it == endings.end()) {
+        std::cerr << "tbgen: no ending for a position after a capture\n";
+        std::exit(1);
+    }
+
+    const Ending &t = *it->second;
+    Bitboard used = 0;
+    int sq[TB_PIECES];
+
+    for (std::size_t i = 0; i < t.pcs.size(); i++) {
+        sq[i] = __builtin_ctzll(board.pieceBB[t.pcs[i]] & ~used);
+        used |= SQUARE_BB(Square(sq[i]));
+    }
+
+    return t.state[encode(t, board.turn, sq)];
+}
+
+bool isExit(unsigned short move) { return getCapture(move) >= CAPTURE; }
+
+bool zeroing(const Board &board, unsigned short move) {
+    return isExit(move) || getPcType(board.board[getFrom(move)]) == PAWN;
+}
+
+// squares a piece on sq could have come from without capturing, pawn
+// pushes only when pawns is set
+Bitboard unmoves(Piece pc, int sq, Bitboard occ, bool pawns) {
+    const Square s = Square(sq);
+
+    switch (getPcType(pc)) {
+    case PAWN: {
+        // white pawns move towards a8 = 0
+        const int dir = pc == W_PAWN ? 8 : -8;
+        const int from = sq + dir;
+        if (!pawns || !isPawnRank(from) || (occ & SQUARE_BB(Square(from))))
+            return 0;
+
+        Bitboard b = SQUARE_BB(Square(from));
+        const bool fourthRank = pc == W_PAWN ? (sq >> 3) == 4 : (sq >> 3) == 3;
+        if (fourthRank && !(occ & SQUARE_BB(Square(from + dir))))
+            b |= SQUARE_BB(Square(from + dir));
+
+        return b;
+    }
+    case KNIGHT:
+        return knightAttacks[s] & ~occ;
+    case BISHOP:
+        return getBishopAttacks(s, occ) & ~occ;
+    case ROOK:
+        return getRookAttacks(s, occ) & ~occ;
+    case QUEEN:
+        return (getBishopAttacks(s, occ) | getRookAttacks(s, occ)) & ~occ;
+    case KING:
+        return kingAttacks[s] & ~occ;
+    default:
+        return 0;
+    }
+}
+
+// calls f(predecessor index) for every position that reaches idx with a
+// move of the other side that stays inside the ending
+template <typename F>
+void predecessors(const Ending &t, std::size_t idx, bool pawns, F f) {
+    int stm, sq[TB_PIECES];
+    decode(t, idx, stm, sq);
+
+    Bitboard occ = 0;
+    for (std::size_t i = 0; i < t.pcs.size(); i++)
+        occ |= SQUARE_BB(Square(sq[i]));
+
+    const int mover = stm ^ 1;
+
+    for (std::size_t i = 0; i < t.pcs.size(); i++) {
+        if ((t.pcs[i] >> 3) != mover)
+            continue;
+
+        for (Bitboard from = unmoves(t.pcs[i], sq[i], occ, pawns); from;
+             from &= from - 1) {
+            int prev[TB_PIECES];
+            std::copy(sq, sq + t.pcs.size(), prev);
+            prev[i] = __builtin_ctzll(from);
+            f(encode(t, mover, prev));
+        }
+    }
+}
+
+// Win/draw/loss without the 50-move rule, the same way the bitbases are
+// built: moves leaving the ending are looked up, the ones staying inside
+// are counted, and results are pushed back with un-moves.
+void solveWdl(Ending &t, Board &board) {
+    std::vector<std::uint8_t> degree(t.size);
+    std::vector<std::size_t> frontier;
+
+    t.state.assign(t.size, S_INVALID);
+
+    for (std::size_t idx = 0; idx < t.size; idx++) {
+        int stm, sq[TB_PIECES];
+        decode(t, idx, stm, sq);
+
+        if (!legal(board, t, stm, sq))
+            continue;
+
+        place(board, t, stm, sq);
+
+        moveList mList = {{{0}}};
+        generate(board, &mList);
+
+        std::uint8_t result = S_UNKNOWN;
+        int inside = 0;
+
+        if (!mList.nMoves)
+            result = board.checkPcs ? S_LOSS | S_MATED : S_DRAW;
+
+        for (int m = 0; m < mList.nMoves && result == S_UNKNOWN; m++) {
+            const unsigned short move = mList.moves[m].move;
+
+            if (!isExit(move)) {
+                inside++;
+                continue;
+            }
+
+            make(board, move);
+            const std::uint8_t r = lookup(board) & 7;
+            unmake(board, move);
+
+            if (r == S_LOSS)
+                result = S_WIN;
+            else if (r == S_DRAW)
+                inside++; // never decremented, keeps this from losing
+        }
+
+        if (result == S_UNKNOWN && !inside)
+            result = S_LOSS;
+
+        remove(board, t, sq);
+        t.state[idx] = result;
+        degree[idx] = inside;
+
+        if ((result & 7) == S_WIN || (result & 7) == S_LOSS)
+            frontier.push_back(idx);
+    }
+
+    while (!frontier.empty()) {
+        std::vector<std::size_t> next;
+
+        for (std::size_t idx : frontier) {
+            const std::uint8_t value = t.state[idx] & 7;
+
+            predecessors(t, idx, true, [&](std::size_t p) {
+                if (t.state[p] != S_UNKNOWN)
+                    return;
+
+                if (value == S_LOSS) {
+                    t.state[p] = S_WIN;
+                    next.push_back(p);
+                } else if (--degree[p] == 0) {
+                    t.state[p] = S_LOSS;
+                    next.push_back(p);
+                }
+            });
+        }
+
+        frontier.swap(next);
+    }
+
+    for (std::uint8_t &s : t.state)
+        if (s == S_UNKNOWN)
+            s = S_DRAW;
+}
+
+// Plies to the next zeroing move. A win is 1 with a zeroing move that
+// wins or a mate, else one more than its fastest losing reply; a loss is 1
+// when mated or when every move zeroes, else one more than its slowest
+// reply. Solved level by level with un-moves that don't zero.
+bool solveDtz(Ending &t, Board &board) {
+    std::vector<std::uint8_t> degree(t.size);
+    std::vector<std::size_t> mated, level;
+
+    t.dtz.assign(t.size, 0);
+
+    for (std::size_t idx = 0; idx < t.size; idx++) {
+        const std::uint8_t s = t.state[idx] & 7;
+        if (s != S_WIN && s != S_LOSS)
+            continue;
+
+        if (t.state[idx] & S_MATED) {
+            t.dtz[idx] = 1;
+            mated.push_back(idx);
+            continue;
+        }
+
+        int stm, sq[TB_PIECES];
+        decode(t, idx, stm, sq);
+        place(board, t, stm, sq);
+
+        moveList mList = {{{0}}};
+        generate(board, &mList);
+
+        int quiet = 0;
+        bool zeroingWin = false;
+
+        for (int m = 0; m < mList.nMoves; m++) {
+            const unsigned short move = mList.moves[m].move;
+
+            if (!zeroing(board, move)) {
+                quiet++;
+                continue;
+            }
+
+            if (s == S_WIN && !zeroingWin) {
+                make(board, move);
+                zeroingWin = (lookup(board) & 7) == S_LOSS;
+                unmake(board, move);
+            }
+        }
+
+        remove(board, t, sq);
+
+        if ((s == S_WIN && zeroingWin) || (s == S_LOSS && !quiet)) {
+            t.dtz[idx] = 1;
+            level.push_back(idx);
+        }
+
+        degree[idx] = quiet;
+    }
+
+    // mates first, a move into one is worth 1 rather than 2
+    level.insert(level.begin(), mated.begin(), mated.end());
+
+    for (int ply = 1; !level.empty(); ply++) {
+        std::vector<std::size_t> next;
+
+        for (std::size_t i = 0; i < level.size(); i++) {
+            const std::size_t idx = level[i];
+            const std::uint8_t value = t.state[idx] & 7;
+            const bool mate = t.state[idx] & S_MATED;
+
+            predecessors(t, idx, false, [&](std::size_t p) {
+                const std::uint8_t s = t.state[p] & 7;
+                if (t.dtz[p] || s == S_INVALID)
+                    return;
+
+                if (value == S_LOSS && s == S_WIN) {
+                    t.dtz[p] = mate ? 1 : ply + 1;
+                    (mate ? level : next).push_back(p);
+                } else if (value == S_WIN && s == S_LOSS && --degree[p] == 0) {
+                    t.dtz[p] = ply + 1;
+                    next.push_back(p);
+                }
+            });
+        }
+
+        level.swap(next);
+    }
+
+    int longest = 0;
+    for (std::size_t idx = 0; idx < t.size; idx++) {
+        const std::uint8_t s = t.state[idx] & 7;
+        if ((s == S_WIN || s == S_LOSS) && !t.dtz[idx]) {
+            std::cerr << "tbgen: " << t.name << " has a result without dtz\n";
+            return false;
+        }
+        longest = std::max(longest, int(t.dtz[idx]));
+    }
+
+    // cursed wins would need the 50-move rule in the solver
+    if (longest > 100) {
+        std::cerr << "tbgen: " << t.name << " needs more than 100 plies\n";
+        return false;
+    }
+
+    std::cout << t.name << ": longest dtz " << longest << std::endl;
+    return true;
+}
+
+// one side and file worth of bytes, in the order the file keeps them
+struct Packed {
+    std::vector<std::uint8_t> sizes, sparse, lengths, blocks;
+};
+
+void putLE(std::vector<std::uint8_t> &out, std::uint64_t v, int bytes) {
+    for (int i = 0; i < bytes; i++)
+        out.push_back(std::uint8_t(v >> (8 * i)));
+}
+
+// huffman code lengths, zero for symbols that never occur
+std::vector<int> codeLengths(const std::vector<std::uint64_t> &freq) {
+    std::vector<int> length(freq.size(), 0);
+    std::vector<std::uint64_t> f = freq;
+
+    while (true) {
+        using Node = std::pair<std::uint64_t, int>;
+        std::priority_queue<Node, std::vector<Node>, std::greater<Node>> heap;
+        std::vector<int> parent;
+
+        for (std::size_t s = 0; s < f.size(); s++) {
+            if (f[s]) {
+                heap.push({f[s], int(parent.size())});
+                parent.push_back(-1);
+            }
+        }
+
+        std::vector<int> leafOf;
+        for (std::size_t s = 0; s < f.size(); s++)
+            if (f[s])
+                leafOf.push_back(int(s));
+
+        const int leaves = int(parent.size());
+        while (heap.size() > 1) {
+            const Node a = heap.top();
+            heap.pop();
+            const Node b = heap.top();
+            heap.pop();
+
+            parent.push_back(-1);
+            parent[a.second] = parent[b.second] = int(parent.size()) - 1;
+            heap.push({a.first + b.first, int(parent.size()) - 1});
+        }
+
+        int longest = 0;
+        for (int i = 0; i < leaves; i++) {
+            int depth = 0;
+            for (int n = i; parent[n] != -1; n = parent[n])
+                depth++;
+
+            length[leafOf[i]] = depth;
+            longest = std::max(longest, depth);
+        }
+
+        // the decoder refills 32 bits at a time
+        if (longest <= 32)
+            return length;
+
+        for (std::uint64_t &x : f)
+            if (x)
+                x = (x >> 1) | 1;
+    }
+}
+
+Packed pack(const std::vector<int> &values, std::uint8_t flags) {
+    Packed p;
+
+    if (std::all_of(values.begin(), values.end(),
+                    [&](int v) { return v == values[0]; })) {
+        p.sizes = {std::uint8_t(flags | TBF_SINGLE_VALUE),
+                   std::uint8_t(values[0])};
+        return p;
+    }
+
+    // leaves first, then pairs of the most frequent neighbours
+    std::vector<std::array<int, 2>> tree;
+    std::vector<int> expanded;
+    std::map<int, int> leaf;
+
+    for (int v : values) {
+        if (!leaf.count(v)) {
+            leaf[v] = int(tree.size());
+            tree.push_back({v, 0xFFF});
+            expanded.push_back(1);
+        }
+    }
+
+    std::vector<int> seq;
+    for (int v : values)
+        seq.push_back(leaf[v]);
+
+    while (int(tree.size()) < MAX_SYMBOLS) {
+        std::unordered_map<int, int> count;
+        for (std::size_t i = 0; i + 1 < seq.size(); i++) {
+            count[seq[i] << 12 | seq[i + 1]]++;
+            // a run of one symbol only pairs up every other step
+            if (seq[i] == seq[i + 1] && i + 2 < seq.size() &&
+                seq[i + 2] == seq[i])
+                i++;
+        }
+
+        // ties go to the lowest pair so the output doesn't depend on the
+        // hash order
+        int best = 0, bestCount = 0;
+        for (auto [pair, n] : count) {
+            if (expanded[pair >> 12] + expanded[pair & 0xFFF] <= 256 &&
+                (n > bestCount || (n == bestCount && pair < best))) {
+                best = pair;
+                bestCount = n;
+            }
+        }
+
+        if (bestCount < MIN_PAIRS)
+            break;
+
+        const int sym = int(tree.size());
+        const int l = best >> 12, r = best & 0xFFF;
+        tree.push_back({l, r});
+        expanded.push_back(expanded[l] + expanded[r]);
+
+        std::vector<int> next;
+        for (std::size_t i = 0; i < seq.size(); i++) {
+            if (i + 1 < seq.size() && seq[i] == l && seq[i + 1] == r) {
+                next.push_back(sym);
+                i++;
+            } else
+                next.push_back(seq[i]);
+        }
+
+        seq.swap(next);
+    }
+
+    std::vector<std::uint64_t> freq(tree.size(), 0);
+    for (int s : seq)
+        freq[s]++;
+
+    // a single coded symbol still needs a one bit code, add a dummy one
+    if (std::count_if(freq.begin(), freq.end(),
+                      [](std::uint64_t f) { return f > 0; }) == 1)
+        freq[freq[0] ? 1 : 0] = 1;
+
+    std::vector<int> length = codeLengths(freq);
+
+    // canonical numbering: longest codes get the lowest symbols, symbols
+    // that are only used inside pairs come last
+    std::vector<int> order(tree.size());
+    for (std::size_t s = 0; s < order.size(); s++)
+        order[s] = int(s);
+    std::stable_sort(order.begin(), order.end(),
+                     [&](int a, int b) { return length[a] > length[b]; });
+
+    std::vector<int> number(tree.size());
+    for (std::size_t i = 0; i < order.size(); i++)
+        number[order[i]] = int(i);
+
+    int minLen = 64, maxLen = 0;
+    for (int l : length) {
+        if (l) {
+            minLen = std::min(minLen, l);
+            maxLen = std::max(maxLen, l);
+        }
+    }
+
+    std::vector<int> lowest(maxLen - minLen + 1), count(maxLen - minLen + 1);
+    std::vector<std::uint64_t> base(maxLen - minLen + 1);
+    for (int l : length)
+        if (l)
+            count[l - minLen]++;
+
+    lowest.back() = 0;
+    base.back() = 0;
+    for (int i = int(lowest.size()) - 2; i >= 0; i--) {
+        lowest[i] = lowest[i + 1] + count[i + 1];
+        base[i] = (base[i + 1] + count[i + 1]) / 2;
+    }
+
+    if (base[0] + count[0] != (1ULL << minLen)) {
+        std::cerr << "tbgen: incomplete huffman code\n";
+        std::exit(1);
+    }
+
+    // blocks of whole symbols, codes msb first
+    const std::size_t blockSize = 1 << BLOCK_BITS;
+    std::vector<std::uint64_t> blockStart;
+    std::vector<int> blockValues;
+    std::size_t bit = blockSize * 8;
+    std::uint64_t start = 0;
+
+    for (int s : seq) {
+        const int l = length[s];
+        if (bit + l > blockSize * 8 ||
+            blockValues.back() + expanded[s] > 65536) {
+            p.blocks.resize(p.blocks.size() + blockSize, 0);
+            blockStart.push_back(start);
+            blockValues.push_back(0);
+            bit = 0;
+        }
+
+        const std::uint64_t code =
+              base[l - minLen] + (number[s] - lowest[l - minLen]);
+        std::uint8_t *block = &p.blocks[p.blocks.size() - blockSize];
+
+        for (int i = l - 1; i >= 0; i--, bit++)
+            if ((code >> i) & 1)
+                block[bit / 8] |= 0x80 >> (bit % 8);
+
+        blockValues.back() += expanded[s];
+        start += expanded[s];
+    }
+
+    for (int n : blockValues)
+        putLE(p.lengths, n - 1, 2);
+
+    // entry k locates value k * span + span / 2
+    const std::uint64_t span = 1ULL << SPAN_BITS;
+    for (std::uint64_t k = 0; k < (values.size() + span - 1) / span; k++) {
+        const std::uint64_t v = k * span + span / 2;
+        const std::size_t b =
+              std::upper_bound(blockStart.begin(), blockStart.end(), v) -
+              blockStart.begin() - 1;
+
+        putLE(p.sparse, b, 4);
+        putLE(p.sparse, v - blockStart[b], 2);
+    }
+
+    p.sizes.push_back(flags);
+    p.sizes.push_back(BLOCK_BITS);
+    p.sizes.push_back(SPAN_BITS);
+    p.sizes.push_back(0); // no blockLength padding
+    putLE(p.sizes, blockValues.size(), 4);
+    p.sizes.push_back(maxLen);
+    p.sizes.push_back(minLen);
+    for (int l : lowest)
+        putLE(p.sizes, l, 2);
+    putLE(p.sizes, tree.size(), 2);
+
+    std::vector<std::array<int, 2>> numbered(tree.size());
+    for (std::size_t s = 0; s < tree.size(); s++) {
+        const bool isLeaf = tree[s][1] == 0xFFF;
+        numbered[number[s]] = {isLeaf ? tree[s][0] : number[tree[s][0]],
+                               isLeaf ? 0xFFF : number[tree[s][1]]};
+    }
+
+    for (auto [l, r] : numbered) {
+        p.sizes.push_back(std::uint8_t(l));
+        p.sizes.push_back(std::uint8_t(((l >> 8) & 0xF) | ((r & 0xF) << 4)));
+        p.sizes.push_back(std::uint8_t(r >> 4));
+    }
+
+    if (tree.size() & 1)
+        p.sizes.push_back(0);
+
+    return p;
+}
+
+// dtz symbols index a per-class map of dtz - 1 values, most frequent first
+struct DtzMap {
+    std::vector<int> values[2]; // [win, loss]
+
+    void build(const std::vector<int> &dtz, const std::vector<int> &wdl) {
+        for (int c = 0; c < 2; c++) {
+            std::map<int, std::uint64_t> freq;
+            for (std::size_t i = 0; i < dtz.size(); i++)
+                if (wdl[i] == (c ? WDL_LOSS : WDL_WIN))
+                    freq[dtz[i] - 1]++;
+
+            std::vector<std::pair<std::uint64_t, int>> byFreq;
+            for (auto [v, n] : freq)
+                byFreq.push_back({n, v});
+            std::stable_sort(
+                  byFreq.begin(), byFreq.end(),
+                  [](auto &a, auto &b) { return a.first > b.first; });
+
+            values[c].clear();
+            for (auto [n, v] : byFreq)
+                values[c].push_back(v);
+        }
+    }
+
+    int symbol(int dtz, int wdl) const {
+        const std::vector<int> &m = values[wdl == WDL_LOSS];
+        return int(std::find(m.begin(), m.end(), dtz - 1) - m.begin());
+    }
+};
+
+// The index of the published format, written out again from its
+// description instead of calling tbprobe.cpp: the leading group is numbered
+// by walking its canonical squares in the documented order, then every
+// further group of like pieces adds its combination of free squares.
+// Squares are a1 = 0 here. Only what these endings need: a unique piece
+// or a single pawn of the stronger side leads.
+struct Layout {
+    std::vector<Piece> order;
+    std::vector<int> groupLen;
+    bool pawns = false;
+    std::vector<int> lead; // [s0][s1][s2] of the leading pieces, or -1
+    std::uint64_t leadSize[4] = {}, size[4] = {};
+
+    explicit Layout(const Ending &t);
+    int files() const { return pawns ? 4 : 1; }
+    std::uint64_t index(const int *squares, int &file) const;
+};
+
+std::uint64_t choose(int n, int k) {
+    std::uint64_t r = 1;
+    for (int i = 0; i < k; i++)
+        r = r * (n - i) / (i + 1);
+    return n < k ? 0 : r;
+}
+
+int rankOfSq(int s) { return s >> 3; }
+int fileOfSq(int s) { return s & 7; }
+
+Layout::Layout(const Ending &t) {
+    for (Piece pc : t.pcs)
+        if (getPcType(pc) == PAWN)
+            order.push_back(pc);
+    pawns = !order.empty();
+    for (Piece pc : t.pcs)
+        if (getPcType(pc) != PAWN)
+            order.push_back(pc);
+
+    // pawns lead alone, pieces three at a time
+    groupLen.push_back(pawns ? 1 : 3);
+    for (std::size_t i = groupLen[0]; i < order.size(); i++) {
+        if (i > std::size_t(groupLen[0]) && order[i] == order[i - 1])
+            groupLen.back()++;
+        else
+            groupLen.push_back(1);
+    }
+
+    if ((pawns && order[1] == order[0]) ||
+        (!pawns && order.size() > 3 && order[3] == order[2])) {
+        std::cerr << "tbgen: " << t.name << " needs a wider leading group\n";
+        std::exit(1);
+    }
+
+    if (pawns) {
+        // the leading pawn on files a-d, one table per file, by rank
+        for (int f = 0; f < 4; f++)
+            leadSize[f] = 6;
+    } else {
+        std::vector<int> triangle, diagonal, corner, below;
+        for (int s = 0; s < 64; s++) {
+            const bool inCorner = rankOfSq(s) < 4 && fileOfSq(s) < 4;
+            if (rankOfSq(s) == fileOfSq(s)) {
+                diagonal.push_back(s);
+                if (inCorner)
+                    corner.push_back(s);
+            } else if (rankOfSq(s) < fileOfSq(s)) {
+                below.push_back(s);
+                if (inCorner)
+                    triangle.push_back(s);
+            }
+        }
+
+        lead.assign(64 * 64 * 64, -1);
+        int n = 0;
+        auto add = [&](int s0, int s1, int s2) {
+            if (s0 != s1 && s0 != s2 && s1 != s2)
+                lead[(s0 * 64 + s1) * 64 + s2] = n++;
+        };
+
+        // the first piece below the diagonal of the a1-d1-d4 triangle
+        for (int s0 : triangle)
+            for (int s1 = 0; s1 < 64; s1++)
+                for (int s2 = 0; s2 < 64; s2++)
+                    add(s0, s1, s2);
+
+        // on the diagonal, then the first piece off it below it
+        for (int s0 : corner)
+            for (int s1 : below)
+                for (int s2 = 0; s2 < 64; s2++)
+                    add(s0, s1, s2);
+
+        for (int s0 : corner)
+            for (int s1 : diagonal)
+                for (int s2 : below)
+                    add(s0, s1, s2);
+
+        for (int s0 : corner)
+            for (int s1 : diagonal)
+                for (int s2 : diagonal)
+                    add(s0, s1, s2);
+
+        leadSize[0] = n;
+    }
+
+    for (int f = 0; f < files(); f++) {
+        int free = 64 - groupLen[0];
+        size[f] = leadSize[f];
+        for (std::size_t g = 1; g < groupLen.size(); g++) {
+            size[f] *= choose(free, groupLen[g]);
+            free -= groupLen[g];
+        }
+    }
+}
+
+std::uint64_t Layout::index(const int *squares, int &file) const {
+    std::vector<int> sq(squares, squares + order.size());
+
+    if (fileOfSq(sq[0]) > 3)
+        for (int &s : sq)
+            s ^= 7;
+
+    std::uint64_t idx;
+    file = 0;
+
+    if (pawns) {
+        file = fileOfSq(sq[0]);
+        idx = rankOfSq(sq[0]) - 1;
+    } else {
+        if (rankOfSq(sq[0]) > 3)
+            for (int &s : sq)
+                s ^= 56;
+
+        // the first leading piece off the diagonal goes below it
+        for (int i = 0; i < 3; i++) {
+            if (rankOfSq(sq[i]) == fileOfSq(sq[i]))
+                continue;
+
+            if (rankOfSq(sq[i]) > fileOfSq(sq[i]))
+                for (int &s : sq)
+                    s = fileOfSq(s) * 8 + rankOfSq(s);
+            break;
+        }
+
+        idx = lead[(sq[0] * 64 + sq[1]) * 64 + sq[2]];
+    }
+
+    // each group ranks its sorted squares among those left by the earlier
+    // groups
+    std::uint64_t factor = leadSize[file];
+    int done = groupLen[0], free = 64 - groupLen[0];
+
+    for (std::size_t g = 1; g < groupLen.size(); g++) {
+        std::sort(sq.begin() + done, sq.begin() + done + groupLen[g]);
+
+        std::uint64_t rank = 0;
+        for (int i = 0; i < groupLen[g]; i++) {
+            const int s = sq[done + i];
+            const int taken = int(std::count_if(
+                  sq.begin(), sq.begin() + done, [&](int o) { return o < s; }));
+            rank += choose(s - taken, i + 1);
+        }
+
+        idx += rank * factor;
+        factor *= choose(free, groupLen[g]);
+        free -= groupLen[g];
+        done += groupLen[g];
+    }
+
+    return idx;
+}
+
+bool writeTable(const Ending &t, TBType type, const std::string &dir) {
+    const Layout layout(t);
+    const std::vector<Piece> &order = layout.order;
+    const int sides = type == TB_WDL && t.key != t.key2 ? 2 : 1;
+    const int files = layout.files();
+    const std::uint8_t stmFlag = type == TB_DTZ && t.dtzSide == BLACK;
+
+    // values[side][file], -1 where nothing legal maps
+    std::vector<int> values[2][4], wdls[2][4];
+    for (int f = 0; f < files; f++) {
+        for (int i = 0; i < sides; i++) {
+            values[i][f].assign(layout.size[f], -1);
+            wdls[i][f].assign(layout.size[f], WDL_DRAW);
+        }
+    }
+
+    for (std::size_t idx = 0; idx < t.size; idx++) {
+        const std::uint8_t s = t.state[idx] & 7;
+        int stm, sq[TB_PIECES], squares[TB_PIECES];
+        decode(t, idx, stm, sq);
+
+        if (s == S_INVALID || (type == TB_DTZ && stm != t.dtzSide))
+            continue;
+
+        // the squares in file order, flipped to a1 = 0
+        Bitboard used = 0;
+        for (std::size_t k = 0; k < order.size(); k++) {
+            for (std::size_t j = 0; j < t.pcs.size(); j++) {
+                if (t.pcs[j] == order[k] && !(used >> j & 1)) {
+                    squares[k] = sq[j] ^ 56;
+                    used |= 1ULL << j;
+                    break;
+                }
+            }
+        }
+
+        int f;
+        const std::uint64_t tbIdx = layout.index(squares, f);
+
+        const int wdl = s == S_WIN    ? WDL_WIN
+                        : s == S_LOSS ? WDL_LOSS
+                                      : WDL_DRAW;
+        const int value = type == TB_WDL ? wdl + 2 : t.dtz[idx];
+        const int side = type == TB_WDL ? stm : 0;
+
+        if (type == TB_DTZ && wdl == WDL_DRAW)
+            continue;
+
+        if (tbIdx >= layout.size[f]) {
+            std::cerr << "tbgen: " << t.name << " index " << tbIdx
+                      << " out of range\n";
+            return false;
+        }
+
+        int &slot = values[side][f][tbIdx];
+        if (slot != -1 && slot != value) {
+            std::cerr << "tbgen: " << t.name << " index " << tbIdx
+                      << " holds two different values\n";
+            return false;
+        }
+
+        slot = value;
+        wdls[side][f][tbIdx] = wdl;
+    }
+
+    std::vector<std::uint8_t> out =
+          type == TB_WDL ? std::vector<std::uint8_t>{0x71, 0xE8, 0x23, 0x5D}
+                         : std::vector<std::uint8_t>{0xD7, 0x66, 0x0C, 0xA5};
+
+    out.push_back((sides == 2) | (layout.pawns << 1));
+    for (int f = 0; f < files; f++) {
+        out.push_back(0); // both sides: leading group first in the index
+        for (Piece pc : order)
+            out.push_back(std::uint8_t(pc | (sides == 2 ? pc << 4 : 0)));
+    }
+    out.resize(out.size() + (out.size() & 1));
+
+    Packed packed[2][4];
+    DtzMap maps[4];
+
+    for (int f = 0; f < files; f++) {
+        for (int i = 0; i < sides; i++) {
+            std::vector<int> &v = values[i][f];
+            std::uint8_t flags = stmFlag;
+
+            if (type == TB_DTZ) {
+                maps[f].build(v, wdls[i][f]);
+                for (std::size_t k = 0; k < v.size(); k++)
+                    if (v[k] != -1)
+                        v[k] = maps[f].symbol(v[k], wdls[i][f][k]);
+                flags |= TBF_MAPPED | TBF_WIN_PLIES | TBF_LOSS_PLIES;
+            }
+
+            // don't care entries repeat their neighbour, pairs love runs
+            int last = *std::max_element(v.begin(), v.end());
+            for (int &x : v)
+                x = x == -1 ? std::max(last, 0) : (last = x);
+
+            packed[i][f] = pack(v, flags);
+            out.insert(out.end(), packed[i][f].sizes.begin(),
+                       packed[i][f].sizes.end());
+        }
+    }
+
+    if (type == TB_DTZ) {
+        for (int f = 0; f < files; f++) {
+            if (!(packed[0][f].sizes[0] & TBF_MAPPED))
+                continue;
+
+            for (int m = 0; m < 4; m++) {
+                const std::vector<int> none;
+                const std::vector<int> &vals = m < 2 ? maps[f].values[m] : none;
+                out.push_back(std::uint8_t(vals.size()));
+                for (int v : vals)
+                    out.push_back(std::uint8_t(v));
+            }
+        }
+        out.resize(out.size() + (out.size() & 1));
+    }
+
+    for (int f = 0; f < files; f++)
+        for (int i = 0; i < sides; i++)
+            out.insert(out.end(), packed[i][f].sparse.begin(),
+                       packed[i][f].sparse.end());
+
+    for (int f = 0; f < files; f++)
+        for (int i = 0; i < sides; i++)
+            out.insert(out.end(), packed[i][f].lengths.begin(),
+                       packed[i][f].lengths.end());
+
+    for (int f = 0; f < files; f++) {
+        for (int i = 0; i < sides; i++) {
+            out.resize((out.size() + 63) & ~std::size_t(63));
+            out.insert(out.end(), packed[i][f].blocks.begin(),
+                       packed[i][f].blocks.end());
+        }
+    }
+
+    // the decoder may read a word past the last block; real tables end
+    // 16 bytes past a multiple of 64
+    out.resize(out.size() + 8);
+    out.resize(((out.size() + 47) & ~std::size_t(63)) + 16);
+
+    const std::string path =
+          dir + "/" + t.name + (type == TB_WDL ? ".rtbw" : ".rtbz");
+    std::ofstream file(path, std::ios::binary);
+    file.write((const char *)out.data(), out.size());
+    std::cout << path << ": " << out.size() << " bytes" << std::endl;
+
+    return bool(file);
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        std::cerr << "usage: tbgen <dir>\n";
+        return 1;
+    }
+
+    init_arrays();
+    initMvvLva();
+
+    // every ending only captures or promotes into the ones before it
+    std::deque<Ending> all;
+    all.push_back(makeEnding("KBvK", WHITE));
+    all.push_back(makeEnding("KNvK", WHITE));
+    all.push_back(makeEnding("KQvK", WHITE));
+    all.push_back(makeEnding("KRvK", BLACK));
+    all.push_back(makeEnding("KPvK", WHITE));
+    all.push_back(makeEnding("KBNvK", BLACK));
+
+    std::unique_ptr<Board> board = std::make_unique<Board>();
+
+    for (Ending &t : all) {
+        endings[t.key] = &t;
+        solveWdl(t, *board);
+
+        if (!solveDtz(t, *board) || !writeTable(t, TB_WDL, argv[1]) ||
+            !writeTable(t, TB_DTZ, argv[1]))
+            return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,201 @@
+/*
+**    Yayo is a UCI chess engine written by am5083 (am@kvasm.us)
+**    Copyright (C) 2022 Ahmed Mohamed (am@kvasm.us)
+**
+**    This program is free software: you can redistribute it and/or modify
+**    it under the terms of the GNU General Public License as published by
+**    the Free Software Foundation, either version 3 of the License, or
+**    (at your option) any later version.
+**
+**    This program is distributed in the hope that it will be useful,
+**    but WITHOUT ANY WARRANTY; without even the implied warranty of
+**    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+**    GNU General Public License for more details.
+**
+**    You should have received a copy of the GNU General Public License
+**    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+** Probes the tables in tests/syzygy, written by tbgen: test_tbprobe <dir>
+**
+** Known positions first, then random positions of every table against the
+** values one move away, which catches a wrong index as well as a wrong
+** decode.
+*/
+
+#include "src/board.hpp"
+#include "src/movegen.hpp"
+#include "src/tbprobe.hpp"
+#include "tests/check.hpp"
+#include <memory>
+#include <random>
+
+using namespace Yayo;
+using namespace Yayo::Bitboards;
+
+namespace {
+
+struct Known {
+    std::string fen;
+    WDLScore wdl;
+    int dtz;
+};
+
+// mates, stalemates and forced captures around each table
+const Known known[] = {
+      {"7k/8/6K1/8/8/8/Q7/8 w - - 0 1", WDL_WIN, 1},
+      {"Q6k/8/6K1/8/8/8/8/8 b - - 0 1", WDL_LOSS, -1},
+      {"7k/5Q2/6K1/8/8/8/8/8 b - - 0 1", WDL_DRAW, 0},
+      {"8/8/8/8/8/8/1Q6/k3K3 b - - 0 1", WDL_DRAW, 0},
+      {"7k/8/6K1/8/8/8/8/R7 w - - 0 1", WDL_WIN, 1},
+      {"R6k/8/6K1/8/8/8/8/8 b - - 0 1", WDL_LOSS, -1},
+      {"8/8/8/8/8/8/3kP3/7K b - - 0 1", WDL_DRAW, 0},
+      {"7k/8/8/8/8/8/7P/7K w - - 0 1", WDL_DRAW, 0},
+      {"8/4P3/8/8/8/8/k7/7K w - - 0 1", WDL_WIN, 1},
+      {"8/4P3/8/8/8/8/k7/7K b - - 0 1", WDL_LOSS, -2},
+      {"7k/4N3/6K1/8/8/8/8/2B5 w - - 0 1", WDL_WIN, 1},
+      {"7k/4N3/6K1/8/8/8/8/B7 b - - 0 1", WDL_LOSS, -1},
+      {"8/8/8/8/8/8/1k6/NB5K b - - 0 1", WDL_DRAW, 0},
+      {"8/8/8/8/3k4/8/8/1B2K3 w - - 0 1", WDL_DRAW, 0},
+      {"8/8/8/8/3k4/8/8/N3K3 b - - 0 1", WDL_DRAW, 0},
+};
+
+// white pieces of each table, black only has a king
+const std::string tables[] = {"Q", "R", "P", "B", "N", "BN"};
+
+std::string randomFen(std::mt19937_64 &rng, const std::string &white) {
+    const std::string pcs = "K" + white + "k";
+    char grid[64];
+
+    while (true) {
+        std::fill(grid, grid + 64, '1');
+
+        bool ok = true;
+        for (char pc : pcs) {
+            const int sq = rng() % 64;
+            ok &= grid[sq] == '1' && (pc != 'P' || (sq >= 8 && sq < 56));
+            grid[sq] = pc;
+        }
+
+        if (!ok)
+            continue;
+
+        std::string fen;
+        for (int r = 0; r < 8; r++) {
+            fen.append(grid + 8 * r, grid + 8 * r + 8);
+            fen += r < 7 ? "/" : rng() & 1 ? " w" : " b";
+        }
+
+        return fen + " - - 0 1";
+    }
+}
+
+// the side that just moved can't be in check
+bool legal(const Board &board) {
+    const Color other = Color(board.turn ^ 1);
+    const Square ksq = Square(__builtin_ctzll(board.pieces(KING, other)));
+    return !board.isSqAttacked(ksq, board.pieces(), board.turn);
+}
+
+WDLScore wdlOf(Board &board) {
+    ProbeState result;
+    const WDLScore wdl = tb.probeWDL(board, &result);
+    CHECK(result != PROBE_FAIL);
+    return wdl;
+}
+
+int dtzOf(Board &board) {
+    ProbeState result;
+    const int dtz = tb.probeDTZ(board, &result);
+    CHECK(result != PROBE_FAIL);
+    return dtz;
+}
+
+bool zeroing(const Board &board, unsigned short move) {
+    return getCapture(move) >= CAPTURE ||
+           getPcType(board.board[getFrom(move)]) == PAWN;
+}
+
+// wdl is the best child for the side to move; dtz is 1 for a winning
+// zeroing move or a mate, else one more than the child it plays into,
+// fastest for a win and slowest for a loss
+void checkAgainstChildren(Board &board) {
+    const WDLScore wdl = wdlOf(board);
+    const int dtz = dtzOf(board);
+
+    moveList mList = {{{0}}};
+    generate(board, &mList);
+
+    int best = mList.nMoves || board.checkPcs ? WDL_LOSS : WDL_DRAW;
+    int winDtz = 1000, lossDtz = 1;
+
+    for (int i = 0; i < mList.nMoves; i++) {
+        const unsigned short move = mList.moves[i].move;
+        const bool zero = zeroing(board, move);
+
+        make(board, move);
+        const int value =
+              popcount(board.pieces()) == 2 ? WDL_DRAW : -wdlOf(board);
+        const int after = zero || value == WDL_DRAW ? 0 : dtzOf(board);
+
+        const bool mate = board.checkPcs && [&] {
+            moveList replies = {{{0}}};
+            generate(board, &replies);
+            return !replies.nMoves;
+        }();
+        unmake(board, move);
+
+        best = std::max(best, value);
+        if (value == WDL_WIN)
+            winDtz = std::min(winDtz, zero || mate ? 1 : 1 - after);
+        if (value == WDL_LOSS)
+            lossDtz = std::max(lossDtz, zero ? 1 : 1 + after);
+    }
+
+    CHECK_EQ(int(wdl), best);
+    if (wdl == WDL_WIN)
+        CHECK_EQ(dtz, winDtz);
+    else if (wdl == WDL_LOSS)
+        CHECK_EQ(dtz, -lossDtz);
+    else
+        CHECK_EQ(dtz, 0);
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        std::cerr << "usage: test_tbprobe <dir>" << std::endl;
+        return 1;
+    }
+
+    init_arrays();
+    initMvvLva();
+    tb.init(argv[1]);
+    CHECK(tb.largest() >= 4);
+
+    std::unique_ptr<Board> board = std::make_unique<Board>();
+
+    for (const Known &k : known) {
+        board->setFen(k.fen);
+        CHECK(legal(*board));
+        CHECK_EQ(int(wdlOf(*board)), int(k.wdl));
+        CHECK_EQ(dtzOf(*board), k.dtz);
+    }
+
+    std::mt19937_64 rng(2022);
+    for (const std::string &white : tables) {
+        for (int n = 0; n < 1000;) {
+            board->setFen(randomFen(rng, white));
+            if (!legal(*board))
+                continue;
+
+            checkAgainstChildren(*board);
+            n++;
+        }
+    }
+
+    std::cout << (failures ? "FAILED" : "ok") << std::endl;
+    return failures != 0;
+}